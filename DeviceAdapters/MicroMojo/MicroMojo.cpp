@@ -14,6 +14,8 @@
 
 #include "MicroMojo.h"
 #include "../../MMDevice/ModuleInterface.h"
+#include <cstdlib>
+#include <algorithm>
 
 #ifdef WIN32
 #include <windows.h>
@@ -28,27 +30,23 @@ const char* g_DeviceNameMojoTTL = "Mojo-TTL";
 const char* g_DeviceNameMojoServos = "Mojo-Servos";
 
 //////////////////////////////////////////////////////////////////////////////
-/// Constants that should match the one in the firmware
-const int g_version = 1;
-
-const int g_maxlasers = 6;
-const int g_maxanaloginput = 8;
-const int g_maxttl = 6;
-const int g_maxpwm = 6;
-const int g_maxservos = 6;
-
-const int g_offsetaddressLaserMode = 0;
-const int g_offsetaddressLaserDuration = 10;
-const int g_offsetaddressLaserSequence = 20;
-const int g_offsetaddressTTL = 30;
-const int g_offsetaddressServo = 40;
-const int g_offsetaddressPWM = 50;
-const int g_offsetaddressAnalogInput = 60;
-
-const int g_address_version = 100;
-
-// static lock
-MMThreadLock MojoHub::lock_;
+// Maximum number of read requests sent to the Mojo before waiting for their answers
+const int g_maxpipelinedepth = 8;
+// Maximum number of write requests packed in a single transfer
+const int g_maxbatchsize = 32;
+// Time (ms) after which a missing answer is reported as a timeout
+const double g_answertimeout = 500.0;
+// Time (ms) during which ReadAnswer only yields while waiting, before sleeping
+const double g_answerspin = 2.0;
+// Number of sample blocks kept by MojoInput when streaming
+const unsigned long g_streamingbuffersize = 4096;
+const long g_maxstreamingwindow = 1024;
+// Number of blocks shown by the MojoInput recent blocks property
+const unsigned long g_recentblocks = 16;
+// Age (ms) after which a value of a MojoInput read pass is read again
+const double g_maxinputage = 20.0;
+// Number of transaction latencies kept for the hub statistics
+const unsigned long g_maxlatencysamples = 4096;
 
 ///////////////////////////////////////////////////////////////////////////////
 // Exported MMDevice API
@@ -106,7 +104,19 @@ MODULE_API void DeleteDevice(MM::Device* pDevice)
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~
 //
 MojoHub::MojoHub() :
-	initialized_ (false)
+	initialized_ (false),
+	rxHead_(0),
+	rxCount_(0),
+	verifyWrites_(false),
+	supportsSequences_(false),
+	supportsTrajectories_(false),
+	baudRate_(9600),
+	simulated_(false),
+	simulator_(0),
+	transactions_(0),
+	commandThread_(0),
+	inFlight_(0),
+	stopCommands_(false)
 {
 	portAvailable_ = false;
 
@@ -116,9 +126,18 @@ MojoHub::MojoHub() :
 	SetErrorText(ERR_NO_PORT_SET, "Hub Device not found. The Mojo Hub device is needed to create this device");
 	SetErrorText(ERR_VERSION_MISMATCH, "The firmware version on the Mojo is not compatible with this adapter. Please use firmware version 1.");
 	SetErrorText(ERR_COMMAND_UNKNOWN, "An unknown command was sent to the Mojo.");
+	SetErrorText(ERR_ANSWER_TIMEOUT, "The Mojo did not answer in time.");
+	SetErrorText(ERR_VERIFY_FAILED, "The value read back from the Mojo differs from the value written.");
+	SetErrorText(ERR_BAUDRATE_FAILED, "Lost the communication with the Mojo while changing the baud rate.");
 
 	CPropertyAction* pAct = new CPropertyAction(this, &MojoHub::OnPort);
 	CreateProperty(MM::g_Keyword_Port, "Undefined", MM::String, false, pAct, true);
+
+	// Simulated firmware, to use the adapter without a board
+	pAct = new CPropertyAction(this, &MojoHub::OnSimulated);
+	CreateProperty("Simulated", "No", MM::String, false, pAct, true);
+	AddAllowedValue("Simulated", "No");
+	AddAllowedValue("Simulated", "Yes");
 }
 
 MojoHub::~MojoHub()
@@ -133,13 +152,13 @@ void MojoHub::GetName(char* name) const
 
 bool MojoHub::Busy()
 {
-	return false;
+	return HasPendingWrites();
 }
 
 MM::DeviceDetectionStatus MojoHub::DetectDevice(void)
 {
 	// Code adapted from Arduino.cpp, Micro-Manager, written by Nico Stuurman and Karl Hoover
-	if (initialized_)
+	if (initialized_ || simulated_)
 		return MM::CanCommunicate;
 
 	MM::DeviceDetectionStatus result = MM::Misconfigured;
@@ -168,16 +187,31 @@ MM::DeviceDetectionStatus MojoHub::DetectDevice(void)
 
 			CDeviceUtils::SleepMs(100);
 			MMThreadGuard myLock(lock_);
-			PurgeComPort(port_.c_str());
-			long v = 0;
-			int ret = GetControllerVersion(v);
 
-			if( DEVICE_OK != ret ){
-				LogMessageCode(ret,true);
-			} else {
+			// The Mojo may have been left at a faster rate, e.g. after a crash
+			for(int i=0;i<g_numbaudrates;i++){
+				long v = 0;
+				int ret = SetPortBaudRate(g_baudrates[i]);
+				if( DEVICE_OK == ret ){
+					ret = GetControllerVersion(v);
+				}
+
+				if( DEVICE_OK != ret ){
+					LogMessageCode(ret,true);
+					continue;
+				}
+
+				if(i > 0){
+					// Back to the default rate expected by Initialize, the request is not answered
+					SendWriteRequest(g_address_baudrate, 0);
+					CDeviceUtils::SleepMs(20);
+				}
+
 				// to succeed must reach here....
 				result = MM::CanCommunicate;
+				break;
 			}
+			GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_BaudRate, "9600" );
 			pS->Shutdown();
 			// always restore the AnswerTimeout to the default
 			GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", answerTO);
@@ -204,7 +238,10 @@ int MojoHub::Initialize()
 
 	MMThreadGuard myLock(lock_);
 
-	PurgeComPort(port_.c_str());
+	if (simulated_)
+		simulator_ = new MojoSimulator();
+
+	PurgeComPortH();
 
 	// Get controller version
 	ret = GetControllerVersion(version_);
@@ -221,6 +258,55 @@ int MojoHub::Initialize()
 	sversion << version_;
 	CreateProperty("MicroMojo version", sversion.str().c_str(), MM::Integer, true, pAct);
 
+	// Optional firmware features
+	ret = ProbeRegister(g_offsetaddressTTLSequenceLength, supportsSequences_);
+	if( DEVICE_OK != ret)
+		return ret;
+	CreateProperty("Supports sequences", supportsSequences_ ? "Yes" : "No", MM::String, true);
+
+	ret = ProbeRegister(g_offsetaddressServoTrajectoryStatus, supportsTrajectories_);
+	if( DEVICE_OK != ret)
+		return ret;
+	CreateProperty("Supports trajectories", supportsTrajectories_ ? "Yes" : "No", MM::String, true);
+
+	// Switch to the fastest baud rate supported by the firmware
+	ret = NegotiateBaudRate();
+	if( DEVICE_OK != ret)
+		return ret;
+	CreateProperty("Baud rate", CDeviceUtils::ConvertToString(baudRate_), MM::Integer, true);
+
+	// Register cache
+	pAct = new CPropertyAction(this, &MojoHub::OnResync);
+	CreateProperty("Resync registers", "Idle", MM::String, false, pAct);
+	AddAllowedValue("Resync registers", "Idle");
+	AddAllowedValue("Resync registers", "Resync");
+
+	pAct = new CPropertyAction(this, &MojoHub::OnVerifyWrites);
+	CreateProperty("Verify writes", "No", MM::String, false, pAct);
+	AddAllowedValue("Verify writes", "No");
+	AddAllowedValue("Verify writes", "Yes");
+
+	// Communication statistics
+	CPropertyActionEx* pExAct = new CPropertyActionEx(this, &MojoHub::OnStatistics, 0);
+	CreateProperty("Transactions", "0", MM::Integer, true, pExAct);
+	pExAct = new CPropertyActionEx(this, &MojoHub::OnStatistics, 1);
+	CreateProperty("Transactions per second", "0", MM::Float, true, pExAct);
+	pExAct = new CPropertyActionEx(this, &MojoHub::OnStatistics, 2);
+	CreateProperty("Latency p50 (ms)", "0", MM::Float, true, pExAct);
+	pExAct = new CPropertyActionEx(this, &MojoHub::OnStatistics, 3);
+	CreateProperty("Latency p99 (ms)", "0", MM::Float, true, pExAct);
+
+	pAct = new CPropertyAction(this, &MojoHub::OnResetStatistics);
+	CreateProperty("Reset statistics", "Idle", MM::String, false, pAct);
+	AddAllowedValue("Reset statistics", "Idle");
+	AddAllowedValue("Reset statistics", "Reset");
+	statisticsStart_ = GetCurrentMMTime();
+
+	// Writes of the peripherals are sent by the command thread
+	stopCommands_ = false;
+	commandThread_ = new MojoHubCommandThread(*this);
+	commandThread_->Start();
+
 	initialized_ = true;
 	return DEVICE_OK;
 }
@@ -252,6 +338,28 @@ int MojoHub::DetectInstalledDevices()
 
 int MojoHub::Shutdown()
 {
+	if (commandThread_ != 0)
+	{
+		delete commandThread_;
+		commandThread_ = 0;
+
+		// send the writes submitted after the thread stopped
+		FlushQueue();
+	}
+
+	if (initialized_ && baudRate_ != g_baudrates[0])
+	{
+		// Go back to the default rate expected by DetectDevice and Initialize
+		MMThreadGuard myLock(lock_);
+		SwitchBaudRate(0);
+	}
+
+	if (simulator_ != 0)
+	{
+		delete simulator_;
+		simulator_ = 0;
+	}
+
 	initialized_ = false;
 	return DEVICE_OK;
 }
@@ -269,9 +377,8 @@ int MojoHub::GetControllerVersion(long& version)
 	return ret;
 }
 
-int MojoHub::SendWriteRequest(long address, long value)
-{   
-	unsigned char command[9];
+void MojoHub::FormatWriteRequest(unsigned char* command, long address, long value)
+{
 	command[0] = (1 << 7);	// 1 = write
 	command[1] = static_cast<char>(address);	// put the least significant byte
 	command[2] = static_cast<char>((address >> 8));	// put the least but one significant byte 
@@ -281,245 +388,844 @@ int MojoHub::SendWriteRequest(long address, long value)
 	command[6] = static_cast<char>((value >> 8));	
 	command[7] = static_cast<char>((value >> 16));	
 	command[8] = static_cast<char>((value >> 24));	
-
-	int ret = WriteToComPortH((const unsigned char*) command, 9);
-
-	return ret;
 }
-int MojoHub::SendReadRequest(long address){
-	unsigned char command[5];
+
+void MojoHub::FormatReadRequest(unsigned char* command, long address)
+{
 	command[0] = (0 << 7);	
 	command[1] = static_cast<char>(address);	
 	command[2] = static_cast<char>((address >> 8));	
 	command[3] = static_cast<char>((address >> 16));	
 	command[4] = static_cast<char>((address >> 24));
+}
 
-	int ret = WriteToComPortH((const unsigned char*) command, 5);
+int MojoHub::ProbeRegister(long address, bool& available)
+{
+	// Registers unknown to the firmware are answered with ERR_COMMAND_UNKNOWN
+	long value;
+	int ret = ReadRegisters(&address, &value, 1);
+	if(ret == ERR_COMMAND_UNKNOWN){
+		available = false;
+		return DEVICE_OK;
+	}
 
+	available = (ret == DEVICE_OK);
 	return ret;
 }
 
-int MojoHub::ReadAnswer(long& ans){
-	unsigned char* answer = new unsigned char[4];
-	
-	// Code adapted from Arduino.cpp, Micro-Manager, written by Nico Stuurman and Karl Hoover
-	MM::MMTime startTime = GetCurrentMMTime();  
-	unsigned long bytesRead = 0;
-
-	while ((bytesRead < 4) && ( (GetCurrentMMTime() - startTime).getMsec() < 500)) {
-		unsigned long bR;
-		int ret = ReadFromComPortH(answer + bytesRead, 4 - bytesRead, bR);
-		if (ret != DEVICE_OK)
-			return ret;
-		bytesRead += bR;
-	}
+int MojoHub::NegotiateBaudRate()
+{
+	baudRate_ = g_baudrates[0];
+
+	// Firmware without the baud rate register only runs at the default rate
+	long address = g_address_baudrate;
+	long mask;
+	int ret = ReadRegisters(&address, &mask, 1);
+	if (ret == ERR_COMMAND_UNKNOWN)
+		return DEVICE_OK;
+	if (ret != DEVICE_OK)
+		return ret;
 
-	// Format answer
-	int tmp = answer[3];
-	for(int i=1;i<4;i++){
-		tmp = tmp << 8;
-		tmp = tmp | answer[3-i];
-	}
+	// Try the fastest rates first
+	for(int i=g_numbaudrates-1;i>0;i--){
+		if((mask & (1 << i)) == 0){
+			continue;
+		}
 
-	ans = tmp;
+		ret = SwitchBaudRate(i);
+		if(ret == DEVICE_OK){
+			return DEVICE_OK;
+		}
 
-	// If unknown command answer
-	if(ans == ERR_COMMAND_UNKNOWN){
-		return ERR_COMMAND_UNKNOWN;
+		// SwitchBaudRate restored the default rate, give up only if that failed too
+		if(baudRate_ != g_baudrates[0]){
+			return ERR_BAUDRATE_FAILED;
+		}
 	}
 
 	return DEVICE_OK;
 }
 
-int MojoHub::OnPort(MM::PropertyBase* pProp, MM::ActionType pAct)
+int MojoHub::SwitchBaudRate(int index)
 {
-	if (pAct == MM::BeforeGet)
-	{
-		pProp->Set(port_.c_str());
+	// Ask the firmware to switch first, the request is not answered
+	unsigned char command[9];
+	FormatWriteRequest(command, g_address_baudrate, index);
+	int ret = WriteToComPortH(command, 9);
+	if (ret != DEVICE_OK)
+		return ret;
+	CDeviceUtils::SleepMs(20);
+
+	// From here on the firmware may be at the new rate, every failure goes through 
+	// the fallback below
+	long version;
+	ret = SetPortBaudRate(g_baudrates[index]);
+	if (ret == DEVICE_OK){
+		// Check the link at the new rate
+		ret = GetControllerVersion(version);
+		if(ret == DEVICE_OK && version == version_){
+			baudRate_ = g_baudrates[index];
+			return DEVICE_OK;
+		}
 	}
-	else if (pAct == MM::AfterSet)
-	{
-		pProp->Get(port_);
-		portAvailable_ = true;
+
+	std::ostringstream os;
+	os << "No communication with the Mojo at " << g_baudrates[index] << " baud, falling back to " << g_baudrates[0];
+	LogMessage(os.str(), false);
+
+	// Fall back to the default rate on both ends, the firmware may or may not have switched
+	FormatWriteRequest(command, g_address_baudrate, 0);
+	WriteToComPortH(command, 9);
+	CDeviceUtils::SleepMs(20);
+
+	ret = SetPortBaudRate(g_baudrates[0]);
+	if (ret == DEVICE_OK){
+		ret = GetControllerVersion(version);
 	}
-	return DEVICE_OK;
+	if(ret != DEVICE_OK || version != version_){
+		baudRate_ = 0;
+		return ERR_BAUDRATE_FAILED;
+	}
+
+	baudRate_ = g_baudrates[0];
+	return index == 0 ? DEVICE_OK : ERR_BAUDRATE_FAILED;
 }
 
-int MojoHub::OnVersion(MM::PropertyBase* pProp, MM::ActionType pAct)
+int MojoHub::SetPortBaudRate(long rate)
 {
-	if (pAct == MM::BeforeGet)
+	if (simulator_)
 	{
-		pProp->Set((long)version_);
+		simulator_->SetBaudRate(rate);
+		return PurgeComPortH();
 	}
-	return DEVICE_OK;
+
+	int ret = GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_BaudRate, CDeviceUtils::ConvertToString(rate));
+	if (ret != DEVICE_OK)
+		return ret;
+
+	return PurgeComPortH();
 }
 
+int MojoHub::SendWriteRequest(long address, long value)
+{   
+	unsigned char command[9];
+	FormatWriteRequest(command, address, value);
+
+	int ret = WriteToComPortH((const unsigned char*) command, 9);
 
-///////////////////////////////////////////////////////////////////////////////////////////
-//////
-MojoLaserTrig::MojoLaserTrig() :
-initialized_ (false),
-	busy_(false)
-{
-	InitializeDefaultErrorMessages();
+	return ret;
+}
 
-	// Custom error messages
-	SetErrorText(ERR_NO_PORT_SET, "Hub Device not found. The Mojo Hub device is needed to create this device");
-	SetErrorText(ERR_COMMAND_UNKNOWN, "An unknown command was sent to the Mojo.");
+int MojoHub::SendReadRequest(long address){
+	unsigned char command[5];
+	FormatReadRequest(command, address);
 
-	// Description
-	int ret = CreateProperty(MM::g_Keyword_Description, "Mojo laser triggering system", MM::String, true);
-	assert(DEVICE_OK == ret);
+	int ret = WriteToComPortH((const unsigned char*) command, 5);
+	if (ret != DEVICE_OK)
+		return ret;
 
-	// Name
-	ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameMojoLaserTrig, MM::String, true);
-	assert(DEVICE_OK == ret);
+	// the Mojo answers the read requests in the order they were received
+	pending_.push_back(address);
 
-	// Number of lasers
-	CPropertyAction* pAct = new CPropertyAction(this, &MojoLaserTrig::OnNumberOfLasers);
-	CreateProperty("Number of lasers", "4", MM::Integer, false, pAct, true);
-	SetPropertyLimits("Number of lasers", 1, g_maxlasers);
+	return DEVICE_OK;
 }
 
-
-MojoLaserTrig::~MojoLaserTrig()
+int MojoHub::PurgeComPortH()
 {
-	Shutdown();
+	// outstanding answers and received bytes are discarded with the port buffers
+	pending_.clear();
+	rxHead_ = 0;
+	rxCount_ = 0;
+	if (simulator_){
+		simulator_->Purge();
+		return DEVICE_OK;
+	}
+	return PurgeComPort(port_.c_str());
 }
 
-void MojoLaserTrig::GetName(char* name) const
+int MojoHub::FillReceiveBuffer(unsigned long& bytesRead)
 {
-	CDeviceUtils::CopyLimitedString(name, g_DeviceNameMojoLaserTrig);
-}
+	// Move the bytes available on the port into the free part of the ring buffer
+	bytesRead = 0;
+	while(rxCount_ < MOJO_RX_BUFFER_SIZE){
+		unsigned int tail = (rxHead_ + rxCount_) % MOJO_RX_BUFFER_SIZE;
+		unsigned int space = (tail >= rxHead_) ? MOJO_RX_BUFFER_SIZE - tail : rxHead_ - tail;
+
+		unsigned long bR = 0;
+		int ret = ReadFromComPortH(rxBuffer_ + tail, space, bR);
+		if (ret != DEVICE_OK)
+			return ret;
 
+		rxCount_ += bR;
+		bytesRead += bR;
 
-int MojoLaserTrig::Initialize()
-{
-	// Parent ID display	
-	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-	if (!hub) {
-		return ERR_NO_PORT_SET;
+		if(bR < space){ // nothing left on the port
+			break;
+		}
 	}
-	char hubLabel[MM::MaxStrLength];
-	hub->GetLabel(hubLabel);
-	SetParentID(hubLabel);
-	CreateHubIDProperty();
+	return DEVICE_OK;
+}
 
-	// Allocate memory for lasers
-	mode_ = new long [GetNumberOfLasers()];
-	duration_ = new long [GetNumberOfLasers()];
-	sequence_ = new long [GetNumberOfLasers()];
+int MojoHub::ReadAnswer(long& ans){
+	// Code adapted from Arduino.cpp, Micro-Manager, written by Nico Stuurman and Karl Hoover
+	MM::MMTime startTime = GetCurrentMMTime();  
 
-	CPropertyActionEx *pExAct;
-	int nRet;
+	// Wait for the 4 bytes of the answer, bytes received in excess are kept for the 
+	// next pipelined answers
+	while(rxCount_ < 4){
+		unsigned long bytesRead;
+		int ret = FillReceiveBuffer(bytesRead);
+		if (ret != DEVICE_OK)
+			return ret;
 
-	for(unsigned int i=0;i<GetNumberOfLasers();i++){	
-		mode_[i] = 0;
-		duration_[i] = 0;
-		sequence_[i] = 0;
+		if(rxCount_ >= 4){
+			break;
+		}
 
-		std::stringstream mode;
-		std::stringstream dura;
-		std::stringstream seq;
-		mode << "Mode" << i;
-		dura << "Duration" << i;
-		seq << "Sequence" << i;
+		double elapsed = (GetCurrentMMTime() - startTime).getMsec();
+		if(elapsed >= g_answertimeout){
+			std::ostringstream os;
+			os << "No answer from the Mojo after " << elapsed << " ms (" << rxCount_ << " of 4 bytes received, "
+				<< pending_.size() << " request(s) pending)";
+			LogMessage(os.str(), false);
 
-		pExAct = new CPropertyActionEx (this, &MojoLaserTrig::OnDuration,i);
-		nRet = CreateProperty(dura.str().c_str(), "0", MM::Integer, false, pExAct);
-		if (nRet != DEVICE_OK)
-			return nRet;
-		SetPropertyLimits(dura.str().c_str(), 0, 65535);   
+			PurgeComPortH();
+			return ERR_ANSWER_TIMEOUT;
+		}
 
-		pExAct = new CPropertyActionEx (this, &MojoLaserTrig::OnMode,i);
-		nRet = CreateProperty(mode.str().c_str(), "0", MM::Integer, false, pExAct);
-		if (nRet != DEVICE_OK)
-			return nRet;
-		SetPropertyLimits(mode.str().c_str(), 0, 4);
+		// Nothing arrived: only yield at first, a sleep lasts a whole scheduler tick 
+		// (15.6 ms on Windows) which is longer than most answers. A slow or silent 
+		// board is then waited for without spinning a core.
+		if(bytesRead == 0){
+			CDeviceUtils::SleepMs(elapsed < g_answerspin ? 0 : 1);
+		}
+	}
 
-		pExAct = new CPropertyActionEx (this, &MojoLaserTrig::OnSequence,i);
-		nRet = CreateProperty(seq.str().c_str(), "65535", MM::Integer, false, pExAct);
-		if (nRet != DEVICE_OK)
-			return nRet;
-		SetPropertyLimits(seq.str().c_str(), 0, 65535);
+	// Format answer (little-endian)
+	unsigned char answer[4];
+	for(int i=0;i<4;i++){
+		answer[i] = rxBuffer_[rxHead_];
+		rxHead_ = (rxHead_ + 1) % MOJO_RX_BUFFER_SIZE;
 	}
+	rxCount_ -= 4;
 
-	nRet = UpdateStatus();
-	if (nRet != DEVICE_OK)
-		return nRet;
+	int tmp = answer[3];
+	for(int i=1;i<4;i++){
+		tmp = tmp << 8;
+		tmp = tmp | answer[3-i];
+	}
 
-	initialized_ = true;
+	ans = tmp;
 
-	return DEVICE_OK;
-}
+	if(!pending_.empty()){
+		pending_.pop_front();
+	}
+
+	// If unknown command answer
+	if(ans == ERR_COMMAND_UNKNOWN){
+		return ERR_COMMAND_UNKNOWN;
+	}
 
-int MojoLaserTrig::Shutdown()
-{
-	initialized_ = false;
 	return DEVICE_OK;
 }
 
-int MojoLaserTrig::WriteToPort(long address, long value)
+int MojoHub::ReadRegisters(const long* addresses, long* answers, int n)
 {
-	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-	if (!hub) {
-		return ERR_NO_PORT_SET;
-	}
-
-	MMThreadGuard myLock(hub->GetLock());
-
-	hub->PurgeComPortH();
+	MMThreadGuard myLock(lock_);
 
-	int ret = hub->SendWriteRequest(address, value);
+	// The answers must reflect the writes submitted before
+	int ret = FlushQueue();
 	if (ret != DEVICE_OK)
 		return ret;
 
-	return DEVICE_OK;
+	// Pipeline the read requests: send them by batches of g_maxpipelinedepth frames in 
+	// a single transfer and match each answer to its request by arrival order.
+	unsigned char command[5*g_maxpipelinedepth];
+	int sent = 0;
+	int received = 0;
+	int error = DEVICE_OK;
+	MM::MMTime batchStart;
+	while(received < n){
+		if(sent == received){
+			int batch = 0;
+			while(sent + batch < n && batch < g_maxpipelinedepth){
+				FormatReadRequest(command + 5*batch, addresses[sent + batch]);
+				batch++;
+			}
+
+			batchStart = GetCurrentMMTime();
+			ret = WriteToComPortH((const unsigned char*) command, 5*batch);
+			if (ret != DEVICE_OK){
+				PurgeComPortH();
+				return ret;
+			}
+
+			for(int i=0;i<batch;i++){
+				pending_.push_back(addresses[sent + i]);
+			}
+			sent += batch;
+		}
+
+		ret = ReadAnswer(answers[received]);
+		if(ret == DEVICE_OK || ret == ERR_COMMAND_UNKNOWN){
+			RecordTransaction((GetCurrentMMTime() - batchStart).getMsec());
+		}
+		if(ret == ERR_COMMAND_UNKNOWN){
+			// the request was answered, keep the pipeline going
+			error = ret;
+		} else if (ret != DEVICE_OK){
+			// the remaining answers cannot be matched anymore
+			PurgeComPortH();
+			return ret;
+		} else if(IsShadowed(addresses[received])){
+			shadow_[addresses[received]] = answers[received];
+		}
+		received++;
+	}
+
+	return error;
 }
 
-int MojoLaserTrig::ReadFromPort(long& answer)
+int MojoHub::WriteRegisters(const long* addresses, const long* values, int n)
 {
-	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-	if (!hub) {
-		return ERR_NO_PORT_SET;
-	}
-	int ret = hub->ReadAnswer(answer);
+	MMThreadGuard myLock(lock_);
+
+	// Keep the order of the writes submitted before
+	int ret = FlushQueue();
 	if (ret != DEVICE_OK)
 		return ret;
 
-	return DEVICE_OK;
-}
+	ret = SendWrites(addresses, values, n);
+	if (ret != DEVICE_OK)
+		return ret;
 
+	if(verifyWrites_){
+		std::vector<long> readback(n);
+		ret = ReadRegisters(addresses, &readback[0], n);
+		if (ret != DEVICE_OK)
+			return ret;
 
-///////////////////////////////////////
-/////////// Action handlers
-int MojoLaserTrig::OnNumberOfLasers(MM::PropertyBase* pProp, MM::ActionType pAct)
-{
-	if (pAct == MM::BeforeGet){
-		pProp->Set(numlasers_);
-	} else if (pAct == MM::AfterSet){
-		pProp->Get(numlasers_);
+		for(int i=0;i<n;i++){
+			if(readback[i] != values[i])
+				return ERR_VERIFY_FAILED;
+		}
 	}
+
 	return DEVICE_OK;
 }
 
-int MojoLaserTrig::OnMode(MM::PropertyBase* pProp, MM::ActionType pAct, long laser)
+int MojoHub::SendWrites(const long* addresses, const long* values, int n)
 {
-	if (pAct == MM::BeforeGet)
-	{
-		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-		if (!hub){
-			return ERR_NO_PORT_SET;
+	// Discard stray bytes, unless answers are still expected
+	if(pending_.empty()){
+		PurgeComPortH();
+	}
+
+	// Write requests are not answered, pack them by batches of g_maxbatchsize frames
+	unsigned char command[9*g_maxbatchsize];
+	int sent = 0;
+	while(sent < n){
+		int batch = 0;
+		while(sent + batch < n && batch < g_maxbatchsize){
+			FormatWriteRequest(command + 9*batch, addresses[sent + batch], values[sent + batch]);
+			batch++;
+		}
+
+		MM::MMTime batchStart = GetCurrentMMTime();
+		int ret = WriteToComPortH((const unsigned char*) command, 9*batch);
+		if (ret != DEVICE_OK)
+			return ret;
+
+		// write requests complete with their transfer
+		double latency = (GetCurrentMMTime() - batchStart).getMsec();
+		for(int i=0;i<batch;i++){
+			RecordTransaction(latency);
+		}
+
+		for(int i=0;i<batch;i++){
+			if(IsShadowed(addresses[sent + i])){
+				shadow_[addresses[sent + i]] = values[sent + i];
+			}
+		}
+		sent += batch;
+	}
+
+	return DEVICE_OK;
+}
+
+int MojoHub::WriteRegister(long address, long value)
+{
+	// Verified writes need the answer of the read-back
+	if(verifyWrites_ || commandThread_ == 0){
+		return WriteRegisters(&address, &value, 1);
+	}
+
+	return QueueWrite(address, value);
+}
+
+int MojoHub::QueueWrite(long address, long value)
+{
+	{
+		std::lock_guard<std::mutex> queueLock(queueMutex_);
+
+		// Report a failed background write of the same register instead of queuing the 
+		// new value, so that the error is not attached to a write that may still succeed
+		std::map<long, int>::iterator error = queueErrors_.find(address);
+		if(error != queueErrors_.end()){
+			int ret = error->second;
+			queueErrors_.erase(error);
+			return ret;
+		}
+
+		// A state register only needs its last value, update the write still waiting in 
+		// place so that the order of the writes to different registers is kept
+		bool coalesced = false;
+		if(IsShadowed(address)){
+			for(std::vector<std::pair<long, long> >::iterator it = queue_.begin(); it != queue_.end(); ++it){
+				if(it->first == address){
+					it->second = value;
+					coalesced = true;
+					break;
+				}
+			}
+		}
+		if(!coalesced){
+			queue_.push_back(std::make_pair(address, value));
+		}
+	}
+	queueReady_.notify_one();
+
+	return DEVICE_OK;
+}
+
+bool MojoHub::HasPendingWrites()
+{
+	std::lock_guard<std::mutex> queueLock(queueMutex_);
+	return !queue_.empty() || inFlight_ > 0;
+}
+
+bool MojoHub::WaitForCommands()
+{
+	std::unique_lock<std::mutex> queueLock(queueMutex_);
+	queueReady_.wait(queueLock, [this]{return stopCommands_ || !queue_.empty();});
+	return !stopCommands_;
+}
+
+void MojoHub::StopCommands()
+{
+	{
+		std::lock_guard<std::mutex> queueLock(queueMutex_);
+		stopCommands_ = true;
+	}
+	queueReady_.notify_all();
+}
+
+int MojoHub::FlushQueue(bool background)
+{
+	// The port lock is taken before emptying the queue so that the writes reach the Mojo 
+	// in the order they were submitted
+	MMThreadGuard myLock(lock_);
+
+	std::vector<long> addresses;
+	std::vector<long> values;
+	{
+		std::lock_guard<std::mutex> queueLock(queueMutex_);
+		for(unsigned int i=0;i<queue_.size();i++){
+			addresses.push_back(queue_[i].first);
+			values.push_back(queue_[i].second);
 		}
+		inFlight_ = queue_.size();
+		queue_.clear();
+	}
+
+	if(addresses.empty()){
+		return DEVICE_OK;
+	}
+
+	int ret = SendWrites(&addresses[0], &values[0], (int) addresses.size());
+
+	std::lock_guard<std::mutex> queueLock(queueMutex_);
+	inFlight_ = 0;
+
+	// Nobody waits for the writes sent in the background, the error is kept for the 
+	// next write of each register that may not have been written
+	if(background && ret != DEVICE_OK){
+		for(unsigned int i=0;i<addresses.size();i++){
+			queueErrors_.insert(std::make_pair(addresses[i], ret));
+		}
+	}
+	return ret;
+}
+
+int MojoHub::GetRegister(long address, long& value)
+{
+	// Writes still in the queue are the most recent values
+	{
+		std::lock_guard<std::mutex> queueLock(queueMutex_);
+		for(std::vector<std::pair<long, long> >::reverse_iterator it = queue_.rbegin(); it != queue_.rend(); ++it){
+			if(it->first == address){
+				value = it->second;
+				return DEVICE_OK;
+			}
+		}
+	}
+
+	MMThreadGuard myLock(lock_);
+
+	// The registers written by the adapter are answered from the shadow copy
+	if(IsShadowed(address)){
+		std::map<long, long>::iterator it = shadow_.find(address);
+		if(it != shadow_.end()){
+			value = it->second;
+			return DEVICE_OK;
+		}
+	}
+
+	return ReadRegisters(&address, &value, 1);
+}
+
+int MojoHub::WriteTable(long address, const std::vector<long>& values)
+{
+	if(values.empty()){
+		return DEVICE_OK;
+	}
+
+	std::vector<long> addresses(values.size());
+	for(unsigned int i=0;i<values.size();i++){
+		addresses[i] = address+i;
+	}
+
+	return WriteRegisters(&addresses[0], &values[0], (int) values.size());
+}
+
+int MojoHub::ResyncRegisters()
+{
+	MMThreadGuard myLock(lock_);
+
+	std::vector<long> addresses;
+	for(std::map<long, long>::iterator it = shadow_.begin(); it != shadow_.end(); ++it){
+		addresses.push_back(it->first);
+	}
+	if(addresses.empty()){
+		return DEVICE_OK;
+	}
+
+	// ReadRegisters refreshes the shadow copy with the values read
+	std::vector<long> values(addresses.size());
+	return ReadRegisters(&addresses[0], &values[0], (int) addresses.size());
+}
+
+void MojoHub::RecordTransaction(double latency)
+{
+	// Keep the latencies of the last g_maxlatencysamples transactions
+	if(latencies_.size() < g_maxlatencysamples){
+		latencies_.push_back(latency);
+	} else {
+		latencies_[transactions_ % g_maxlatencysamples] = latency;
+	}
+	transactions_++;
+}
+
+double MojoHub::GetLatencyPercentile(double percentile)
+{
+	if(latencies_.empty()){
+		return 0;
+	}
+
+	std::vector<double> sorted(latencies_);
+	std::vector<double>::iterator it = sorted.begin() + (size_t) (percentile*(sorted.size()-1));
+	std::nth_element(sorted.begin(), it, sorted.end());
+	return *it;
+}
+
+bool MojoHub::IsShadowed(long address)
+{
+	// Laser, TTL, servo and PWM registers are only changed by the adapter
+	return address >= g_offsetaddressLaserMode && address < g_offsetaddressAnalogInput;
+}
+
+int MojoHub::OnPort(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet)
+	{
+		pProp->Set(port_.c_str());
+	}
+	else if (pAct == MM::AfterSet)
+	{
+		pProp->Get(port_);
+		portAvailable_ = true;
+	}
+	return DEVICE_OK;
+}
+
+int MojoHub::OnVersion(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet)
+	{
+		pProp->Set((long)version_);
+	}
+	return DEVICE_OK;
+}
+
+int MojoHub::OnResync(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet)
+	{
+		pProp->Set("Idle");
+	}
+	else if (pAct == MM::AfterSet)
+	{
+		std::string val;
+		pProp->Get(val);
+		if(val.compare("Resync") == 0){
+			int ret = ResyncRegisters();
+			pProp->Set("Idle");
+			if (ret != DEVICE_OK)
+				return ret;
+		}
+	}
+	return DEVICE_OK;
+}
+
+int MojoHub::OnSimulated(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet)
+	{
+		pProp->Set(simulated_ ? "Yes" : "No");
+	}
+	else if (pAct == MM::AfterSet)
+	{
+		std::string val;
+		pProp->Get(val);
+		simulated_ = (val.compare("Yes") == 0);
+	}
+	return DEVICE_OK;
+}
+
+int MojoHub::OnStatistics(MM::PropertyBase* pProp, MM::ActionType pAct, long statistic)
+{
+	if (pAct == MM::BeforeGet)
+	{
+		MMThreadGuard myLock(lock_);
+
+		if(statistic == 0){
+			pProp->Set((long) transactions_);
+		} else if(statistic == 1){
+			double elapsed = (GetCurrentMMTime() - statisticsStart_).getMsec();
+			pProp->Set(elapsed > 0 ? 1000.0*transactions_/elapsed : 0.0);
+		} else if(statistic == 2){
+			pProp->Set(GetLatencyPercentile(0.5));
+		} else {
+			pProp->Set(GetLatencyPercentile(0.99));
+		}
+	}
+	return DEVICE_OK;
+}
+
+int MojoHub::OnResetStatistics(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet)
+	{
+		pProp->Set("Idle");
+	}
+	else if (pAct == MM::AfterSet)
+	{
+		std::string val;
+		pProp->Get(val);
+		if(val.compare("Reset") == 0){
+			MMThreadGuard myLock(lock_);
+			latencies_.clear();
+			transactions_ = 0;
+			statisticsStart_ = GetCurrentMMTime();
+			pProp->Set("Idle");
+		}
+	}
+	return DEVICE_OK;
+}
+
+int MojoHub::OnVerifyWrites(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet)
+	{
+		pProp->Set(verifyWrites_ ? "Yes" : "No");
+	}
+	else if (pAct == MM::AfterSet)
+	{
+		std::string val;
+		pProp->Get(val);
+		verifyWrites_ = (val.compare("Yes") == 0);
+	}
+	return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//////
+MojoLaserTrig::MojoLaserTrig() :
+initialized_ (false),
+	busy_(false)
+{
+	InitializeDefaultErrorMessages();
+
+	// Custom error messages
+	SetErrorText(ERR_NO_PORT_SET, "Hub Device not found. The Mojo Hub device is needed to create this device");
+	SetErrorText(ERR_COMMAND_UNKNOWN, "An unknown command was sent to the Mojo.");
+	SetErrorText(ERR_ANSWER_TIMEOUT, "The Mojo did not answer in time.");
+	SetErrorText(ERR_VERIFY_FAILED, "The value read back from the Mojo differs from the value written.");
+
+	// Description
+	int ret = CreateProperty(MM::g_Keyword_Description, "Mojo laser triggering system", MM::String, true);
+	assert(DEVICE_OK == ret);
+
+	// Name
+	ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameMojoLaserTrig, MM::String, true);
+	assert(DEVICE_OK == ret);
+
+	// Number of lasers
+	CPropertyAction* pAct = new CPropertyAction(this, &MojoLaserTrig::OnNumberOfLasers);
+	CreateProperty("Number of lasers", "4", MM::Integer, false, pAct, true);
+	SetPropertyLimits("Number of lasers", 1, g_maxlasers);
+}
+
+
+MojoLaserTrig::~MojoLaserTrig()
+{
+	Shutdown();
+}
+
+void MojoLaserTrig::GetName(char* name) const
+{
+	CDeviceUtils::CopyLimitedString(name, g_DeviceNameMojoLaserTrig);
+}
+
+bool MojoLaserTrig::Busy()
+{
+	// Writes are sent asynchronously by the hub
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	return busy_ || (hub && hub->HasPendingWrites());
+}
+
+
+int MojoLaserTrig::Initialize()
+{
+	// Parent ID display	
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (!hub) {
+		return ERR_NO_PORT_SET;
+	}
+	char hubLabel[MM::MaxStrLength];
+	hub->GetLabel(hubLabel);
+	SetParentID(hubLabel);
+	CreateHubIDProperty();
+
+	// Allocate memory for lasers
+	mode_ = new long [GetNumberOfLasers()];
+	duration_ = new long [GetNumberOfLasers()];
+	sequence_ = new long [GetNumberOfLasers()];
+
+	// Read the current configuration of all lasers in a single batch
+	long addresses[3*g_maxlasers];
+	long values[3*g_maxlasers];
+	for(unsigned int i=0;i<GetNumberOfLasers();i++){
+		addresses[3*i] = g_offsetaddressLaserMode+i;
+		addresses[3*i+1] = g_offsetaddressLaserDuration+i;
+		addresses[3*i+2] = g_offsetaddressLaserSequence+i;
+	}
+
+	int nRet = hub->ReadRegisters(addresses, values, 3*GetNumberOfLasers());
+	if (nRet != DEVICE_OK)
+		return nRet;
+
+	CPropertyActionEx *pExAct;
+
+	for(unsigned int i=0;i<GetNumberOfLasers();i++){	
+		mode_[i] = values[3*i];
+		duration_[i] = values[3*i+1];
+		sequence_[i] = values[3*i+2];
+
+		std::stringstream mode;
+		std::stringstream dura;
+		std::stringstream seq;
+		mode << "Mode" << i;
+		dura << "Duration" << i;
+		seq << "Sequence" << i;
+
+		pExAct = new CPropertyActionEx (this, &MojoLaserTrig::OnDuration,i);
+		nRet = CreateProperty(dura.str().c_str(), CDeviceUtils::ConvertToString(duration_[i]), MM::Integer, false, pExAct);
+		if (nRet != DEVICE_OK)
+			return nRet;
+		SetPropertyLimits(dura.str().c_str(), 0, 65535);   
+
+		pExAct = new CPropertyActionEx (this, &MojoLaserTrig::OnMode,i);
+		nRet = CreateProperty(mode.str().c_str(), CDeviceUtils::ConvertToString(mode_[i]), MM::Integer, false, pExAct);
+		if (nRet != DEVICE_OK)
+			return nRet;
+		SetPropertyLimits(mode.str().c_str(), 0, 4);
+
+		pExAct = new CPropertyActionEx (this, &MojoLaserTrig::OnSequence,i);
+		nRet = CreateProperty(seq.str().c_str(), CDeviceUtils::ConvertToString(sequence_[i]), MM::Integer, false, pExAct);
+		if (nRet != DEVICE_OK)
+			return nRet;
+		SetPropertyLimits(seq.str().c_str(), 0, 65535);
+	}
+
+	initialized_ = true;
+
+	return DEVICE_OK;
+}
+
+int MojoLaserTrig::Shutdown()
+{
+	initialized_ = false;
+	return DEVICE_OK;
+}
 
-		MMThreadGuard myLock(hub->GetLock());
+int MojoLaserTrig::WriteToPort(long address, long value)
+{
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (!hub) {
+		return ERR_NO_PORT_SET;
+	}
 
-		int ret = hub->SendReadRequest(g_offsetaddressLaserMode+laser);
-		if (ret != DEVICE_OK)
-			return ret;
+	int ret = hub->WriteRegister(address, value);
+	if (ret != DEVICE_OK)
+		return ret;
+
+	return DEVICE_OK;
+}
+
+int MojoLaserTrig::ReadFromPort(long address, long& answer)
+{
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (!hub) {
+		return ERR_NO_PORT_SET;
+	}
+	int ret = hub->GetRegister(address, answer);
+	if (ret != DEVICE_OK)
+		return ret;
+
+	return DEVICE_OK;
+}
+
+
+///////////////////////////////////////
+/////////// Action handlers
+int MojoLaserTrig::OnNumberOfLasers(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet){
+		pProp->Set(numlasers_);
+	} else if (pAct == MM::AfterSet){
+		pProp->Get(numlasers_);
+	}
+	return DEVICE_OK;
+}
 
+int MojoLaserTrig::OnMode(MM::PropertyBase* pProp, MM::ActionType pAct, long laser)
+{
+	if (pAct == MM::BeforeGet)
+	{
 		long answer;
-		ret = ReadFromPort(answer);
+		int ret = ReadFromPort(g_offsetaddressLaserMode+laser, answer);
 		if (ret != DEVICE_OK)
 			return ret;
 
@@ -545,19 +1251,8 @@ int MojoLaserTrig::OnDuration(MM::PropertyBase* pProp, MM::ActionType pAct, long
 {
 	if (pAct == MM::BeforeGet)
 	{
-		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-		if (!hub){
-			return ERR_NO_PORT_SET;
-		}
-
-		MMThreadGuard myLock(hub->GetLock());
-
-		int ret = hub->SendReadRequest(g_offsetaddressLaserDuration+laser);
-		if (ret != DEVICE_OK)
-			return ret;
-
 		long answer;
-		ret = ReadFromPort(answer);
+		int ret = ReadFromPort(g_offsetaddressLaserDuration+laser, answer);
 		if (ret != DEVICE_OK)
 			return ret;
 
@@ -583,19 +1278,8 @@ int MojoLaserTrig::OnSequence(MM::PropertyBase* pProp, MM::ActionType pAct, long
 {
 	if (pAct == MM::BeforeGet)
 	{
-		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-		if (!hub){
-			return ERR_NO_PORT_SET;
-		}
-
-		MMThreadGuard myLock(hub->GetLock());
-
-		int ret = hub->SendReadRequest(g_offsetaddressLaserSequence+laser);
-		if (ret != DEVICE_OK)
-			return ret;
-
 		long answer;
-		ret = ReadFromPort(answer);
+		int ret = ReadFromPort(g_offsetaddressLaserSequence+laser, answer);
 		if (ret != DEVICE_OK)
 			return ret;
 
@@ -629,6 +1313,8 @@ initialized_ (false),
 	// Custom error messages
 	SetErrorText(ERR_NO_PORT_SET, "Hub Device not found. The Mojo Hub device is needed to create this device");
 	SetErrorText(ERR_COMMAND_UNKNOWN, "An unknown command was sent to the Mojo.");
+	SetErrorText(ERR_ANSWER_TIMEOUT, "The Mojo did not answer in time.");
+	SetErrorText(ERR_VERIFY_FAILED, "The value read back from the Mojo differs from the value written.");
 
 	// Description
 	int ret = CreateProperty(MM::g_Keyword_Description, "Mojo TTL", MM::String, true);
@@ -654,6 +1340,13 @@ void MojoTTL::GetName(char* name) const
 	CDeviceUtils::CopyLimitedString(name, g_DeviceNameMojoTTL);
 }
 
+bool MojoTTL::Busy()
+{
+	// Writes are sent asynchronously by the hub
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	return busy_ || (hub && hub->HasPendingWrites());
+}
+
 
 int MojoTTL::Initialize()
 {
@@ -672,28 +1365,35 @@ int MojoTTL::Initialize()
 
 	// Allocate memory for TTLs
 	state_ = new long [GetNumberOfChannels()];
+	sequenceLength_ = new long [GetNumberOfChannels()];
+	for(unsigned int i=0;i<GetNumberOfChannels();i++){
+		sequenceLength_[i] = 0;
+	}
+
+	// Read the current state of all channels in a single batch
+	long addresses[g_maxttl];
+	for(unsigned int i=0;i<GetNumberOfChannels();i++){
+		addresses[i] = g_offsetaddressTTL+i;
+	}
+
+	int nRet = hub->ReadRegisters(addresses, state_, GetNumberOfChannels());
+	if (nRet != DEVICE_OK)
+		return nRet;
 
 	CPropertyActionEx *pExAct;
-	int nRet;
 
 	for(unsigned int i=0;i<GetNumberOfChannels();i++){
-		state_[i]  = 0;
-
 		std::stringstream sstm;
 		sstm << "State" << i;
 
 		pExAct = new CPropertyActionEx (this, &MojoTTL::OnState,i);
-		nRet = CreateProperty(sstm.str().c_str(), "0", MM::Integer, false, pExAct);
+		nRet = CreateProperty(sstm.str().c_str(), CDeviceUtils::ConvertToString(state_[i]), MM::Integer, false, pExAct);
 		if (nRet != DEVICE_OK)
 			return nRet;
 		AddAllowedValue(sstm.str().c_str(), "0");
 		AddAllowedValue(sstm.str().c_str(), "1");
 	}
 
-	nRet = UpdateStatus();
-	if (nRet != DEVICE_OK)
-		return nRet;
-
 	initialized_ = true;
 
 	return DEVICE_OK;
@@ -712,31 +1412,52 @@ int MojoTTL::WriteToPort(long address, long state)
 		return ERR_NO_PORT_SET;
 	}
 
-	MMThreadGuard myLock(hub->GetLock());
-
-	hub->PurgeComPortH();
-
 	int val = 0;
 	if(state == 1){
 		val = 1;
 	} 
-	int ret = hub->SendWriteRequest(address, val);
+	int ret = hub->WriteRegister(address, val);
 	if (ret != DEVICE_OK)
 		return ret;
 
 	return DEVICE_OK;
 }
 
-int MojoTTL::ReadFromPort(long& answer)
+int MojoTTL::ReadFromPort(long address, long& answer)
 {
 	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
 	if (!hub) {
 		return ERR_NO_PORT_SET;
 	}
-	int ret = hub->ReadAnswer(answer);
+	int ret = hub->GetRegister(address, answer);
+	if (ret != DEVICE_OK)
+		return ret;
+
+	return DEVICE_OK;
+}
+
+int MojoTTL::LoadSequence(long channel, const std::vector<std::string>& sequence)
+{
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (!hub) {
+		return ERR_NO_PORT_SET;
+	}
+
+	std::vector<long> values(sequence.size());
+	for(unsigned int i=0;i<sequence.size();i++){
+		values[i] = atol(sequence[i].c_str());
+		if(values[i] != 0 && values[i] != 1){
+			return DEVICE_INVALID_PROPERTY_VALUE;
+		}
+	}
+
+	// Upload the whole TTL pattern in batched transfers
+	int ret = hub->WriteTable(g_offsetaddressTTLSequence+channel*g_maxsequence, values);
 	if (ret != DEVICE_OK)
 		return ret;
 
+	sequenceLength_[channel] = (long) values.size();
+
 	return DEVICE_OK;
 }
 
@@ -756,19 +1477,8 @@ int MojoTTL::OnState(MM::PropertyBase* pProp, MM::ActionType pAct, long channel)
 {
 	if (pAct == MM::BeforeGet)
 	{
-		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-		if (!hub){
-			return ERR_NO_PORT_SET;
-		}
-
-		MMThreadGuard myLock(hub->GetLock());
-
-		int ret = hub->SendReadRequest(g_offsetaddressTTL+channel);
-		if (ret != DEVICE_OK)
-			return ret;
-
 		long answer;
-		ret = ReadFromPort(answer);
+		int ret = ReadFromPort(g_offsetaddressTTL+channel, answer);
 		if (ret != DEVICE_OK)
 			return ret;
 
@@ -786,6 +1496,48 @@ int MojoTTL::OnState(MM::PropertyBase* pProp, MM::ActionType pAct, long channel)
 
 		state_[channel] = pos;
 	}
+	else if (pAct == MM::IsSequenceable)
+	{
+		// The pattern table is stepped by the Mojo on each camera trigger
+		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+		if (hub && hub->SupportsSequences()){
+			pProp->SetSequenceable(g_maxsequence);
+		} else {
+			pProp->SetSequenceable(0);
+		}
+	}
+	else if (pAct == MM::AfterLoadSequence)
+	{
+		std::vector<std::string> sequence = pProp->GetSequence();
+		if (sequence.size() > (unsigned int) g_maxsequence)
+			return DEVICE_SEQUENCE_TOO_LARGE;
+
+		int ret = LoadSequence(channel, sequence);
+		if (ret != DEVICE_OK)
+			return ret;
+	}
+	else if (pAct == MM::StartSequence)
+	{
+		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+		if (!hub){
+			return ERR_NO_PORT_SET;
+		}
+
+		int ret = hub->WriteRegister(g_offsetaddressTTLSequenceLength+channel, sequenceLength_[channel]);
+		if (ret != DEVICE_OK)
+			return ret;
+	}
+	else if (pAct == MM::StopSequence)
+	{
+		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+		if (!hub){
+			return ERR_NO_PORT_SET;
+		}
+
+		int ret = hub->WriteRegister(g_offsetaddressTTLSequenceLength+channel, 0);
+		if (ret != DEVICE_OK)
+			return ret;
+	}
 
 	return DEVICE_OK;
 }
@@ -802,6 +1554,9 @@ initialized_ (false),
 	// Custom error messages
 	SetErrorText(ERR_NO_PORT_SET, "Hub Device not found. The Mojo Hub device is needed to create this device");
 	SetErrorText(ERR_COMMAND_UNKNOWN, "An unknown command was sent to the Mojo.");
+	SetErrorText(ERR_ANSWER_TIMEOUT, "The Mojo did not answer in time.");
+	SetErrorText(ERR_VERIFY_FAILED, "The value read back from the Mojo differs from the value written.");
+	SetErrorText(ERR_INVALID_TRAJECTORY, "Invalid trajectory, expected a list of position:time(ms) points separated by commas.");
 
 	// Description
 	int ret = CreateProperty(MM::g_Keyword_Description, "Mojo Servo controller", MM::String, true);
@@ -827,6 +1582,23 @@ void MojoServo::GetName(char* name) const
 	CDeviceUtils::CopyLimitedString(name, g_DeviceNameMojoServos);
 }
 
+bool MojoServo::Busy()
+{
+	// Writes are sent asynchronously by the hub
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (busy_ || (hub && hub->HasPendingWrites()))
+		return true;
+
+	// Trajectories are executed by the Mojo
+	if (initialized_ && UpdateTrajectoryStatus() == DEVICE_OK){
+		for(unsigned int i=0;i<GetNumberOfServos();i++){
+			if(running_[i])
+				return true;
+		}
+	}
+	return false;
+}
+
 
 int MojoServo::Initialize()
 {
@@ -846,25 +1618,60 @@ int MojoServo::Initialize()
 	// Allocate memory for servos
 	position_ = new long [GetNumberOfServos()];
 
+	// Read the current position of all servos in a single batch
+	long addresses[g_maxservos];
+	for(unsigned int i=0;i<GetNumberOfServos();i++){
+		addresses[i] = g_offsetaddressServo+i;
+	}
+
+	int nRet = hub->ReadRegisters(addresses, position_, GetNumberOfServos());
+	if (nRet != DEVICE_OK)
+		return nRet;
+
 	CPropertyActionEx *pExAct;
-	int nRet;
 
 	for(unsigned int i=0;i<GetNumberOfServos();i++){	
-		position_[i] = 0;
-
 		std::stringstream sstm;
 		sstm << "Position" << i;
 
 		pExAct = new CPropertyActionEx (this, &MojoServo::OnPosition,i);
-		nRet = CreateProperty(sstm.str().c_str(), "0", MM::Integer, false, pExAct);
+		nRet = CreateProperty(sstm.str().c_str(), CDeviceUtils::ConvertToString(position_[i]), MM::Integer, false, pExAct);
 		if (nRet != DEVICE_OK)
 			return nRet;
 		SetPropertyLimits(sstm.str().c_str(), 0, 65535);
 	}
 
-	nRet = UpdateStatus();
-	if (nRet != DEVICE_OK)
-		return nRet;
+	// Trajectories
+	trajectory_ = new std::string [GetNumberOfServos()];
+	trajectoryLength_ = new long [GetNumberOfServos()];
+	running_ = new bool [GetNumberOfServos()];
+	for(unsigned int i=0;i<GetNumberOfServos();i++){
+		trajectoryLength_[i] = 0;
+		running_[i] = false;
+	}
+
+	if (hub->SupportsTrajectories()){
+		for(unsigned int i=0;i<GetNumberOfServos();i++){	
+			std::stringstream sstm;
+			sstm << "Trajectory" << i;
+
+			pExAct = new CPropertyActionEx (this, &MojoServo::OnTrajectory,i);
+			nRet = CreateProperty(sstm.str().c_str(), "", MM::String, false, pExAct);
+			if (nRet != DEVICE_OK)
+				return nRet;
+
+			std::stringstream sstm2;
+			sstm2 << "Run trajectory" << i;
+
+			pExAct = new CPropertyActionEx (this, &MojoServo::OnRunTrajectory,i);
+			nRet = CreateProperty(sstm2.str().c_str(), "Idle", MM::String, false, pExAct);
+			if (nRet != DEVICE_OK)
+				return nRet;
+			AddAllowedValue(sstm2.str().c_str(), "Idle");
+			AddAllowedValue(sstm2.str().c_str(), "Run");
+			AddAllowedValue(sstm2.str().c_str(), "Stop");
+		}
+	}
 
 	initialized_ = true;
 
@@ -884,28 +1691,111 @@ int MojoServo::WriteToPort(long address, long value)
 		return ERR_NO_PORT_SET;
 	}
 
-	MMThreadGuard myLock(hub->GetLock());
+	int ret = hub->WriteRegister(address, value);
+	if (ret != DEVICE_OK)
+		return ret;
 
-	hub->PurgeComPortH();
+	return DEVICE_OK;
+}
+
+int MojoServo::ReadFromPort(long address, long& answer)
+{
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (!hub) {
+		return ERR_NO_PORT_SET;
+	}
+	int ret = hub->GetRegister(address, answer);
+	if (ret != DEVICE_OK)
+		return ret;
+
+	return DEVICE_OK;
+}
+
+int MojoServo::LoadTrajectory(long servo, const std::string& trajectory)
+{
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (!hub) {
+		return ERR_NO_PORT_SET;
+	}
+
+	// Parse "position:time,position:time,..."
+	std::vector<long> positions;
+	std::vector<long> times;
+	std::istringstream points(trajectory);
+	std::string point;
+	while(std::getline(points, point, ',')){
+		long position, time;
+		char separator;
+		std::istringstream values(point);
+		if(!(values >> position >> separator >> time) || separator != ':'){
+			return ERR_INVALID_TRAJECTORY;
+		}
+		// nothing may follow the time, e.g. "100:200abc"
+		values >> std::ws;
+		if(!values.eof()){
+			return ERR_INVALID_TRAJECTORY;
+		}
+		if(position < 0 || position > 65535 || time < 0){
+			return ERR_INVALID_TRAJECTORY;
+		}
+		positions.push_back(position);
+		times.push_back(time);
+	}
+
+	if (positions.empty())
+		return ERR_INVALID_TRAJECTORY;
 
+	if (positions.size() > (unsigned int) g_maxsequence)
+		return DEVICE_SEQUENCE_TOO_LARGE;
 
-	int ret = hub->SendWriteRequest(address, value);
+	// Upload the positions and timings in batched transfers
+	int ret = hub->WriteTable(g_offsetaddressServoTrajectory+servo*g_maxsequence, positions);
 	if (ret != DEVICE_OK)
 		return ret;
 
+	ret = hub->WriteTable(g_offsetaddressServoTrajectoryTime+servo*g_maxsequence, times);
+	if (ret != DEVICE_OK)
+		return ret;
+
+	trajectoryLength_[servo] = (long) positions.size();
+
 	return DEVICE_OK;
 }
 
-int MojoServo::ReadFromPort(long& answer)
+int MojoServo::UpdateTrajectoryStatus()
 {
 	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
 	if (!hub) {
 		return ERR_NO_PORT_SET;
 	}
-	int ret = hub->ReadAnswer(answer);
+
+	// Poll the status and the position of the running servos in a single batch, reading
+	// the positions also refreshes the hub copy of the registers moved by the Mojo
+	long addresses[2*g_maxservos];
+	long values[2*g_maxservos];
+	int n = 0;
+	for(unsigned int i=0;i<GetNumberOfServos();i++){
+		if(running_[i]){
+			addresses[n++] = g_offsetaddressServoTrajectoryStatus+i;
+			addresses[n++] = g_offsetaddressServo+i;
+		}
+	}
+	if(n == 0){
+		return DEVICE_OK;
+	}
+
+	int ret = hub->ReadRegisters(addresses, values, n);
 	if (ret != DEVICE_OK)
 		return ret;
 
+	for(int k=0;k<n;k+=2){
+		long servo = addresses[k]-g_offsetaddressServoTrajectoryStatus;
+		position_[servo] = values[k+1];
+		if(values[k] == 0){
+			running_[servo] = false;
+		}
+	}
+
 	return DEVICE_OK;
 }
 
@@ -926,23 +1816,11 @@ int MojoServo::OnPosition(MM::PropertyBase* pProp, MM::ActionType pAct, long ser
 {
 	if (pAct == MM::BeforeGet)
 	{
-		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-		if (!hub){
-			return ERR_NO_PORT_SET;
-		}
-
-		MMThreadGuard myLock(hub->GetLock());
-
-		int ret = hub->SendReadRequest(g_offsetaddressServo+servo);
-		if (ret != DEVICE_OK)
-			return ret;
-
 		long answer;
-		ret = ReadFromPort(answer);
+		int ret = ReadFromPort(g_offsetaddressServo+servo, answer);
 		if (ret != DEVICE_OK)
 			return ret;
 
-
 		pProp->Set(answer);
 		position_[servo]=answer;
 	}
@@ -961,6 +1839,77 @@ int MojoServo::OnPosition(MM::PropertyBase* pProp, MM::ActionType pAct, long ser
 	return DEVICE_OK;
 }
 
+int MojoServo::OnTrajectory(MM::PropertyBase* pProp, MM::ActionType pAct, long servo)
+{
+	if (pAct == MM::BeforeGet)
+	{
+		pProp->Set(trajectory_[servo].c_str());
+	}
+	else if (pAct == MM::AfterSet)
+	{
+		std::string trajectory;
+		pProp->Get(trajectory);
+
+		if(running_[servo]){
+			return DEVICE_CAN_NOT_SET_PROPERTY;
+		}
+
+		int ret = LoadTrajectory(servo, trajectory);
+		if (ret != DEVICE_OK){
+			pProp->Set(trajectory_[servo].c_str());
+			return ret;
+		}
+
+		trajectory_[servo] = trajectory;
+	}
+
+	return DEVICE_OK;
+}
+
+int MojoServo::OnRunTrajectory(MM::PropertyBase* pProp, MM::ActionType pAct, long servo)
+{
+	if (pAct == MM::BeforeGet)
+	{
+		int ret = UpdateTrajectoryStatus();
+		if (ret != DEVICE_OK)
+			return ret;
+
+		pProp->Set(running_[servo] ? "Run" : "Idle");
+	}
+	else if (pAct == MM::AfterSet)
+	{
+		std::string val;
+		pProp->Get(val);
+
+		if(val.compare("Run") == 0){
+			if(trajectoryLength_[servo] == 0){
+				return ERR_INVALID_TRAJECTORY;
+			}
+
+			// The Mojo steps through the points on its own and reports the points left
+			int ret = WriteToPort(g_offsetaddressServoTrajectoryLength+servo, trajectoryLength_[servo]);
+			if (ret != DEVICE_OK)
+				return ret;
+
+			running_[servo] = true;
+		} else if(val.compare("Stop") == 0){
+			int ret = WriteToPort(g_offsetaddressServoTrajectoryLength+servo, 0);
+			if (ret != DEVICE_OK)
+				return ret;
+
+			// Read where the servo stopped
+			ret = UpdateTrajectoryStatus();
+			if (ret != DEVICE_OK)
+				return ret;
+
+			running_[servo] = false;
+			pProp->Set("Idle");
+		}
+	}
+
+	return DEVICE_OK;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 //////
 MojoPWM::MojoPWM() :
@@ -972,6 +1921,8 @@ initialized_ (false),
 	// Custom error messages
 	SetErrorText(ERR_NO_PORT_SET, "Hub Device not found. The Mojo Hub device is needed to create this device");
 	SetErrorText(ERR_COMMAND_UNKNOWN, "An unknown command was sent to the Mojo.");
+	SetErrorText(ERR_ANSWER_TIMEOUT, "The Mojo did not answer in time.");
+	SetErrorText(ERR_VERIFY_FAILED, "The value read back from the Mojo differs from the value written.");
 
 	// Description
 	int ret = CreateProperty(MM::g_Keyword_Description, "Mojo PWM controller", MM::String, true);
@@ -997,6 +1948,13 @@ void MojoPWM::GetName(char* name) const
 	CDeviceUtils::CopyLimitedString(name, g_DeviceNameMojoPWM);
 }
 
+bool MojoPWM::Busy()
+{
+	// Writes are sent asynchronously by the hub
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	return busy_ || (hub && hub->HasPendingWrites());
+}
+
 
 int MojoPWM::Initialize()
 {
@@ -1015,27 +1973,34 @@ int MojoPWM::Initialize()
 
 	// Allocate memory for channels
 	state_ = new long [GetNumberOfChannels()];
+	sequenceLength_ = new long [GetNumberOfChannels()];
+	for(unsigned int i=0;i<GetNumberOfChannels();i++){
+		sequenceLength_[i] = 0;
+	}
+
+	// Read the current state of all channels in a single batch
+	long addresses[g_maxpwm];
+	for(unsigned int i=0;i<GetNumberOfChannels();i++){
+		addresses[i] = g_offsetaddressPWM+i;
+	}
+
+	int nRet = hub->ReadRegisters(addresses, state_, GetNumberOfChannels());
+	if (nRet != DEVICE_OK)
+		return nRet;
 
 	CPropertyActionEx *pExAct;
-	int nRet;
 
 	for(unsigned int i=0;i<GetNumberOfChannels();i++){
-		state_[i] = 0;
-
 		std::stringstream sstm;
 		sstm << "Position" << i;
 
 		pExAct = new CPropertyActionEx (this, &MojoPWM::OnState,i);
-		nRet = CreateProperty(sstm.str().c_str(), "0", MM::Integer, false, pExAct);
+		nRet = CreateProperty(sstm.str().c_str(), CDeviceUtils::ConvertToString(state_[i]), MM::Integer, false, pExAct);
 		if (nRet != DEVICE_OK)
 			return nRet;
 		SetPropertyLimits(sstm.str().c_str(), 0, 255);
 	}
 
-	nRet = UpdateStatus();
-	if (nRet != DEVICE_OK)
-		return nRet;
-
 	initialized_ = true;
 
 	return DEVICE_OK;
@@ -1054,27 +2019,48 @@ int MojoPWM::WriteToPort(long address, long position)
 		return ERR_NO_PORT_SET;
 	}
 
-	MMThreadGuard myLock(hub->GetLock());
+	int ret = hub->WriteRegister(address, position);
+	if (ret != DEVICE_OK)
+		return ret;
 
-	hub->PurgeComPortH();
+	return DEVICE_OK;
+}
 
-	int ret = hub->SendWriteRequest(address, position);
+int MojoPWM::ReadFromPort(long address, long& answer)
+{
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (!hub) {
+		return ERR_NO_PORT_SET;
+	}
+	int ret = hub->GetRegister(address, answer);
 	if (ret != DEVICE_OK)
 		return ret;
 
 	return DEVICE_OK;
 }
 
-int MojoPWM::ReadFromPort(long& answer)
+int MojoPWM::LoadSequence(long channel, const std::vector<std::string>& sequence)
 {
 	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
 	if (!hub) {
 		return ERR_NO_PORT_SET;
 	}
-	int ret = hub->ReadAnswer(answer);
+
+	std::vector<long> values(sequence.size());
+	for(unsigned int i=0;i<sequence.size();i++){
+		values[i] = atol(sequence[i].c_str());
+		if(values[i] < 0 || values[i] > 255){
+			return DEVICE_INVALID_PROPERTY_VALUE;
+		}
+	}
+
+	// Upload the whole PWM pattern in batched transfers
+	int ret = hub->WriteTable(g_offsetaddressPWMSequence+channel*g_maxsequence, values);
 	if (ret != DEVICE_OK)
 		return ret;
 
+	sequenceLength_[channel] = (long) values.size();
+
 	return DEVICE_OK;
 }
 
@@ -1094,19 +2080,8 @@ int MojoPWM::OnState(MM::PropertyBase* pProp, MM::ActionType pAct, long channel)
 {
 	if (pAct == MM::BeforeGet)
 	{
-		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-		if (!hub){
-			return ERR_NO_PORT_SET;
-		}
-
-		MMThreadGuard myLock(hub->GetLock());
-
-		int ret = hub->SendReadRequest(g_offsetaddressPWM+channel);
-		if (ret != DEVICE_OK)
-			return ret;
-
 		long answer;
-		ret = ReadFromPort(answer);
+		int ret = ReadFromPort(g_offsetaddressPWM+channel, answer);
 		if (ret != DEVICE_OK)
 			return ret;
 
@@ -1128,6 +2103,48 @@ int MojoPWM::OnState(MM::PropertyBase* pProp, MM::ActionType pAct, long channel)
 
 		state_[channel] = pos;
 	}
+	else if (pAct == MM::IsSequenceable)
+	{
+		// The pattern table is stepped by the Mojo on each camera trigger
+		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+		if (hub && hub->SupportsSequences()){
+			pProp->SetSequenceable(g_maxsequence);
+		} else {
+			pProp->SetSequenceable(0);
+		}
+	}
+	else if (pAct == MM::AfterLoadSequence)
+	{
+		std::vector<std::string> sequence = pProp->GetSequence();
+		if (sequence.size() > (unsigned int) g_maxsequence)
+			return DEVICE_SEQUENCE_TOO_LARGE;
+
+		int ret = LoadSequence(channel, sequence);
+		if (ret != DEVICE_OK)
+			return ret;
+	}
+	else if (pAct == MM::StartSequence)
+	{
+		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+		if (!hub){
+			return ERR_NO_PORT_SET;
+		}
+
+		int ret = hub->WriteRegister(g_offsetaddressPWMSequenceLength+channel, sequenceLength_[channel]);
+		if (ret != DEVICE_OK)
+			return ret;
+	}
+	else if (pAct == MM::StopSequence)
+	{
+		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+		if (!hub){
+			return ERR_NO_PORT_SET;
+		}
+
+		int ret = hub->WriteRegister(g_offsetaddressPWMSequenceLength+channel, 0);
+		if (ret != DEVICE_OK)
+			return ret;
+	}
 
 	return DEVICE_OK;
 }
@@ -1135,13 +2152,22 @@ int MojoPWM::OnState(MM::PropertyBase* pProp, MM::ActionType pAct, long channel)
 ///////////////////////////////////////////////////////////////////////////////////////////
 //////
 MojoInput::MojoInput() :
-initialized_ (false)
+	state_(0),
+	fresh_(0),
+	initialized_ (false),
+	thread_(0),
+	streaming_(false),
+	streamingPeriod_(10),
+	window_(100),
+	ringWritten_(0)
 {
 	InitializeDefaultErrorMessages();
 
 	// Custom error messages
 	SetErrorText(ERR_NO_PORT_SET, "Hub Device not found. The Mojo Hub device is needed to create this device");
 	SetErrorText(ERR_COMMAND_UNKNOWN, "An unknown command was sent to the Mojo.");
+	SetErrorText(ERR_ANSWER_TIMEOUT, "The Mojo did not answer in time.");
+	SetErrorText(ERR_VERIFY_FAILED, "The value read back from the Mojo differs from the value written.");
 
 	// Description
 	int ret = CreateProperty(MM::g_Keyword_Description, "Mojo AnalogInput", MM::String, true);
@@ -1160,6 +2186,8 @@ initialized_ (false)
 MojoInput::~MojoInput()
 {
 	Shutdown();
+	delete [] state_;
+	delete [] fresh_;
 }
 
 void MojoInput::GetName(char* name) const
@@ -1189,12 +2217,14 @@ int MojoInput::Initialize()
 
 	// Allocate memory for inputs
 	state_ = new long [GetNumberOfChannels()];
+	fresh_ = new bool [GetNumberOfChannels()];
 
 	CPropertyActionEx *pExAct;
 	int nRet;
 
 	for(unsigned int i=0;i<GetNumberOfChannels();i++){
 		state_[i] = 0;
+		fresh_[i] = false;
 
 		std::stringstream sstm;
 		sstm << "AnalogInput" << i;
@@ -1203,8 +2233,64 @@ int MojoInput::Initialize()
 		nRet = CreateProperty(sstm.str().c_str(), "0", MM::Integer, true, pExAct);
 		if (nRet != DEVICE_OK)
 			return nRet;
+
+		std::stringstream mean;
+		std::stringstream min;
+		std::stringstream max;
+		mean << "AnalogInput" << i << " mean";
+		min << "AnalogInput" << i << " min";
+		max << "AnalogInput" << i << " max";
+
+		pExAct = new CPropertyActionEx (this, &MojoInput::OnMean,i);
+		nRet = CreateProperty(mean.str().c_str(), "0", MM::Float, true, pExAct);
+		if (nRet != DEVICE_OK)
+			return nRet;
+
+		pExAct = new CPropertyActionEx (this, &MojoInput::OnMin,i);
+		nRet = CreateProperty(min.str().c_str(), "0", MM::Integer, true, pExAct);
+		if (nRet != DEVICE_OK)
+			return nRet;
+
+		pExAct = new CPropertyActionEx (this, &MojoInput::OnMax,i);
+		nRet = CreateProperty(max.str().c_str(), "0", MM::Integer, true, pExAct);
+		if (nRet != DEVICE_OK)
+			return nRet;
 	}
 
+	// Streaming
+	ringValues_.resize(g_streamingbuffersize*numChannels_);
+	ringTimes_.resize(g_streamingbuffersize);
+
+	CPropertyAction* pAct = new CPropertyAction(this, &MojoInput::OnStreaming);
+	nRet = CreateProperty("Streaming", "Off", MM::String, false, pAct);
+	if (nRet != DEVICE_OK)
+		return nRet;
+	AddAllowedValue("Streaming", "Off");
+	AddAllowedValue("Streaming", "On");
+
+	pAct = new CPropertyAction(this, &MojoInput::OnStreamingPeriod);
+	nRet = CreateProperty("Streaming period (ms)", "10", MM::Integer, false, pAct);
+	if (nRet != DEVICE_OK)
+		return nRet;
+	SetPropertyLimits("Streaming period (ms)", 1, 10000);
+
+	pAct = new CPropertyAction(this, &MojoInput::OnWindow);
+	nRet = CreateProperty("Statistics window (samples)", "100", MM::Integer, false, pAct);
+	if (nRet != DEVICE_OK)
+		return nRet;
+	SetPropertyLimits("Statistics window (samples)", 1, g_maxstreamingwindow);
+
+	pAct = new CPropertyAction(this, &MojoInput::OnSamples);
+	nRet = CreateProperty("Streamed samples", "0", MM::Integer, true, pAct);
+	if (nRet != DEVICE_OK)
+		return nRet;
+
+	// Last streamed blocks with their time (ms) since the start of the streaming
+	pAct = new CPropertyAction(this, &MojoInput::OnRecentBlocks);
+	nRet = CreateProperty("Recent blocks", "", MM::String, true, pAct);
+	if (nRet != DEVICE_OK)
+		return nRet;
+
 	nRet = UpdateStatus();
 	if (nRet != DEVICE_OK)
 		return nRet;
@@ -1216,10 +2302,149 @@ int MojoInput::Initialize()
 
 int MojoInput::Shutdown()
 {
+	StopStreaming();
 	initialized_ = false;
 	return DEVICE_OK;
 }
 
+int MojoInput::StartStreaming()
+{
+	if(streaming_){
+		return DEVICE_OK;
+	}
+
+	ringWritten_.store(0);
+	streamingStart_ = GetCurrentMMTime();
+	nextBlock_ = streamingStart_;
+
+	thread_ = new MojoInputMonitorThread(*this);
+	thread_->Start();
+	streaming_ = true;
+
+	return DEVICE_OK;
+}
+
+void MojoInput::StopStreaming()
+{
+	if(thread_ != 0){
+		// the thread is stopped and joined by its destructor
+		delete thread_;
+		thread_ = 0;
+	}
+	streaming_ = false;
+}
+
+double MojoInput::GetTimeToNextBlock()
+{
+	return (nextBlock_ - GetCurrentMMTime()).getMsec();
+}
+
+int MojoInput::AcquireBlock()
+{
+	// The deadlines are absolute so that the rate does not drift with the transfer time
+	long period;
+	{
+		MMThreadGuard myLock(lock_);
+		period = streamingPeriod_;
+	}
+	nextBlock_ = nextBlock_ + MM::MMTime(period*1000.0);
+	MM::MMTime now = GetCurrentMMTime();
+	if(nextBlock_ < now){
+		// late, resynchronize on the current time
+		nextBlock_ = now;
+	}
+
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (!hub) {
+		return ERR_NO_PORT_SET;
+	}
+
+	long addresses[g_maxanaloginput];
+	long values[g_maxanaloginput];
+	for(int i=0;i<numChannels_;i++){
+		addresses[i] = g_offsetaddressAnalogInput+i;
+	}
+
+	int ret = hub->ReadRegisters(addresses, values, numChannels_);
+	if (ret != DEVICE_OK){
+		LogMessageCode(ret, false);
+		return ret;
+	}
+
+	// Fill the next slot before publishing it
+	unsigned long written = ringWritten_.load(std::memory_order_relaxed);
+	unsigned long slot = written % g_streamingbuffersize;
+	for(int i=0;i<numChannels_;i++){
+		ringValues_[slot*numChannels_+i] = values[i];
+	}
+	ringTimes_[slot] = (GetCurrentMMTime() - streamingStart_).getMsec();
+	ringWritten_.store(written+1, std::memory_order_release);
+
+	return DEVICE_OK;
+}
+
+void MojoInput::GetStatistics(long channel, double& mean, long& min, long& max)
+{
+	for(;;){
+		unsigned long written = ringWritten_.load(std::memory_order_acquire);
+		if(written == 0){
+			mean = state_[channel];
+			min = state_[channel];
+			max = state_[channel];
+			return;
+		}
+
+		long window;
+		{
+			MMThreadGuard myLock(lock_);
+			window = window_;
+		}
+		unsigned long n = written < (unsigned long) window ? written : window;
+		double sum = 0;
+		min = ringValues_[((written-n) % g_streamingbuffersize)*numChannels_+channel];
+		max = min;
+		for(unsigned long k=written-n;k<written;k++){
+			long v = ringValues_[(k % g_streamingbuffersize)*numChannels_+channel];
+			sum += v;
+			if(v < min) min = v;
+			if(v > max) max = v;
+		}
+		mean = sum/n;
+
+		// Retry if the monitor thread overwrote the oldest blocks in the meantime
+		if(ringWritten_.load(std::memory_order_acquire) - (written-n) < g_streamingbuffersize){
+			return;
+		}
+	}
+}
+
+std::string MojoInput::GetRecentBlocks()
+{
+	for(;;){
+		unsigned long written = ringWritten_.load(std::memory_order_acquire);
+		unsigned long n = written < g_recentblocks ? written : g_recentblocks;
+
+		// "time:value0,value1,...;" for each block, oldest first
+		std::ostringstream blocks;
+		for(unsigned long k=written-n;k<written;k++){
+			unsigned long slot = k % g_streamingbuffersize;
+			blocks << ringTimes_[slot] << ":";
+			for(int i=0;i<numChannels_;i++){
+				if(i > 0){
+					blocks << ",";
+				}
+				blocks << ringValues_[slot*numChannels_+i];
+			}
+			blocks << ";";
+		}
+
+		// Retry if the monitor thread overwrote the oldest blocks in the meantime
+		if(ringWritten_.load(std::memory_order_acquire) - (written-n) < g_streamingbuffersize){
+			return blocks.str();
+		}
+	}
+}
+
 int MojoInput::WriteToPort(long address)
 {
 	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
@@ -1263,28 +2488,203 @@ int MojoInput::OnNumberOfChannels(MM::PropertyBase* pProp, MM::ActionType pAct)
 	return DEVICE_OK;
 }
 
+int MojoInput::ReadAllChannels()
+{
+	MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
+	if (!hub){
+		return ERR_NO_PORT_SET;
+	}
+
+	long addresses[g_maxanaloginput];
+	for(int i=0;i<numChannels_;i++){
+		addresses[i] = g_offsetaddressAnalogInput+i;
+	}
+
+	int ret = hub->ReadRegisters(addresses, state_, numChannels_);
+	if (ret != DEVICE_OK)
+		return ret;
+
+	lastRead_ = GetCurrentMMTime();
+	for(int i=0;i<numChannels_;i++){
+		fresh_[i] = true;
+	}
+
+	return DEVICE_OK;
+}
+
 int MojoInput::OnAnalogInput(MM::PropertyBase* pProp, MM::ActionType pAct, long channel)
 {
-	if (pAct == MM::BeforeGet){
-		MojoHub* hub = static_cast<MojoHub*>(GetParentHub());
-		if (!hub){
-			return ERR_NO_PORT_SET;
+	if (pAct == MM::BeforeGet && streaming_){
+		// Latest streamed sample
+		unsigned long written = ringWritten_.load(std::memory_order_acquire);
+		if(written > 0){
+			state_[channel] = ringValues_[((written-1) % g_streamingbuffersize)*numChannels_+channel];
+		}
+		pProp->Set(state_[channel]);
+	}
+	else if (pAct == MM::BeforeGet){
+		// All channels are read in a single pipelined pass, each value is then
+		// served once, and only within g_maxinputage of the pass, before a new 
+		// pass is triggered.
+		if(!fresh_[channel] || (GetCurrentMMTime() - lastRead_).getMsec() > g_maxinputage){
+			int ret = ReadAllChannels();
+			if (ret != DEVICE_OK)
+				return ret;
 		}
+		fresh_[channel] = false;
 
-		MMThreadGuard myLock(hub->GetLock());
+		pProp->Set(state_[channel]);
+	}
+	return DEVICE_OK;
+}
 
-		int ret = hub->SendReadRequest(g_offsetaddressAnalogInput+channel);
-		if (ret != DEVICE_OK)
-			return ret;
+int MojoInput::OnMean(MM::PropertyBase* pProp, MM::ActionType pAct, long channel)
+{
+	if (pAct == MM::BeforeGet){
+		double mean;
+		long min, max;
+		GetStatistics(channel, mean, min, max);
+		pProp->Set(mean);
+	}
+	return DEVICE_OK;
+}
 
-		long answer;
-		ret = ReadFromPort(answer);
-		if (ret != DEVICE_OK)
-			return ret;
+int MojoInput::OnMin(MM::PropertyBase* pProp, MM::ActionType pAct, long channel)
+{
+	if (pAct == MM::BeforeGet){
+		double mean;
+		long min, max;
+		GetStatistics(channel, mean, min, max);
+		pProp->Set(min);
+	}
+	return DEVICE_OK;
+}
 
+int MojoInput::OnMax(MM::PropertyBase* pProp, MM::ActionType pAct, long channel)
+{
+	if (pAct == MM::BeforeGet){
+		double mean;
+		long min, max;
+		GetStatistics(channel, mean, min, max);
+		pProp->Set(max);
+	}
+	return DEVICE_OK;
+}
 
-		pProp->Set(answer);
-		state_[channel]=answer;
+int MojoInput::OnStreaming(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet){
+		pProp->Set(streaming_ ? "On" : "Off");
+	} else if (pAct == MM::AfterSet){
+		std::string val;
+		pProp->Get(val);
+		if(val.compare("On") == 0){
+			return StartStreaming();
+		}
+		StopStreaming();
 	}
 	return DEVICE_OK;
 }
+
+int MojoInput::OnStreamingPeriod(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	// read by the monitor thread
+	MMThreadGuard myLock(lock_);
+	if (pAct == MM::BeforeGet){
+		pProp->Set(streamingPeriod_);
+	} else if (pAct == MM::AfterSet){
+		pProp->Get(streamingPeriod_);
+	}
+	return DEVICE_OK;
+}
+
+int MojoInput::OnWindow(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	MMThreadGuard myLock(lock_);
+	if (pAct == MM::BeforeGet){
+		pProp->Set(window_);
+	} else if (pAct == MM::AfterSet){
+		pProp->Get(window_);
+	}
+	return DEVICE_OK;
+}
+
+int MojoInput::OnSamples(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet){
+		pProp->Set((long) ringWritten_.load(std::memory_order_acquire));
+	}
+	return DEVICE_OK;
+}
+
+int MojoInput::OnRecentBlocks(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+	if (pAct == MM::BeforeGet){
+		pProp->Set(GetRecentBlocks().c_str());
+	}
+	return DEVICE_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//////
+MojoInputMonitorThread::MojoInputMonitorThread(MojoInput& input) :
+	input_(input),
+	stop_(true)
+{
+}
+
+MojoInputMonitorThread::~MojoInputMonitorThread()
+{
+	Stop();
+	wait();
+}
+
+int MojoInputMonitorThread::svc()
+{
+	while (!stop_)
+	{
+		double wait = input_.GetTimeToNextBlock();
+		if(wait > 0){
+			// sleep by short steps to stay responsive to Stop()
+			CDeviceUtils::SleepMs(wait > 50 ? 50 : (long) wait);
+			continue;
+		}
+
+		input_.AcquireBlock();
+	}
+	return 0;
+}
+
+void MojoInputMonitorThread::Start()
+{
+	stop_ = false;
+	activate();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//////
+MojoHubCommandThread::MojoHubCommandThread(MojoHub& hub) :
+	hub_(hub)
+{
+}
+
+MojoHubCommandThread::~MojoHubCommandThread()
+{
+	Stop();
+	wait();
+}
+
+int MojoHubCommandThread::svc()
+{
+	// Errors are kept by the hub and reported to the next submission
+	while (hub_.WaitForCommands())
+	{
+		hub_.FlushQueue(true);
+	}
+	return 0;
+}
+
+void MojoHubCommandThread::Start()
+{
+	activate();
+}
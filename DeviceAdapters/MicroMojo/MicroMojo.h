@@ -16,6 +16,15 @@
 
 #include "../../MMDevice/MMDevice.h"
 #include "../../MMDevice/DeviceBase.h"
+#include "MojoRegisters.h"
+#include "MojoSimulator.h"
+#include <deque>
+#include <map>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
 
 //////////////////////////////////////////////////////////////////////////////
 // Error codes
@@ -24,8 +33,16 @@
 #define ERR_PORT_OPEN_FAILED 102
 #define ERR_NO_PORT_SET 103
 #define ERR_VERSION_MISMATCH 104
-#define ERR_COMMAND_UNKNOWN 38730
+#define ERR_ANSWER_TIMEOUT 105
+#define ERR_VERIFY_FAILED 106
+#define ERR_BAUDRATE_FAILED 107
+#define ERR_INVALID_TRAJECTORY 108
+// ERR_COMMAND_UNKNOWN is the answer of the firmware, see MojoRegisters.h
 
+// Size of the hub receive buffer (bytes)
+#define MOJO_RX_BUFFER_SIZE 256
+
+class MojoHubCommandThread;
 
 class MojoHub : public HubBase<MojoHub>  
 {
@@ -44,24 +61,82 @@ public:
    // property handlers
    int OnPort(MM::PropertyBase* pPropt, MM::ActionType eAct);
    int OnVersion(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnResync(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnVerifyWrites(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnSimulated(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnStatistics(MM::PropertyBase* pPropt, MM::ActionType eAct, long statistic);
+   int OnResetStatistics(MM::PropertyBase* pPropt, MM::ActionType eAct);
 
-   int PurgeComPortH() {return PurgeComPort(port_.c_str());}
+   int PurgeComPortH();
    int SendWriteRequest(long address, long value);
    int SendReadRequest(long address);
    int ReadAnswer(long& answer);
-   int WriteToComPortH(const unsigned char* command, unsigned len) {return WriteToComPort(port_.c_str(), command, len);}
+   int ReadRegisters(const long* addresses, long* answers, int n);
+   int WriteRegisters(const long* addresses, const long* values, int n);
+   int WriteRegister(long address, long value);
+   int QueueWrite(long address, long value);
+   bool HasPendingWrites();
+   int GetRegister(long address, long& value);
+   int ResyncRegisters();
+   int WriteTable(long address, const std::vector<long>& values);
+   bool SupportsSequences() const {return supportsSequences_;}
+   bool SupportsTrajectories() const {return supportsTrajectories_;}
+   int WriteToComPortH(const unsigned char* command, unsigned len) {
+      if (simulator_) return simulator_->Write(command, len);
+      return WriteToComPort(port_.c_str(), command, len);
+   }
    int ReadFromComPortH(unsigned char* answer, unsigned maxLen, unsigned long& bytesRead) {
+      if (simulator_) return simulator_->Read(answer, maxLen, bytesRead);
       return ReadFromComPort(port_.c_str(), answer, maxLen, bytesRead);
    }
-   static MMThreadLock& GetLock() {return lock_;}
+   MMThreadLock& GetLock() {return lock_;}
+
+   // called by the command thread
+   bool WaitForCommands();
+   void StopCommands();
+   int FlushQueue(bool background = false);
 
 private:
    int GetControllerVersion(long&);
+   int ProbeRegister(long address, bool& available);
+   int NegotiateBaudRate();
+   int SwitchBaudRate(int index);
+   int SetPortBaudRate(long rate);
+   void FormatWriteRequest(unsigned char* command, long address, long value);
+   void FormatReadRequest(unsigned char* command, long address);
+   int SendWrites(const long* addresses, const long* values, int n);
+   int FillReceiveBuffer(unsigned long& bytesRead);
+   bool IsShadowed(long address);
+   void RecordTransaction(double latency);
+   double GetLatencyPercentile(double percentile);
    std::string port_;
    bool initialized_;
    bool portAvailable_;
    long version_;
-   static MMThreadLock lock_;
+   std::deque<long> pending_; // addresses of the read requests waiting for an answer
+   unsigned char rxBuffer_[MOJO_RX_BUFFER_SIZE]; // ring buffer of the received bytes
+   unsigned int rxHead_;
+   unsigned int rxCount_;
+   std::map<long, long> shadow_; // last known value of the registers written by the adapter
+   bool verifyWrites_;
+   bool supportsSequences_;
+   bool supportsTrajectories_;
+   long baudRate_;
+   bool simulated_;
+   MojoSimulator* simulator_; // replaces the serial port in simulation
+   std::vector<double> latencies_; // ms, last transactions
+   unsigned long transactions_;
+   MM::MMTime statisticsStart_;
+   MMThreadLock lock_; // serialises the port access of this hub
+
+   // Command queue: writes submitted by the peripherals and sent by the command thread
+   MojoHubCommandThread* commandThread_;
+   std::vector<std::pair<long, long> > queue_; // (address, value) in submission order
+   std::mutex queueMutex_;
+   std::condition_variable queueReady_;
+   size_t inFlight_; // writes taken from the queue and not sent yet
+   std::map<long, int> queueErrors_; // first error of the asynchronous writes of each register, reported in place of its next submission
+   bool stopCommands_;
 };
 
 
@@ -79,7 +154,7 @@ public:
    int Shutdown();
   
    void GetName(char* pszName) const;
-   bool Busy() {return busy_;}
+   bool Busy();
    
    unsigned long GetNumberOfLasers()const {return numlasers_;}
 
@@ -93,7 +168,7 @@ public:
 private:
 	
    int WriteToPort(long address, long value);
-   int ReadFromPort(long& answer);
+   int ReadFromPort(long address, long& answer);
 
    bool initialized_;
    long numlasers_;
@@ -118,7 +193,7 @@ public:
    int Shutdown();
   
    void GetName(char* pszName) const;
-   bool Busy() {return busy_;}
+   bool Busy();
    
    unsigned long GetNumberOfServos()const {return numServos_;}
 
@@ -126,15 +201,22 @@ public:
    // ----------------
    int OnNumberOfServos(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnPosition(MM::PropertyBase* pProp, MM::ActionType eAct, long servo);
+   int OnTrajectory(MM::PropertyBase* pProp, MM::ActionType eAct, long servo);
+   int OnRunTrajectory(MM::PropertyBase* pProp, MM::ActionType eAct, long servo);
 
 private:
    int WriteToPort(long address, long value);
-   int ReadFromPort(long& answer);
+   int ReadFromPort(long address, long& answer);
+   int LoadTrajectory(long servo, const std::string& trajectory);
+   int UpdateTrajectoryStatus();
 
    long *position_;
    bool initialized_;
    long numServos_;
    bool busy_;
+   std::string *trajectory_;
+   long *trajectoryLength_;
+   bool *running_;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -152,7 +234,7 @@ public:
    int Shutdown();
   
    void GetName(char* pszName) const;
-   bool Busy() {return busy_;}
+   bool Busy();
    
    unsigned long GetNumberOfChannels()const {return numChannels_;}
 
@@ -163,10 +245,12 @@ public:
 
 private:
    int WriteToPort(long channel, long state);
-   int ReadFromPort(long& answer);
+   int ReadFromPort(long address, long& answer);
+   int LoadSequence(long channel, const std::vector<std::string>& sequence);
 
    long numChannels_;
    long *state_;
+   long *sequenceLength_;
    bool initialized_;
    bool busy_;
 };
@@ -186,7 +270,7 @@ public:
    int Shutdown();
   
    void GetName(char* pszName) const;
-   bool Busy() {return busy_;}
+   bool Busy();
    
    unsigned long GetNumberOfChannels()const {return numChannels_;}
 
@@ -197,10 +281,12 @@ public:
 
 private:
    int WriteToPort(long channel, long value);
-   int ReadFromPort(long& answer);
+   int ReadFromPort(long address, long& answer);
+   int LoadSequence(long channel, const std::vector<std::string>& sequence);
    
    bool initialized_;
    long *state_;
+   long *sequenceLength_;
    long numChannels_;
    bool busy_;
 };
@@ -208,6 +294,8 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 //////
+class MojoInputMonitorThread;
+
 class MojoInput : public CGenericBase<MojoInput>  
 {
 public:
@@ -220,18 +308,81 @@ public:
    bool Busy();
 
    int OnAnalogInput(MM::PropertyBase* pProp, MM::ActionType eAct, long channel);
+   int OnMean(MM::PropertyBase* pProp, MM::ActionType eAct, long channel);
+   int OnMin(MM::PropertyBase* pProp, MM::ActionType eAct, long channel);
+   int OnMax(MM::PropertyBase* pProp, MM::ActionType eAct, long channel);
    int OnNumberOfChannels(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStreaming(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStreamingPeriod(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnWindow(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSamples(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRecentBlocks(MM::PropertyBase* pProp, MM::ActionType eAct);
    
    unsigned long GetNumberOfChannels()const {return numChannels_;}
 
+   // called by the monitor thread
+   int AcquireBlock();
+   double GetTimeToNextBlock();
+
 private:
    int WriteToPort(long address);
    int ReadFromPort(long& answer);
+   int ReadAllChannels();
+   int StartStreaming();
+   void StopStreaming();
+   void GetStatistics(long channel, double& mean, long& min, long& max);
+   std::string GetRecentBlocks();
    
    MMThreadLock lock_;
    long numChannels_;
    long *state_;
+   bool *fresh_; // values of the last read pass not yet served
+   MM::MMTime lastRead_; // time of the last read pass
    bool initialized_;
+
+   // Streaming: the monitor thread is the only writer of the ring buffer
+   MojoInputMonitorThread* thread_;
+   bool streaming_;
+   long streamingPeriod_; // guarded by lock_
+   long window_; // guarded by lock_
+   MM::MMTime streamingStart_;
+   MM::MMTime nextBlock_;
+   std::vector<long> ringValues_; // blocks of numChannels_ samples
+   std::vector<double> ringTimes_; // ms since the start of the streaming
+   std::atomic<unsigned long> ringWritten_; // number of blocks written
+};
+
+class MojoInputMonitorThread : public MMDeviceThreadBase
+{
+public:
+   MojoInputMonitorThread(MojoInput& input);
+   ~MojoInputMonitorThread();
+   int svc();
+   int open (void*) { return 0;}
+   int close(unsigned long) {return 0;}
+
+   void Start();
+   void Stop() {stop_ = true;}
+
+private:
+   MojoInput& input_;
+   volatile bool stop_;
+};
+
+class MojoHubCommandThread : public MMDeviceThreadBase
+{
+public:
+   MojoHubCommandThread(MojoHub& hub);
+   ~MojoHubCommandThread();
+   int svc();
+   int open (void*) { return 0;}
+   int close(unsigned long) {return 0;}
+
+   void Start();
+   void Stop() {hub_.StopCommands();}
+
+private:
+   MojoHub& hub_;
 };
 
 #endif
\ No newline at end of file
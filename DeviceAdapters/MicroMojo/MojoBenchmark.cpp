@@ -0,0 +1,144 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          MojoBenchmark.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Times the register transactions of MojoHub against the firmware
+//                simulator, without a board nor the Micro-Manager core. Run by
+//                "make check", fails if a transaction fails or a value written is
+//                not read back.
+// COPYRIGHT:     The MicroMojo adapter authors
+// LICENSE:       LGPL
+//
+// AUTHOR:        MicroMojo adapter contributors, 2026
+//
+//
+
+#include "MicroMojo.h"
+#include "MojoRegisters.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Number of repetitions of each timed operation
+const int g_benchiterations = 200;
+
+int Report(const char* name, int ret, Clock::time_point start, int operations)
+{
+	if(ret != DEVICE_OK){
+		printf("%s: failed with error %d\n", name, ret);
+		return ret;
+	}
+	double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	printf("%-32s %8.3f ms per operation\n", name, elapsed / operations);
+	return DEVICE_OK;
+}
+
+int RunBenchmark(MojoHub& hub)
+{
+	// Single read: one round trip on the simulated link
+	long address = g_offsetaddressAnalogInput;
+	long answer = 0;
+	int ret = DEVICE_OK;
+	Clock::time_point start = Clock::now();
+	for(int i=0;i<g_benchiterations && ret == DEVICE_OK;i++){
+		ret = hub.ReadRegisters(&address, &answer, 1);
+	}
+	ret = Report("Single read", ret, start, g_benchiterations);
+	if(ret != DEVICE_OK)
+		return ret;
+
+	// All the analog inputs, pipelined
+	std::vector<long> addresses(g_maxanaloginput);
+	std::vector<long> answers(g_maxanaloginput);
+	for(int i=0;i<g_maxanaloginput;i++){
+		addresses[i] = g_offsetaddressAnalogInput+i;
+	}
+	start = Clock::now();
+	for(int i=0;i<g_benchiterations && ret == DEVICE_OK;i++){
+		ret = hub.ReadRegisters(&addresses[0], &answers[0], g_maxanaloginput);
+	}
+	ret = Report("Pipelined analog inputs", ret, start, g_benchiterations);
+	if(ret != DEVICE_OK)
+		return ret;
+
+	// All the TTL outputs in a single transfer
+	addresses.resize(g_maxttl);
+	std::vector<long> values(g_maxttl);
+	for(int i=0;i<g_maxttl;i++){
+		addresses[i] = g_offsetaddressTTL+i;
+	}
+	start = Clock::now();
+	for(int i=0;i<g_benchiterations && ret == DEVICE_OK;i++){
+		for(int k=0;k<g_maxttl;k++){
+			values[k] = (i + k) % 2;
+		}
+		ret = hub.WriteRegisters(&addresses[0], &values[0], g_maxttl);
+	}
+	ret = Report("Batched TTL writes", ret, start, g_benchiterations);
+	if(ret != DEVICE_OK)
+		return ret;
+
+	// Writes of a peripheral: queued, coalesced and sent by the command thread
+	start = Clock::now();
+	for(int i=0;i<g_benchiterations && ret == DEVICE_OK;i++){
+		ret = hub.WriteRegister(g_offsetaddressTTL, i % 2);
+	}
+	while(ret == DEVICE_OK && hub.Busy()){
+		CDeviceUtils::SleepMs(1);
+	}
+	ret = Report("Queued TTL writes", ret, start, g_benchiterations);
+	if(ret != DEVICE_OK)
+		return ret;
+
+	address = g_offsetaddressTTL;
+	ret = hub.ReadRegisters(&address, &answer, 1);
+	if(ret != DEVICE_OK)
+		return ret;
+	if(answer != (g_benchiterations - 1) % 2){
+		printf("Queued TTL writes: read back %ld instead of %d\n", answer, (g_benchiterations - 1) % 2);
+		return DEVICE_ERR;
+	}
+
+	// Sequence load
+	if(hub.SupportsSequences()){
+		std::vector<long> table(g_maxsequence);
+		for(int i=0;i<g_maxsequence;i++){
+			table[i] = i % 2;
+		}
+		start = Clock::now();
+		ret = hub.WriteTable(g_offsetaddressTTLSequence, table);
+		ret = Report("TTL sequence load", ret, start, 1);
+		if(ret != DEVICE_OK)
+			return ret;
+	}
+
+	return DEVICE_OK;
+}
+
+int main()
+{
+	MojoHub hub;
+	int ret = hub.SetProperty("Simulated", "Yes");
+	if(ret == DEVICE_OK){
+		ret = hub.Initialize();
+	}
+	if(ret != DEVICE_OK){
+		printf("Initialization failed with error %d\n", ret);
+		return 1;
+	}
+
+	long baudRate = 0;
+	char value[MM::MaxStrLength];
+	if(hub.GetProperty("Baud rate", value) == DEVICE_OK){
+		baudRate = atol(value);
+	}
+	printf("MojoHub on the simulated firmware at %ld baud\n", baudRate);
+
+	ret = RunBenchmark(hub);
+	hub.Shutdown();
+	return ret == DEVICE_OK ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          MojoRegisters.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Register map of the MicroMojo firmware, shared by the adapter
+//                and the firmware simulator
+// COPYRIGHT:     The MicroMojo adapter authors
+// LICENSE:       LGPL
+//
+// AUTHOR:        MicroMojo adapter contributors, 2026
+//
+//
+
+#ifndef _MojoRegisters_H_
+#define _MojoRegisters_H_
+
+// Answer of the firmware to a register it does not know
+#define ERR_COMMAND_UNKNOWN 38730
+
+//////////////////////////////////////////////////////////////////////////////
+/// Constants that should match the one in the firmware
+const int g_version = 1;
+
+const int g_maxlasers = 6;
+const int g_maxanaloginput = 8;
+const int g_maxttl = 6;
+const int g_maxpwm = 6;
+const int g_maxservos = 6;
+
+const int g_offsetaddressLaserMode = 0;
+const int g_offsetaddressLaserDuration = 10;
+const int g_offsetaddressLaserSequence = 20;
+const int g_offsetaddressTTL = 30;
+const int g_offsetaddressServo = 40;
+const int g_offsetaddressPWM = 50;
+const int g_offsetaddressAnalogInput = 60;
+
+const int g_address_version = 100;
+
+//////////////////////////////////////////////////////////////////////////////
+/// Optional firmware registers, boards whose firmware does not implement them
+/// answer ERR_COMMAND_UNKNOWN and the corresponding features are disabled
+const int g_maxsequence = 256; // depth of the pattern tables
+
+const int g_offsetaddressTTLSequenceLength = 110; // number of steps, 0 stops the sequence
+const int g_offsetaddressPWMSequenceLength = 120;
+const int g_offsetaddressTTLSequence = 1000; // pattern table: + channel*g_maxsequence + step
+const int g_offsetaddressPWMSequence = 3000;
+
+const int g_offsetaddressServoTrajectoryLength = 140; // number of points, starts the trajectory, 0 stops it
+const int g_offsetaddressServoTrajectoryStatus = 150; // number of points left, 0 when done
+const int g_offsetaddressServoTrajectory = 5000; // positions: + servo*g_maxsequence + point
+const int g_offsetaddressServoTrajectoryTime = 7000; // time (ms) to reach each point
+
+const int g_address_baudrate = 101; // read: mask of the supported rates, write: index of the rate to use
+const long g_baudrates[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600};
+const int g_numbaudrates = 8;
+
+#endif
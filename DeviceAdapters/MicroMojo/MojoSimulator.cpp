@@ -0,0 +1,231 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          MojoSimulator.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Host-side model of the MicroMojo firmware register protocol
+// COPYRIGHT:     The MicroMojo adapter authors
+// LICENSE:       LGPL
+//
+// AUTHOR:        MicroMojo adapter contributors, 2026
+//
+//
+
+
+#include "MojoSimulator.h"
+#include "MojoRegisters.h"
+
+// Frame sizes
+const unsigned int g_simWriteFrame = 9;
+const unsigned int g_simReadFrame = 5;
+
+MojoSimulator::MojoSimulator() :
+	baudRate_(g_baudrates[0])
+{
+	start_ = Clock::now();
+	inputEnd_ = start_;
+	outputEnd_ = start_;
+	trajectoryStart_.resize(g_maxservos, start_);
+}
+
+MojoSimulator::~MojoSimulator()
+{
+}
+
+int MojoSimulator::Write(const unsigned char* buffer, unsigned long length)
+{
+	// Each byte takes its transfer time on the link, frames are decoded once complete
+	for(unsigned long i=0;i<length;i++){
+		Clock::time_point now = Clock::now();
+		inputEnd_ = (inputEnd_ > now ? inputEnd_ : now) + TransferTime(1);
+		input_.push_back(buffer[i]);
+		DecodeFrames();
+	}
+	return 0;
+}
+
+int MojoSimulator::Read(unsigned char* buffer, unsigned long maxLength, unsigned long& bytesRead)
+{
+	// Only the answer bytes already sent on the link can be read
+	Clock::time_point now = Clock::now();
+	bytesRead = 0;
+	while(bytesRead < maxLength && !output_.empty() && outputReady_.front() <= now){
+		buffer[bytesRead++] = output_.front();
+		output_.pop_front();
+		outputReady_.pop_front();
+	}
+	return 0;
+}
+
+void MojoSimulator::Purge()
+{
+	input_.clear();
+	output_.clear();
+	outputReady_.clear();
+}
+
+void MojoSimulator::DecodeFrames()
+{
+	if(input_.empty()){
+		return;
+	}
+
+	// Resynchronise on the first byte of a frame
+	if(input_[0] != 0x80 && input_[0] != 0x00){
+		input_.erase(input_.begin());
+		return;
+	}
+
+	unsigned int frame = (input_[0] == 0x80) ? g_simWriteFrame : g_simReadFrame;
+	if(input_.size() < frame){
+		return;
+	}
+
+	// Little-endian address and value
+	long address = 0;
+	long value = 0;
+	for(int i=3;i>=0;i--){
+		address = (address << 8) | input_[1+i];
+		if(frame == g_simWriteFrame){
+			value = (value << 8) | input_[5+i];
+		}
+	}
+	input_.erase(input_.begin(), input_.begin()+frame);
+
+	if(frame == g_simWriteFrame){
+		WriteRegister(address, value);
+		return;
+	}
+
+	long answer = IsKnown(address) ? ReadRegister(address) : ERR_COMMAND_UNKNOWN;
+	for(int i=0;i<4;i++){
+		outputEnd_ = (outputEnd_ > inputEnd_ ? outputEnd_ : inputEnd_) + TransferTime(1);
+		output_.push_back((unsigned char) ((answer >> (8*i)) & 0xFF));
+		outputReady_.push_back(outputEnd_);
+	}
+}
+
+bool MojoSimulator::IsKnown(long address)
+{
+	if(address >= g_offsetaddressAnalogInput && address < g_offsetaddressAnalogInput+g_maxanaloginput){
+		return true;
+	}
+	if(address >= g_offsetaddressTTLSequence && address < g_offsetaddressTTLSequence+g_maxttl*g_maxsequence){
+		return true;
+	}
+	if(address >= g_offsetaddressPWMSequence && address < g_offsetaddressPWMSequence+g_maxpwm*g_maxsequence){
+		return true;
+	}
+	if(address >= g_offsetaddressServoTrajectory && address < g_offsetaddressServoTrajectory+g_maxservos*g_maxsequence){
+		return true;
+	}
+	if(address >= g_offsetaddressServoTrajectoryTime && address < g_offsetaddressServoTrajectoryTime+g_maxservos*g_maxsequence){
+		return true;
+	}
+	if(address == g_address_version || address == g_address_baudrate){
+		return true;
+	}
+
+	// Blocks of one register per channel
+	const int blocks[][2] = {
+		{g_offsetaddressLaserMode, g_maxlasers}, {g_offsetaddressLaserDuration, g_maxlasers},
+		{g_offsetaddressLaserSequence, g_maxlasers}, {g_offsetaddressTTL, g_maxttl},
+		{g_offsetaddressServo, g_maxservos}, {g_offsetaddressPWM, g_maxpwm},
+		{g_offsetaddressTTLSequenceLength, g_maxttl}, {g_offsetaddressPWMSequenceLength, g_maxpwm},
+		{g_offsetaddressServoTrajectoryLength, g_maxservos}, {g_offsetaddressServoTrajectoryStatus, g_maxservos}};
+	for(unsigned int i=0;i<sizeof(blocks)/sizeof(blocks[0]);i++){
+		if(address >= blocks[i][0] && address < blocks[i][0]+blocks[i][1]){
+			return true;
+		}
+	}
+	return false;
+}
+
+long MojoSimulator::ReadRegister(long address)
+{
+	if(address == g_address_version){
+		return g_version;
+	}
+	if(address == g_address_baudrate){
+		return (1 << g_numbaudrates) - 1;
+	}
+
+	// Analog inputs: 10 bits triangle signals with a different period on each channel
+	if(address >= g_offsetaddressAnalogInput && address < g_offsetaddressAnalogInput+g_maxanaloginput){
+		long channel = address-g_offsetaddressAnalogInput;
+		long ms = (long) std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now()-start_).count();
+		long period = 1000*(channel+1);
+		long phase = ms % period;
+		return phase < period/2 ? 2046*phase/period : 2046*(period-phase)/period;
+	}
+
+	// Trajectories progress with time
+	if(address >= g_offsetaddressServo && address < g_offsetaddressServo+g_maxservos){
+		UpdateTrajectory(address-g_offsetaddressServo);
+	} else if(address >= g_offsetaddressServoTrajectoryStatus && address < g_offsetaddressServoTrajectoryStatus+g_maxservos){
+		UpdateTrajectory(address-g_offsetaddressServoTrajectoryStatus);
+	}
+
+	std::map<long, long>::iterator it = registers_.find(address);
+	return it == registers_.end() ? 0 : it->second;
+}
+
+void MojoSimulator::WriteRegister(long address, long value)
+{
+	// Unknown and read-only registers ignore the writes, as in the firmware
+	if(!IsKnown(address) || address == g_address_version ||
+		(address >= g_offsetaddressAnalogInput && address < g_offsetaddressAnalogInput+g_maxanaloginput) ||
+		(address >= g_offsetaddressServoTrajectoryStatus && address < g_offsetaddressServoTrajectoryStatus+g_maxservos)){
+		return;
+	}
+
+	// The firmware switches its rate once the frame is received
+	if(address == g_address_baudrate){
+		if(value >= 0 && value < g_numbaudrates){
+			baudRate_ = g_baudrates[value];
+		}
+		return;
+	}
+
+	if(address >= g_offsetaddressServoTrajectoryLength && address < g_offsetaddressServoTrajectoryLength+g_maxservos){
+		long servo = address-g_offsetaddressServoTrajectoryLength;
+		UpdateTrajectory(servo);
+		trajectoryStart_[servo] = Clock::now();
+		registers_[g_offsetaddressServoTrajectoryStatus+servo] = value;
+	}
+
+	registers_[address] = value;
+}
+
+void MojoSimulator::UpdateTrajectory(long servo)
+{
+	long length = registers_[g_offsetaddressServoTrajectoryLength+servo];
+	if(length <= 0){
+		registers_[g_offsetaddressServoTrajectoryStatus+servo] = 0;
+		return;
+	}
+
+	// Move the servo to the last point whose time is elapsed
+	long elapsed = (long) std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now()-trajectoryStart_[servo]).count();
+	long time = 0;
+	long done = 0;
+	while(done < length){
+		time += registers_[g_offsetaddressServoTrajectoryTime+servo*g_maxsequence+done];
+		if(time > elapsed){
+			break;
+		}
+		registers_[g_offsetaddressServo+servo] = registers_[g_offsetaddressServoTrajectory+servo*g_maxsequence+done];
+		done++;
+	}
+
+	registers_[g_offsetaddressServoTrajectoryStatus+servo] = length-done;
+	if(done == length){
+		registers_[g_offsetaddressServoTrajectoryLength+servo] = 0;
+	}
+}
+
+MojoSimulator::Clock::duration MojoSimulator::TransferTime(unsigned long bytes)
+{
+	// 8N1: 10 bits per byte
+	return std::chrono::duration_cast<Clock::duration>(std::chrono::microseconds(bytes*10*1000000LL/baudRate_));
+}
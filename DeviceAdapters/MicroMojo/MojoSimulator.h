@@ -0,0 +1,57 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          MojoSimulator.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Host-side model of the MicroMojo firmware register protocol
+// COPYRIGHT:     The MicroMojo adapter authors
+// LICENSE:       LGPL
+//
+// AUTHOR:        MicroMojo adapter contributors, 2026
+//
+//
+
+#ifndef _MojoSimulator_H_
+#define _MojoSimulator_H_
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <vector>
+
+// Replaces the serial port of MojoHub: frames written by the hub are decoded as the
+// firmware does and the answers are made available with the delay of a serial link
+// running at the simulated baud rate.
+class MojoSimulator
+{
+public:
+   MojoSimulator();
+   ~MojoSimulator();
+
+   int Write(const unsigned char* buffer, unsigned long length);
+   int Read(unsigned char* buffer, unsigned long maxLength, unsigned long& bytesRead);
+   void Purge();
+   void SetBaudRate(long rate) {baudRate_ = rate;}
+
+private:
+   typedef std::chrono::steady_clock Clock;
+
+   void DecodeFrames();
+   long ReadRegister(long address);
+   void WriteRegister(long address, long value);
+   bool IsKnown(long address);
+   void UpdateTrajectory(long servo);
+   Clock::duration TransferTime(unsigned long bytes);
+
+   std::vector<unsigned char> input_; // bytes of the frame being received
+   std::deque<unsigned char> output_; // answers waiting to be read
+   std::deque<Clock::time_point> outputReady_; // time at which each answer byte is on the wire
+   Clock::time_point inputEnd_; // time at which the last written byte is received
+   Clock::time_point outputEnd_; // time at which the last answer byte is sent
+   Clock::time_point start_;
+   std::map<long, long> registers_;
+   std::vector<Clock::time_point> trajectoryStart_;
+   long baudRate_;
+};
+
+#endif
@@ -0,0 +1,1134 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DAQmxStandIn.cpp
+// PROJECT:       100X micro-manager extensions
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   In-memory stand-in for the NI-DAQmx library
+//
+//                Implements the DAQmx functions used by NI100X with the
+//                signatures of NIDAQmx.h. Link it instead of nidaqmx.lib
+//                to run the adapter without a card: the file is excluded
+//                from the regular build of NI100X.vcxproj, Makefile.am
+//                links it into the NI100XBenchmark check program.
+//
+//                The stand-in exposes a single card, Dev1, with 4 analog
+//                outputs, 8 analog inputs, two 8-line digital ports, 4
+//                counters and PFI0-7. Sample clocks tick at their
+//                configured rate when the source is the onboard clock,
+//                and at NI100X_STANDIN_TRIGGER_HZ (default 100 Hz) when
+//                the source is a terminal; so do the changes of the
+//                digital inputs, which count in binary. Every call takes
+//                NI100X_STANDIN_LATENCY_US microseconds, task creation,
+//                commit and implicit commit take
+//                NI100X_STANDIN_TASK_LATENCY_US.
+//
+// AUTHOR:        NI100X adapter contributors, 2026
+//
+// COPYRIGHT:     The NI100X adapter authors
+//
+
+#include "NIDAQmx.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef __CFUNC
+#define __CFUNC
+#endif
+
+namespace
+{
+   typedef std::chrono::steady_clock Clock;
+
+   // Errors of the real library for the same conditions
+   const int32 g_ErrorInvalidTask = -200088;
+   const int32 g_ErrorInvalidChannel = -200170;
+   const int32 g_ErrorReadTimeout = -200284;
+   const int32 g_ErrorUnderflow = -200290;
+   const int32 g_ErrorWriteTimeout = -200292;
+   const int32 g_ErrorOverflow = -200279;
+   const int32 g_ErrorEmptyBuffer = -200462;
+   const int32 g_ErrorWaitTimeout = -200560;
+
+   // Longest wait of a call, whatever its timeout.
+   const double g_MaxWait = 10.0;
+
+   const char* g_Devices = "Dev1";
+   const char* g_AOChannels = "Dev1/ao0, Dev1/ao1, Dev1/ao2, Dev1/ao3";
+   const char* g_AIChannels = "Dev1/ai0, Dev1/ai1, Dev1/ai2, Dev1/ai3, "
+      "Dev1/ai4, Dev1/ai5, Dev1/ai6, Dev1/ai7";
+   const char* g_DOLines = "Dev1/port0/line0, Dev1/port0/line1, Dev1/port0/line2, "
+      "Dev1/port0/line3, Dev1/port0/line4, Dev1/port0/line5, Dev1/port0/line6, "
+      "Dev1/port0/line7, Dev1/port1/line0, Dev1/port1/line1, Dev1/port1/line2, "
+      "Dev1/port1/line3, Dev1/port1/line4, Dev1/port1/line5, Dev1/port1/line6, "
+      "Dev1/port1/line7";
+   const char* g_COChannels = "Dev1/ctr0, Dev1/ctr1, Dev1/ctr2, Dev1/ctr3";
+   const char* g_Terminals = "/Dev1/PFI0, /Dev1/PFI1, /Dev1/PFI2, /Dev1/PFI3, "
+      "/Dev1/PFI4, /Dev1/PFI5, /Dev1/PFI6, /Dev1/PFI7";
+   const uInt32 g_LinesPerPort = 8;
+
+   enum TaskType { Untyped, AnalogOutput, AnalogInput, DigitalOutput, CounterOutput,
+      DigitalInput, CounterInput };
+
+   // Rate of the timebase counted by the counter inputs
+   const double g_TimebaseRate = 20e6;
+
+   struct Task
+   {
+      Task() : type(Untyped), numChans(0), numLines(0), timed(false), rate(0.0),
+         external(false), implicit(false), finite(false), sampsPerChan(0), regenerate(true),
+         bufferSize(0), written(0), writePos(0), readPos(0), startTrigger(false),
+         retriggerable(false), committed(false), running(false), error(0) {}
+
+      TaskType type;
+      uInt32 numChans;
+      uInt32 numLines;
+      bool timed;
+      double rate;
+      // The sample clock is a terminal, i.e. an external trigger
+      bool external;
+      // Counter output clocked by its own pulses, at rate
+      bool implicit;
+      bool finite;
+      uInt64 sampsPerChan;
+      bool regenerate;
+      // Configured buffer size, 0 if sized by the writes
+      uInt32 bufferSize;
+      // Output: samples per channel in the buffer, or streamed so far
+      uInt64 written;
+      uInt64 writePos;
+      // Input: samples per channel read so far
+      uInt64 readPos;
+      bool startTrigger;
+      bool retriggerable;
+      bool committed;
+      bool running;
+      Clock::time_point started;
+      // Error stopping the task, reported by the next call
+      int32 error;
+   };
+
+   std::mutex g_Mutex;
+   std::map<TaskHandle, Task*> g_Tasks;
+   unsigned long g_NextTask = 1;
+   std::string g_LastError;
+
+   long GetEnv(const char* name, long def)
+   {
+      const char* value = std::getenv(name);
+      return value == 0 ? def : std::atol(value);
+   }
+
+   void Latency(bool task)
+   {
+      static const long callLatency = GetEnv("NI100X_STANDIN_LATENCY_US", 0);
+      static const long taskLatency = GetEnv("NI100X_STANDIN_TASK_LATENCY_US", 0);
+      long latency = task ? taskLatency : callLatency;
+      if (latency > 0)
+      {
+         std::this_thread::sleep_for(std::chrono::microseconds(latency));
+      }
+   }
+
+   double TriggerRate()
+   {
+      static const long rate = GetEnv("NI100X_STANDIN_TRIGGER_HZ", 100);
+      return rate > 0 ? (double) rate : 100.0;
+   }
+
+   int32 Fail(int32 error, const std::string& message)
+   {
+      g_LastError = message;
+      return error;
+   }
+
+   Task* Find(TaskHandle handle)
+   {
+      std::map<TaskHandle, Task*>::iterator it = g_Tasks.find(handle);
+      return it == g_Tasks.end() ? 0 : it->second;
+   }
+
+   // Number of physical channels in a list such as "Dev1/ao0:2, Dev1/ao3",
+   // 0 if one of them does not exist.
+   uInt32 CountChannels(const std::string& list, const char* known, uInt32* lines = 0)
+   {
+      uInt32 count = 0;
+      if (lines != 0)
+      {
+         *lines = 0;
+      }
+      size_t start = 0;
+      while (start < list.size())
+      {
+         size_t end = list.find(',', start);
+         if (end == std::string::npos)
+         {
+            end = list.size();
+         }
+         std::string channel = list.substr(start, end - start);
+         start = end + 1;
+         size_t first = channel.find_first_not_of(' ');
+         if (first == std::string::npos)
+         {
+            continue;
+         }
+         channel = channel.substr(first, channel.find_last_not_of(' ') - first + 1);
+
+         // Range suffix, e.g. line0:3
+         uInt32 span = 1;
+         size_t colon = channel.rfind(':');
+         if (colon != std::string::npos)
+         {
+            size_t digits = channel.find_last_not_of("0123456789", colon - 1) + 1;
+            long from = std::atol(channel.substr(digits, colon - digits).c_str());
+            long to = std::atol(channel.substr(colon + 1).c_str());
+            span = (uInt32) (to >= from ? to - from + 1 : from - to + 1);
+            channel = channel.substr(0, colon);
+         }
+
+         // A whole digital port
+         bool port = (lines != 0 && channel.find("line") == std::string::npos);
+         std::string name = port ? channel + "/line0" : channel;
+         if (std::strstr(known, name.c_str()) == 0)
+         {
+            return 0;
+         }
+         count += 1;
+         if (lines != 0)
+         {
+            *lines += port ? g_LinesPerPort : span;
+         }
+         else
+         {
+            count += span - 1;
+         }
+      }
+      return count;
+   }
+
+   // Samples per channel clocked since the task started.
+   uInt64 Ticks(Task* task)
+   {
+      if (!task->running || !task->timed)
+      {
+         return 0;
+      }
+      double elapsed = std::chrono::duration<double>(Clock::now() - task->started).count();
+      uInt64 ticks;
+      if (task->startTrigger && task->retriggerable)
+      {
+         // Each trigger clocks a finite block
+         ticks = (uInt64) (elapsed * TriggerRate()) * task->sampsPerChan;
+      }
+      else
+      {
+         ticks = (uInt64) (elapsed * (task->external ? TriggerRate() : task->rate));
+         if (task->finite && ticks > task->sampsPerChan)
+         {
+            ticks = task->sampsPerChan;
+         }
+      }
+      return ticks;
+   }
+
+   uInt32 Capacity(Task* task)
+   {
+      if (task->bufferSize > 0)
+      {
+         return task->bufferSize;
+      }
+      return (uInt32) (task->sampsPerChan > task->written ? task->sampsPerChan : task->written);
+   }
+
+   // Samples generated by an output task, flagging underflows.
+   uInt64 Generated(Task* task)
+   {
+      uInt64 ticks = Ticks(task);
+      if (task->regenerate)
+      {
+         return ticks;
+      }
+      if (ticks > task->written && task->error == 0)
+      {
+         task->error = g_ErrorUnderflow;
+         g_LastError = "The generation has stopped to prevent the regeneration of old samples.";
+      }
+      return ticks < task->written ? ticks : task->written;
+   }
+
+   // Samples per channel acquired and not read yet.
+   uInt64 Available(Task* task)
+   {
+      uInt64 ticks = Ticks(task);
+      uInt64 available = ticks - task->readPos;
+      uInt32 capacity = Capacity(task);
+      if (capacity > 0 && available > capacity && task->error == 0)
+      {
+         task->error = g_ErrorOverflow;
+         g_LastError = "The application is not able to keep up with the hardware acquisition.";
+      }
+      return available;
+   }
+
+   // Wait, without holding the lock, for the hardware to progress.
+   void Wait(std::unique_lock<std::mutex>& lock, double seconds)
+   {
+      lock.unlock();
+      std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+      lock.lock();
+   }
+
+   int32 CreateChannel(TaskHandle handle, const char channels[], TaskType type, const char* known,
+      bool perLine = false)
+   {
+      Task* task = Find(handle);
+      if (task == 0)
+      {
+         return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+      }
+      uInt32 lines = 0;
+      bool digital = (type == DigitalOutput || type == DigitalInput);
+      uInt32 count = CountChannels(channels, known, digital ? &lines : 0);
+      if (count == 0)
+      {
+         return Fail(g_ErrorInvalidChannel,
+            std::string("Physical channel specified does not exist: ") + channels);
+      }
+      task->type = type;
+      task->numChans += perLine ? lines : count;
+      task->numLines += lines;
+      task->committed = false;
+      return 0;
+   }
+
+   // Wait for numSampsPerChan samples of an input task, -1 for the
+   // samples available, and provide the first and number of samples to
+   // read. On-demand reads return the current sample.
+   int32 Acquire(std::unique_lock<std::mutex>& lock, TaskHandle handle, int32 numSampsPerChan,
+      float64 timeout, uInt32 arraySizeInSamps, Task*& task, uInt64& first, uInt64& count)
+   {
+      task = Find(handle);
+      if (task == 0)
+      {
+         return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+      }
+      uInt32 numChans = task->numChans > 0 ? task->numChans : 1;
+      if (!task->timed)
+      {
+         count = numSampsPerChan < 0 ? 1 : numSampsPerChan;
+         first = (uInt64) (std::chrono::duration<double>(Clock::now().time_since_epoch()).count() *
+            TriggerRate());
+      }
+      else
+      {
+         double wait = timeout < 0 || timeout > g_MaxWait ? g_MaxWait : timeout;
+         Clock::time_point deadline = Clock::now() +
+            std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wait));
+         count = Available(task);
+         while (numSampsPerChan >= 0 && count < (uInt64) numSampsPerChan &&
+            task->error == 0 && Clock::now() < deadline)
+         {
+            Wait(lock, 0.001);
+            task = Find(handle);
+            if (task == 0)
+            {
+               return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+            }
+            count = Available(task);
+         }
+         if (task->error != 0)
+         {
+            return task->error;
+         }
+         if (numSampsPerChan >= 0 && count > (uInt64) numSampsPerChan)
+         {
+            count = numSampsPerChan;
+         }
+         first = task->readPos;
+      }
+      if (count * numChans > arraySizeInSamps)
+      {
+         count = arraySizeInSamps / numChans;
+      }
+      return 0;
+   }
+
+   // Complete a read of count samples.
+   int32 Acquired(Task* task, int32 numSampsPerChan, uInt64 count, int32* sampsPerChanRead)
+   {
+      if (task->timed)
+      {
+         task->readPos += count;
+      }
+      if (sampsPerChanRead != 0)
+      {
+         *sampsPerChanRead = (int32) count;
+      }
+      if (numSampsPerChan >= 0 && count < (uInt64) numSampsPerChan)
+      {
+         return Fail(g_ErrorReadTimeout,
+            "Some or all of the samples requested have not yet been acquired.");
+      }
+      return 0;
+   }
+
+   template <class T>
+   int32 Write(TaskHandle handle, int32 numSampsPerChan, bool32 autoStart,
+      float64 timeout, const T data[], int32* written)
+   {
+      Latency(false);
+      std::unique_lock<std::mutex> lock(g_Mutex);
+      if (written != 0)
+      {
+         *written = 0;
+      }
+      Task* task = Find(handle);
+      if (task == 0)
+      {
+         return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+      }
+      if (task->error != 0)
+      {
+         return task->error;
+      }
+      (void) data;
+
+      if (!task->timed)
+      {
+         // On-demand write
+         task->running = task->running || autoStart != 0;
+      }
+      else if (!task->running)
+      {
+         task->writePos += numSampsPerChan;
+         if (task->writePos > task->written)
+         {
+            task->written = task->writePos;
+         }
+      }
+      else if (task->regenerate)
+      {
+         // Replaces data being generated
+         task->writePos = (task->writePos + numSampsPerChan) % Capacity(task);
+      }
+      else
+      {
+         // Wait for room in the buffer
+         double wait = timeout < 0 || timeout > g_MaxWait ? g_MaxWait : timeout;
+         Clock::time_point deadline = Clock::now() +
+            std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wait));
+         while (Capacity(task) - (task->written - Generated(task)) < (uInt64) numSampsPerChan)
+         {
+            if (task->error != 0)
+            {
+               return task->error;
+            }
+            if (Clock::now() >= deadline)
+            {
+               return Fail(g_ErrorWriteTimeout,
+                  "Some or all of the samples to write could not be written to the buffer yet.");
+            }
+            Wait(lock, 0.001);
+            task = Find(handle);
+            if (task == 0)
+            {
+               return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+            }
+         }
+         task->written += numSampsPerChan;
+      }
+      if (written != 0)
+      {
+         *written = numSampsPerChan;
+      }
+      return 0;
+   }
+}
+
+extern "C" {
+
+int32 __CFUNC DAQmxCreateTask(const char taskName[], TaskHandle* taskHandle)
+{
+   Latency(true);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) taskName;
+   *taskHandle = (TaskHandle) g_NextTask++;
+   g_Tasks[*taskHandle] = new Task();
+   return 0;
+}
+
+int32 __CFUNC DAQmxClearTask(TaskHandle taskHandle)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   delete task;
+   g_Tasks.erase(taskHandle);
+   return 0;
+}
+
+int32 __CFUNC DAQmxTaskControl(TaskHandle taskHandle, int32 action)
+{
+   Latency(action == DAQmx_Val_Task_Commit);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   if (action == DAQmx_Val_Task_Commit)
+   {
+      task->committed = true;
+   }
+   return 0;
+}
+
+int32 __CFUNC DAQmxStartTask(TaskHandle taskHandle)
+{
+   bool committed;
+   {
+      std::lock_guard<std::mutex> lock(g_Mutex);
+      Task* task = Find(taskHandle);
+      committed = (task != 0 && task->committed);
+   }
+   // Starting an uncommitted task commits it first
+   Latency(!committed);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   if (task->timed && !task->implicit && task->written == 0 &&
+      (task->type == AnalogOutput || task->type == DigitalOutput || task->type == CounterOutput))
+   {
+      return Fail(g_ErrorEmptyBuffer,
+         "Generation cannot be started because the output buffer is empty.");
+   }
+   task->committed = true;
+   task->running = true;
+   task->started = Clock::now();
+   task->readPos = 0;
+   task->error = 0;
+   return 0;
+}
+
+int32 __CFUNC DAQmxStopTask(TaskHandle taskHandle)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   task->running = false;
+   task->writePos = 0;
+   if (!task->regenerate)
+   {
+      task->written = 0;
+   }
+   return 0;
+}
+
+int32 __CFUNC DAQmxCreateAOVoltageChan(TaskHandle taskHandle, const char physicalChannel[],
+   const char nameToAssignToChannel[], float64 minVal, float64 maxVal, int32 units,
+   const char customScaleName[])
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) nameToAssignToChannel; (void) minVal; (void) maxVal; (void) units; (void) customScaleName;
+   return CreateChannel(taskHandle, physicalChannel, AnalogOutput, g_AOChannels);
+}
+
+int32 __CFUNC DAQmxCreateAIVoltageChan(TaskHandle taskHandle, const char physicalChannel[],
+   const char nameToAssignToChannel[], int32 terminalConfig, float64 minVal, float64 maxVal,
+   int32 units, const char customScaleName[])
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) nameToAssignToChannel; (void) terminalConfig; (void) minVal; (void) maxVal;
+   (void) units; (void) customScaleName;
+   return CreateChannel(taskHandle, physicalChannel, AnalogInput, g_AIChannels);
+}
+
+int32 __CFUNC DAQmxCreateDOChan(TaskHandle taskHandle, const char lines[],
+   const char nameToAssignToLines[], int32 lineGrouping)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) nameToAssignToLines; (void) lineGrouping;
+   return CreateChannel(taskHandle, lines, DigitalOutput, g_DOLines);
+}
+
+int32 __CFUNC DAQmxCreateCOPulseChanFreq(TaskHandle taskHandle, const char counter[],
+   const char nameToAssignToChannel[], int32 units, int32 idleState, float64 initialDelay,
+   float64 freq, float64 dutyCycle)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) nameToAssignToChannel; (void) units; (void) idleState; (void) initialDelay;
+   (void) dutyCycle;
+   int32 error = CreateChannel(taskHandle, counter, CounterOutput, g_COChannels);
+   if (error == 0)
+   {
+      Find(taskHandle)->rate = freq;
+   }
+   return error;
+}
+
+int32 __CFUNC DAQmxCreateDIChan(TaskHandle taskHandle, const char lines[],
+   const char nameToAssignToLines[], int32 lineGrouping)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) nameToAssignToLines;
+   return CreateChannel(taskHandle, lines, DigitalInput, g_DOLines,
+      lineGrouping == DAQmx_Val_ChanPerLine);
+}
+
+int32 __CFUNC DAQmxCreateCICountEdgesChan(TaskHandle taskHandle, const char counter[],
+   const char nameToAssignToChannel[], int32 edge, uInt32 initialCount, int32 countDirection)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) nameToAssignToChannel; (void) edge; (void) initialCount; (void) countDirection;
+   return CreateChannel(taskHandle, counter, CounterInput, g_COChannels);
+}
+
+int32 __CFUNC DAQmxSetCICountEdgesTerm(TaskHandle taskHandle, const char channel[], const char* data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) channel; (void) data;
+   if (Find(taskHandle) == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   return 0;
+}
+
+int32 __CFUNC DAQmxCfgChangeDetectionTiming(TaskHandle taskHandle, const char risingEdgeChan[],
+   const char fallingEdgeChan[], int32 sampleMode, uInt64 sampsPerChan)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) risingEdgeChan; (void) fallingEdgeChan;
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   // The lines change at the trigger rate
+   task->timed = true;
+   task->implicit = false;
+   task->external = true;
+   task->finite = (sampleMode == DAQmx_Val_FiniteSamps);
+   task->sampsPerChan = sampsPerChan;
+   task->committed = false;
+   return 0;
+}
+
+int32 __CFUNC DAQmxCfgImplicitTiming(TaskHandle taskHandle, int32 sampleMode, uInt64 sampsPerChan)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   task->timed = true;
+   task->implicit = true;
+   task->external = false;
+   task->finite = (sampleMode == DAQmx_Val_FiniteSamps);
+   task->sampsPerChan = sampsPerChan;
+   task->committed = false;
+   return 0;
+}
+
+int32 __CFUNC DAQmxCfgSampClkTiming(TaskHandle taskHandle, const char source[], float64 rate,
+   int32 activeEdge, int32 sampleMode, uInt64 sampsPerChan)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) activeEdge;
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   task->timed = true;
+   task->implicit = false;
+   task->rate = rate;
+   task->external = (source != 0 && source[0] != '\0');
+   task->finite = (sampleMode == DAQmx_Val_FiniteSamps);
+   task->sampsPerChan = sampsPerChan;
+   task->committed = false;
+   return 0;
+}
+
+int32 __CFUNC DAQmxSetSampTimingType(TaskHandle taskHandle, int32 data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   // Only the switch back to on-demand timing is used
+   task->timed = (data != DAQmx_Val_OnDemand);
+   task->committed = false;
+   return 0;
+}
+
+int32 __CFUNC DAQmxCfgDigEdgeStartTrig(TaskHandle taskHandle, const char triggerSource[],
+   int32 triggerEdge)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) triggerSource; (void) triggerEdge;
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   task->startTrigger = true;
+   task->committed = false;
+   return 0;
+}
+
+int32 __CFUNC DAQmxSetStartTrigRetriggerable(TaskHandle taskHandle, bool32 data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   task->retriggerable = (data != 0);
+   task->committed = false;
+   return 0;
+}
+
+int32 __CFUNC DAQmxSetWriteRegenMode(TaskHandle taskHandle, int32 data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   task->regenerate = (data != DAQmx_Val_DoNotAllowRegen);
+   return 0;
+}
+
+int32 __CFUNC DAQmxSetWriteRelativeTo(TaskHandle taskHandle, int32 data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   if (data == DAQmx_Val_FirstSample)
+   {
+      task->writePos = 0;
+   }
+   return 0;
+}
+
+int32 __CFUNC DAQmxSetWriteOffset(TaskHandle taskHandle, int32 data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   task->writePos = data;
+   return 0;
+}
+
+int32 __CFUNC DAQmxCfgOutputBuffer(TaskHandle taskHandle, uInt32 numSampsPerChan)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   task->bufferSize = numSampsPerChan;
+   task->committed = false;
+   return 0;
+}
+
+int32 __CFUNC DAQmxCfgInputBuffer(TaskHandle taskHandle, uInt32 numSampsPerChan)
+{
+   return DAQmxCfgOutputBuffer(taskHandle, numSampsPerChan);
+}
+
+int32 __CFUNC DAQmxWriteAnalogF64(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart,
+   float64 timeout, bool32 dataLayout, const float64 writeArray[], int32* sampsPerChanWritten,
+   bool32* reserved)
+{
+   (void) dataLayout; (void) reserved;
+   return Write(taskHandle, numSampsPerChan, autoStart, timeout, writeArray, sampsPerChanWritten);
+}
+
+int32 __CFUNC DAQmxWriteDigitalU32(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart,
+   float64 timeout, bool32 dataLayout, const uInt32 writeArray[], int32* sampsPerChanWritten,
+   bool32* reserved)
+{
+   (void) dataLayout; (void) reserved;
+   return Write(taskHandle, numSampsPerChan, autoStart, timeout, writeArray, sampsPerChanWritten);
+}
+
+int32 __CFUNC DAQmxWriteCtrFreq(TaskHandle taskHandle, int32 numSampsPerChan, bool32 autoStart,
+   float64 timeout, bool32 dataLayout, const float64 frequency[], const float64 dutyCycle[],
+   int32* numSampsPerChanWritten, bool32* reserved)
+{
+   (void) dataLayout; (void) dutyCycle; (void) reserved;
+   return Write(taskHandle, numSampsPerChan, autoStart, timeout, frequency, numSampsPerChanWritten);
+}
+
+int32 __CFUNC DAQmxWriteCtrFreqScalar(TaskHandle taskHandle, bool32 autoStart, float64 timeout,
+   float64 frequency, float64 dutyCycle, bool32* reserved)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) autoStart; (void) timeout; (void) dutyCycle; (void) reserved;
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   if (task->implicit && task->running)
+   {
+      // Count the pulses at the old rate up to now
+      uInt64 ticks = Ticks(task);
+      task->started = Clock::now() -
+         std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(ticks / frequency));
+   }
+   task->rate = frequency;
+   return 0;
+}
+
+int32 __CFUNC DAQmxIsTaskDone(TaskHandle taskHandle, bool32* isTaskDone)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   *isTaskDone = (!task->running || (task->finite && Ticks(task) >= task->sampsPerChan)) ? 1 : 0;
+   return 0;
+}
+
+int32 __CFUNC DAQmxWaitUntilTaskDone(TaskHandle taskHandle, float64 timeToWait)
+{
+   Latency(false);
+   std::unique_lock<std::mutex> lock(g_Mutex);
+   double wait = timeToWait < 0 || timeToWait > g_MaxWait ? g_MaxWait : timeToWait;
+   Clock::time_point deadline = Clock::now() +
+      std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wait));
+   while (true)
+   {
+      Task* task = Find(taskHandle);
+      if (task == 0)
+      {
+         return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+      }
+      if (!task->running || !task->finite || Ticks(task) >= task->sampsPerChan)
+      {
+         return 0;
+      }
+      if (Clock::now() >= deadline)
+      {
+         return Fail(g_ErrorWaitTimeout,
+            "Wait Until Done did not indicate that the task was done within the specified timeout.");
+      }
+      Wait(lock, 0.001);
+   }
+}
+
+int32 __CFUNC DAQmxReadAnalogF64(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout,
+   bool32 fillMode, float64 readArray[], uInt32 arraySizeInSamps, int32* sampsPerChanRead,
+   bool32* reserved)
+{
+   Latency(false);
+   std::unique_lock<std::mutex> lock(g_Mutex);
+   (void) reserved;
+   if (sampsPerChanRead != 0)
+   {
+      *sampsPerChanRead = 0;
+   }
+   Task* task;
+   uInt64 first;
+   uInt64 count;
+   int32 error = Acquire(lock, taskHandle, numSampsPerChan, timeout, arraySizeInSamps,
+      task, first, count);
+   if (error)
+   {
+      return error;
+   }
+   uInt32 numChans = task->numChans > 0 ? task->numChans : 1;
+
+   // Slow sine waves, with a different period on each channel
+   for (uInt64 i = 0; i < count; ++i)
+   {
+      double t = task->timed ? (first + i) / (task->external ? TriggerRate() : task->rate)
+         : std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+      for (uInt32 c = 0; c < numChans; ++c)
+      {
+         double value = 2.5 + 2.0 * std::sin(2.0 * 3.14159265358979323846 * t / (c + 1));
+         if (fillMode == DAQmx_Val_GroupByChannel)
+         {
+            readArray[c * count + i] = value;
+         }
+         else
+         {
+            readArray[i * numChans + c] = value;
+         }
+      }
+   }
+   return Acquired(task, numSampsPerChan, count, sampsPerChanRead);
+}
+
+int32 __CFUNC DAQmxReadDigitalU32(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout,
+   bool32 fillMode, uInt32 readArray[], uInt32 arraySizeInSamps, int32* sampsPerChanRead,
+   bool32* reserved)
+{
+   Latency(false);
+   std::unique_lock<std::mutex> lock(g_Mutex);
+   (void) reserved;
+   if (sampsPerChanRead != 0)
+   {
+      *sampsPerChanRead = 0;
+   }
+   Task* task;
+   uInt64 first;
+   uInt64 count;
+   int32 error = Acquire(lock, taskHandle, numSampsPerChan, timeout, arraySizeInSamps,
+      task, first, count);
+   if (error)
+   {
+      return error;
+   }
+   uInt32 numChans = task->numChans > 0 ? task->numChans : 1;
+
+   // The k-th change sets the lines to k in binary, each line read at
+   // its bit of the port
+   for (uInt64 i = 0; i < count; ++i)
+   {
+      uInt64 k = first + i + 1;
+      for (uInt32 c = 0; c < numChans; ++c)
+      {
+         uInt32 value = ((k >> c) & 1) ? (1u << (c % g_LinesPerPort)) : 0;
+         if (fillMode == DAQmx_Val_GroupByChannel)
+         {
+            readArray[c * count + i] = value;
+         }
+         else
+         {
+            readArray[i * numChans + c] = value;
+         }
+      }
+   }
+   return Acquired(task, numSampsPerChan, count, sampsPerChanRead);
+}
+
+int32 __CFUNC DAQmxReadCounterU32(TaskHandle taskHandle, int32 numSampsPerChan, float64 timeout,
+   uInt32 readArray[], uInt32 arraySizeInSamps, int32* sampsPerChanRead, bool32* reserved)
+{
+   Latency(false);
+   std::unique_lock<std::mutex> lock(g_Mutex);
+   (void) reserved;
+   if (sampsPerChanRead != 0)
+   {
+      *sampsPerChanRead = 0;
+   }
+   Task* task;
+   uInt64 first;
+   uInt64 count;
+   int32 error = Acquire(lock, taskHandle, numSampsPerChan, timeout, arraySizeInSamps,
+      task, first, count);
+   if (error)
+   {
+      return error;
+   }
+
+   // Timebase edges counted up to each sample, wrapping at 32 bits
+   double rate = task->external ? TriggerRate() : task->rate;
+   for (uInt64 i = 0; i < count; ++i)
+   {
+      readArray[i] = (uInt32) (uInt64) ((first + i + 1) * g_TimebaseRate / rate);
+   }
+   return Acquired(task, numSampsPerChan, count, sampsPerChanRead);
+}
+
+int32 __CFUNC DAQmxGetWriteSpaceAvail(TaskHandle taskHandle, uInt32* data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   uInt64 pending = task->written - Generated(task);
+   if (task->error != 0)
+   {
+      return task->error;
+   }
+   uInt32 capacity = Capacity(task);
+   *data = pending > capacity ? 0 : (uInt32) (capacity - pending);
+   return 0;
+}
+
+int32 __CFUNC DAQmxGetWriteTotalSampPerChanGenerated(TaskHandle taskHandle, uInt64* data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   *data = Generated(task);
+   return 0;
+}
+
+int32 __CFUNC DAQmxGetReadAvailSampPerChan(TaskHandle taskHandle, uInt32* data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   uInt64 available = Available(task);
+   if (task->error != 0)
+   {
+      return task->error;
+   }
+   *data = (uInt32) available;
+   return 0;
+}
+
+int32 __CFUNC DAQmxGetTaskNumChans(TaskHandle taskHandle, uInt32* data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   *data = task->numChans;
+   return 0;
+}
+
+int32 __CFUNC DAQmxGetDONumLines(TaskHandle taskHandle, const char channel[], uInt32* data)
+{
+   Latency(false);
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   (void) channel;
+   Task* task = Find(taskHandle);
+   if (task == 0)
+   {
+      return Fail(g_ErrorInvalidTask, "Task specified is invalid or does not exist.");
+   }
+   *data = task->numLines;
+   return 0;
+}
+
+}
+
+// String queries: a null buffer returns the size needed.
+static int32 CopyString(const char* value, char* data, uInt32 bufferSize)
+{
+   Latency(false);
+   uInt32 size = (uInt32) std::strlen(value) + 1;
+   if (data == 0 || bufferSize == 0)
+   {
+      return (int32) size;
+   }
+   std::strncpy(data, value, bufferSize);
+   data[bufferSize - 1] = '\0';
+   return 0;
+}
+
+static const char* GetDeviceString(const char device[], const char* value)
+{
+   return std::strcmp(device, g_Devices) == 0 ? value : "";
+}
+
+extern "C" {
+
+int32 __CFUNC DAQmxGetSysDevNames(char* data, uInt32 bufferSize)
+{
+   return CopyString(g_Devices, data, bufferSize);
+}
+
+int32 __CFUNC DAQmxGetDevDOLines(const char device[], char* data, uInt32 bufferSize)
+{
+   return CopyString(GetDeviceString(device, g_DOLines), data, bufferSize);
+}
+
+int32 __CFUNC DAQmxGetDevAOPhysicalChans(const char device[], char* data, uInt32 bufferSize)
+{
+   return CopyString(GetDeviceString(device, g_AOChannels), data, bufferSize);
+}
+
+int32 __CFUNC DAQmxGetDevAIPhysicalChans(const char device[], char* data, uInt32 bufferSize)
+{
+   return CopyString(GetDeviceString(device, g_AIChannels), data, bufferSize);
+}
+
+int32 __CFUNC DAQmxGetDevCOPhysicalChans(const char device[], char* data, uInt32 bufferSize)
+{
+   return CopyString(GetDeviceString(device, g_COChannels), data, bufferSize);
+}
+
+int32 __CFUNC DAQmxGetDevCIPhysicalChans(const char device[], char* data, uInt32 bufferSize)
+{
+   return CopyString(GetDeviceString(device, g_COChannels), data, bufferSize);
+}
+
+int32 __CFUNC DAQmxGetDevDILines(const char device[], char* data, uInt32 bufferSize)
+{
+   return CopyString(GetDeviceString(device, g_DOLines), data, bufferSize);
+}
+
+int32 __CFUNC DAQmxGetDevTerminals(const char device[], char* data, uInt32 bufferSize)
+{
+   return CopyString(GetDeviceString(device, g_Terminals), data, bufferSize);
+}
+
+int32 __CFUNC DAQmxGetExtendedErrorInfo(char errorString[], uInt32 bufferSize)
+{
+   std::lock_guard<std::mutex> lock(g_Mutex);
+   return CopyString(g_LastError.c_str(), errorString, bufferSize);
+}
+
+}
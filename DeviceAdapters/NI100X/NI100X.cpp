@@ -18,9 +18,11 @@
 
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <iostream>
 #include <sstream>
-#include <fstream>
+#include <cmath>
+#include <algorithm>
 
 #include "NI100X.h"
 #include "ModuleInterface.h"
@@ -29,8 +31,13 @@ const char* g_DeviceNameDigitalO = "DigitalO";
 const char* g_DeviceNameShutter = "Shutter";
 const char* g_DeviceNameAnalogO = "AnalogO";
 const char* g_DeviceNameAnalogI = "AnalogI";
+const char* g_DeviceNameMultiAnalogO = "MultiAnalogO";
+const char* g_DeviceNameCounterO = "CounterO";
+const char* g_DeviceNameHub = "NIHub";
+const char* g_DeviceNameDigitalI = "DigitalI";
 
 const char* g_PropertyVolts = "Volts";
+const char* g_PropertyAllVolts = "AllVolts";
 const char* g_PropertyMinVolts = "MinVolts";
 const char* g_PropertyMaxVolts = "MaxVolts";
 const char* g_PropertyChannel = "IOChannel";
@@ -40,11 +47,110 @@ const char* g_PropertyTriggeringEnabled = "Sequenceable";
 const char* g_PropertySampleRate = "TriggerSampleRate";
 const char* g_PropertySequenceLength = "TriggerSequenceLength";
 const char* g_PropertyTriggerInput = "TriggerInputLine";
+const char* g_PropertyStreaming = "Streaming";
+const char* g_PropertyStreamBufferSize = "StreamBufferSize";
+// Longest sequence accepted when streaming.
+const long g_MaxStreamedSequenceLength = 2147483647L;
+// Period at which the stream thread checks the output buffer, in ms.
+const long g_StreamPollPeriod = 10;
+// Number of call latencies kept for the statistics.
+const unsigned long g_MaxLatencySamples = 4096;
 //used for disabling EOMs temporariliy for laser switching
 const char* g_PropertyDisable = "Block voltage";
 
 const char* g_PropertyDemo = "Demo";
 
+const char* g_PropertyWaveformShape = "WaveformShape";
+const char* g_PropertyWaveformAmplitude = "WaveformAmplitude";
+const char* g_PropertyWaveformOffset = "WaveformOffset";
+const char* g_PropertyWaveformPeriod = "WaveformPeriod";
+const char* g_PropertyWaveformSamples = "WaveformSamples";
+const char* g_PropertyWaveformPoints = "WaveformPoints";
+const char* g_PropertyWaveformClock = "WaveformClock";
+const char* g_PropertyGenerateWaveform = "GenerateWaveform";
+const char* g_PropertyDoubleBuffering = "DoubleBuffering";
+const char* g_PropertyRampMode = "RampMode";
+const char* g_PropertyRampSlewRate = "RampSlewRate";
+const char* g_PropertyRampDuration = "RampDuration";
+const char* g_RampOff = "Off";
+const char* g_RampSlewRate = "SlewRate";
+const char* g_RampDuration = "Duration";
+const char* g_PropertyFrequency = "Frequency";
+const char* g_PropertyDutyCycle = "DutyCycle";
+const char* g_PropertyPulseCount = "PulseCount";
+const char* g_PropertyStartTrigger = "StartTrigger";
+const char* g_PropertyRunning = "Running";
+const char* g_StartImmediately = "None";
+const char* g_WaveformNone = "None";
+const char* g_WaveformRamp = "Ramp";
+const char* g_WaveformSawtooth = "Sawtooth";
+const char* g_WaveformSine = "Sine";
+const char* g_WaveformTriangle = "Triangle";
+const char* g_WaveformPiecewiseLinear = "PiecewiseLinear";
+const char* g_ClockTriggerInput = "TriggerInput";
+const char* g_ClockInternal = "Internal";
+// Largest waveform generated on the adapter.
+const long g_MaxWaveformSamples = 10000000;
+
+const char* g_PropertyContinuous = "ContinuousAcquisition";
+const char* g_PropertyAveraging = "Averaging";
+const char* g_PropertyAveragingWindow = "AveragingWindow";
+const char* g_PropertyTrace = "Trace";
+const char* g_PropertyTraceLength = "TraceLength";
+const char* g_PropertyTraceDecimation = "TraceDecimation";
+const char* g_AveragingNone = "None";
+const char* g_AveragingBoxcar = "Boxcar";
+const char* g_AveragingExponential = "Exponential";
+const char* g_PropertyTriggeredAcquisition = "TriggeredAcquisition";
+const char* g_PropertyTriggeredFrames = "TriggeredFrames";
+const char* g_PropertySamplesPerFrame = "SamplesPerFrame";
+const char* g_PropertyFramesAcquired = "FramesAcquired";
+const char* g_PropertyFrameValues = "FrameValues";
+const char* g_TriggeredIdle = "Idle";
+const char* g_TriggeredArmed = "Armed";
+
+// Number of samples kept by AnalogI during continuous acquisition.
+const unsigned long g_RingSize = 1 << 16;
+// Time (s) covered by each read of the acquisition thread.
+const double g_BlockDuration = 0.05;
+// Largest triggered acquisition of AnalogI, in frames.
+const long g_MaxTriggeredFrames = 1000000;
+// Largest block of samples per trigger.
+const long g_MaxSamplesPerFrame = 10000;
+// Period (ms) at which the frames of a triggered acquisition are read.
+const int g_FramePollPeriod = 10;
+
+const char* g_PropertyLineStates = "LineStates";
+const char* g_PropertyChangeDetection = "ChangeDetection";
+const char* g_PropertyEdges = "Edges";
+const char* g_PropertyTimestampCounter = "TimestampCounter";
+const char* g_PropertyNotifyChanges = "NotifyChanges";
+const char* g_PropertyEdgeCount = "EdgeCount";
+const char* g_PropertyLastEdge = "LastEdge";
+const char* g_PropertyChanges = "Changes";
+const char* g_PropertyEdgeRate = "EdgeRate";
+const char* g_PropertyRecentEdges = "RecentEdges";
+const char* g_EdgesRising = "Rising";
+const char* g_EdgesFalling = "Falling";
+const char* g_EdgesBoth = "Both";
+const char* g_TimestampHostClock = "None";
+
+// Number of changes kept by DigitalI during change detection.
+const unsigned long g_EdgeRingSize = 1 << 16;
+// Largest number of changes taken by each read of the detection thread.
+const uInt32 g_EdgeBlockSize = 4096;
+// Interval (ms) between the reads of the detection thread.
+const long g_DetectionPollPeriod = 10;
+// Changes averaged by the edge rate, and shown by the recent edges.
+const unsigned long g_RateEdges = 100;
+const unsigned long g_RecentEdges = 16;
+// One bit of the line states per line.
+const uInt32 g_MaxDigitalInputLines = 32;
+// Rate (Hz) of the timebase counted by the timestamp counter, and
+// upper bound of the change rate given to its sample clock.
+const double g_TimestampTimebaseRate = 20e6;
+const double g_MaxChangeRate = 1e6;
+
 const char* g_UseCustom = "Use Custom";
 const char* g_Yes = "Yes";
 const char* g_No = "No";
@@ -56,7 +162,10 @@ unsigned int g_shutterState = 0;
 
 using namespace std;
 
-const char* g_logpath = "Log_AnalogI.txt";
+const char* g_PropertyDebugLog = "DebugLog";
+const char* g_PropertyDumpDebugLog = "DumpDebugLog";
+// Number of events kept by the AnalogI debug log.
+const unsigned long g_DebugLogSize = 256;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -67,6 +176,10 @@ MODULE_API void InitializeModuleData()
    RegisterDevice(g_DeviceNameDigitalO, MM::StateDevice, "NI digital Output");
    RegisterDevice(g_DeviceNameAnalogO, MM::SignalIODevice, "NI analog Output");
    RegisterDevice(g_DeviceNameAnalogI, MM::SignalIODevice, "NI analog Input");
+   RegisterDevice(g_DeviceNameMultiAnalogO, MM::GenericDevice, "NI multi-channel analog Output");
+   RegisterDevice(g_DeviceNameCounterO, MM::GenericDevice, "NI counter pulse-train Output");
+   RegisterDevice(g_DeviceNameHub, MM::HubDevice, "NI cards with shared output tasks");
+   RegisterDevice(g_DeviceNameDigitalI, MM::GenericDevice, "NI digital Input with change detection");
 }
 
 MODULE_API MM::Device* CreateDevice(const char* deviceName)
@@ -86,6 +199,22 @@ MODULE_API MM::Device* CreateDevice(const char* deviceName)
    {
       return new AnalogI;
    }
+   else if (strcmp(deviceName, g_DeviceNameMultiAnalogO) == 0)
+   {
+      return new MultiAnalogO;
+   }
+   else if (strcmp(deviceName, g_DeviceNameCounterO) == 0)
+   {
+      return new CounterO;
+   }
+   else if (strcmp(deviceName, g_DeviceNameHub) == 0)
+   {
+      return new NIHub;
+   }
+   else if (strcmp(deviceName, g_DeviceNameDigitalI) == 0)
+   {
+      return new DigitalI;
+   }
    return 0;
 }
 
@@ -99,10 +228,62 @@ MODULE_API void DeleteDevice(MM::Device* pDevice)
 // DAQDevice functions
 ///////////////////////////////////////////////////////////////////////////////
 
+// Process-wide cache of the device discovery, shared by all the devices
+// of the adapter: each query runs once per card.
+static std::map<std::string, std::string> g_DiscoveryCache;
+static MMThreadLock g_DiscoveryLock;
+
+typedef int32 (*DeviceQuery)(const char device[], char* data, uInt32 bufferSize);
+
+static int32 GetSysDevNames(const char* /*device*/, char* data, uInt32 bufferSize)
+{
+   return DAQmxGetSysDevNames(data, bufferSize);
+}
+
+// Run a DAQmx string query through the cache. The buffer is sized by
+// a first call without buffer, which returns the size needed.
+static int32 QueryDevice(DeviceQuery query, const char* name,
+   const std::string& device, std::string& result)
+{
+   MMThreadGuard guard(g_DiscoveryLock);
+   std::string key = std::string(name) + ":" + device;
+   std::map<std::string, std::string>::iterator it = g_DiscoveryCache.find(key);
+   if (it != g_DiscoveryCache.end())
+   {
+      result = it->second;
+      return 0;
+   }
+   result.clear();
+   int32 size = query(device.c_str(), NULL, 0);
+   if (size < 0)
+   {
+      return size;
+   }
+   if (size > 0)
+   {
+      std::vector<char> buffer(size);
+      int32 error = query(device.c_str(), &buffer[0], (uInt32) size);
+      if (error)
+      {
+         return error;
+      }
+      result = &buffer[0];
+   }
+   // Empty answers are queried again, e.g. for cards plugged in later
+   if (!result.empty())
+   {
+      g_DiscoveryCache[key] = result;
+   }
+   return 0;
+}
+
+
 DAQDevice::DAQDevice(): task_(NULL), channel_("undef"),
     isTriggeringEnabled_(true), samplesPerSec_(100000),
     supportsTriggering_(true), maxSequenceLength_(1000),
-    amPreparedToTrigger_(false)
+    amPreparedToTrigger_(false), onDemandReady_(false), streaming_(false),
+    streamBufferSize_(100000), streamLength_(0), streamPos_(0), streamThread_(0),
+    calls_(0), sequenceLoadTime_(0.0), shared_(0), sharedIndex_(0)
 {
 }
 
@@ -117,10 +298,9 @@ void DAQDevice::SetContext(MM::Core* core, MM::Device* device)
 std::vector<std::string> DAQDevice::GetDevices()
 {
    std::vector<std::string> result;
-   char devNames[4096];
-   DAQmxGetSysDevNames(devNames, 4096);
    // Names are comma-separated.
-   std::string allNames = devNames;
+   std::string allNames;
+   QueryDevice(&GetSysDevNames, "SysDevNames", "", allNames);
    size_t index = allNames.find(", ");
    if (index == std::string::npos)
    {
@@ -143,11 +323,10 @@ std::vector<std::string> DAQDevice::GetDevices()
 // Provide a list of all digital output ports on the device.
 std::vector<std::string> DAQDevice::GetDigitalOPortsForDevice(std::string device)
 {
-   char ports[4096];
    // Provides a comma-separated list of individual lines,
    // e.g. "Dev1/port0/line0, Dev1/port0/line1"
-   DAQmxGetDevDOLines(device.c_str(), ports, 4096);
-   std::string allPorts = ports;
+   std::string allPorts;
+   QueryDevice(&DAQmxGetDevDOLines, "DevDOLines", device, allPorts);
    size_t index = std::string::npos;
    std::vector<std::string> result;
    do
@@ -160,11 +339,10 @@ std::vector<std::string> DAQDevice::GetDigitalOPortsForDevice(std::string device
 // Provide a list of all analog output ports on the device.
 std::vector<std::string> DAQDevice::GetAnalogOPortsForDevice(std::string device)
 {
-   char ports[4096];
    // Provides a comma-separated list of analog channels,
    // e.g. "Dev1/ao0, Dev1/ao1"
-   DAQmxGetDevAOPhysicalChans(device.c_str(), ports, 4096);
-   std::string allPorts = ports;
+   std::string allPorts;
+   QueryDevice(&DAQmxGetDevAOPhysicalChans, "DevAOPhysicalChans", device, allPorts);
    size_t index = std::string::npos;
    std::vector<std::string> result;
    do
@@ -177,11 +355,42 @@ std::vector<std::string> DAQDevice::GetAnalogOPortsForDevice(std::string device)
 // Provide a list of all analog input ports on the device.
 std::vector<std::string> DAQDevice::GetAnalogIPortsForDevice(std::string device)
 {
-   char ports[4096];
    // Provides a comma-separated list of analog channels,
    // e.g. "Dev1/ao0, Dev1/ao1"
-   DAQmxGetDevAIPhysicalChans(device.c_str(), ports, 4096);
-   std::string allPorts = ports;
+   std::string allPorts;
+   QueryDevice(&DAQmxGetDevAIPhysicalChans, "DevAIPhysicalChans", device, allPorts);
+   size_t index = std::string::npos;
+   std::vector<std::string> result;
+   do
+   {
+      result.push_back(GetNextEntry(allPorts, index));
+   } while (index != std::string::npos);
+   return result;
+}
+
+// Provide a list of all digital input ports on the device.
+std::vector<std::string> DAQDevice::GetDigitalIPortsForDevice(std::string device)
+{
+   // Provides a comma-separated list of individual lines,
+   // e.g. "Dev1/port0/line0, Dev1/port0/line1"
+   std::string allPorts;
+   QueryDevice(&DAQmxGetDevDILines, "DevDILines", device, allPorts);
+   size_t index = std::string::npos;
+   std::vector<std::string> result;
+   do
+   {
+      result.push_back(GetPort(GetNextEntry(allPorts, index)));
+   } while (index != std::string::npos);
+   return result;
+}
+
+// Provide a list of all counter outputs on the device.
+std::vector<std::string> DAQDevice::GetCounterOPortsForDevice(std::string device)
+{
+   // Provides a comma-separated list of counters,
+   // e.g. "Dev1/ctr0, Dev1/ctr1"
+   std::string allPorts;
+   QueryDevice(&DAQmxGetDevCOPhysicalChans, "DevCOPhysicalChans", device, allPorts);
    size_t index = std::string::npos;
    std::vector<std::string> result;
    do
@@ -279,6 +488,36 @@ int DAQDevice::OnSequenceLength(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
+int DAQDevice::OnStreaming(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(streaming_ ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string val;
+      pProp->Get(val);
+      streaming_ = (val.compare(g_Yes) == 0);
+   }
+
+   return DEVICE_OK;
+}
+
+int DAQDevice::OnStreamBufferSize(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(streamBufferSize_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(streamBufferSize_);
+   }
+
+   return DEVICE_OK;
+}
+
 int DAQDevice::OnSampleRate(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::BeforeGet)
@@ -288,18 +527,22 @@ int DAQDevice::OnSampleRate(MM::PropertyBase* pProp, MM::ActionType eAct)
     else if (eAct == MM::AfterSet)
     {
         pProp->Get(samplesPerSec_);
+        // The clock of a loaded sequence is outdated
+        amPreparedToTrigger_ = false;
     }
 
     return DEVICE_OK;
 }
 
-int DAQDevice::SetupClockInput(int numVals)
+// Clock the task with the input trigger. Continuous tasks use numVals
+// as their buffer size, finite tasks stop after numVals samples.
+int DAQDevice::SetupClockInput(int numVals, int32 sampleMode)
 {
    // Samples per sec is the "maximum expected rate of the clock",
    // where clock is the input trigger signal
    int error = DAQmxCfgSampClkTiming(task_, inputTrigger_.c_str(),
       samplesPerSec_,
-      DAQmx_Val_Rising, DAQmx_Val_ContSamps, numVals);
+      DAQmx_Val_Rising, sampleMode, numVals);
    if (error)
    {
        return LogError(error, "CfgSampClkTiming");
@@ -308,6 +551,181 @@ int DAQDevice::SetupClockInput(int numVals)
 }
 
 
+int DAQDevice::OnStatistics(MM::PropertyBase* pProp, MM::ActionType eAct, long statistic)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      if (statistic == 0)
+      {
+         pProp->Set((long) calls_);
+      }
+      else if (statistic == 1)
+      {
+         pProp->Set(GetLatencyPercentile(0.5));
+      }
+      else if (statistic == 2)
+      {
+         pProp->Set(GetLatencyPercentile(0.99));
+      }
+      else
+      {
+         pProp->Set(sequenceLoadTime_);
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int DAQDevice::OnResetStatistics(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set("Idle");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string val;
+      pProp->Get(val);
+      if (val.compare("Reset") == 0)
+      {
+         latencies_.clear();
+         calls_ = 0;
+         sequenceLoadTime_ = 0.0;
+         pProp->Set("Idle");
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+// Record the duration of an on-demand write or read started at start.
+void DAQDevice::RecordCall(std::chrono::steady_clock::time_point start)
+{
+   double latency = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+   // Keep the latencies of the last g_MaxLatencySamples calls
+   if (latencies_.size() < g_MaxLatencySamples)
+   {
+      latencies_.push_back(latency);
+   }
+   else
+   {
+      latencies_[calls_ % g_MaxLatencySamples] = latency;
+   }
+   calls_++;
+}
+
+// Record the duration of a sequence load started at start.
+void DAQDevice::RecordSequenceLoad(std::chrono::steady_clock::time_point start)
+{
+   sequenceLoadTime_ = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+double DAQDevice::GetLatencyPercentile(double percentile)
+{
+   if (latencies_.empty())
+   {
+      return 0.0;
+   }
+   std::vector<double> sorted(latencies_);
+   std::vector<double>::iterator it = sorted.begin() + (size_t) (percentile * (sorted.size() - 1));
+   std::nth_element(sorted.begin(), it, sorted.end());
+   return *it;
+}
+
+// Longest sequence that can be loaded.
+long DAQDevice::GetMaxSequenceLength() const
+{
+   return streaming_ ? g_MaxStreamedSequenceLength : maxSequenceLength_;
+}
+
+// Set up task_ to stream a sequence of numVals samples: the output
+// buffer is not regenerated, it is filled here before the task starts
+// and then kept filled by the stream thread, looping over the sequence.
+int DAQDevice::PrepareStream(long numVals)
+{
+   streamLength_ = numVals;
+   streamPos_ = 0;
+   if (numVals == 0)
+   {
+      return DEVICE_OK;
+   }
+   int error = DAQmxSetWriteRegenMode(task_, DAQmx_Val_DoNotAllowRegen);
+   if (error)
+   {
+      return LogError(error, "SetWriteRegenMode");
+   }
+   error = DAQmxCfgOutputBuffer(task_, (uInt32) streamBufferSize_);
+   if (error)
+   {
+      return LogError(error, "CfgOutputBuffer");
+   }
+   return WriteStream(streamBufferSize_);
+}
+
+// Start the stream thread once the task is running.
+int DAQDevice::StartStream()
+{
+   if (!streaming_ || streamLength_ == 0 || streamThread_ != 0)
+   {
+      return DEVICE_OK;
+   }
+   streamThread_ = new DAQStreamThread(*this);
+   streamThread_->Start();
+   return DEVICE_OK;
+}
+
+void DAQDevice::StopStream()
+{
+   if (streamThread_ != 0)
+   {
+      delete streamThread_;
+      streamThread_ = 0;
+   }
+}
+
+// Write the next numVals samples of the streamed sequence, wrapping
+// around at its end.
+int DAQDevice::WriteStream(long numVals)
+{
+   while (numVals > 0)
+   {
+      long count = std::min(numVals, streamLength_ - streamPos_);
+      int error = WriteSamples(streamPos_, count);
+      if (error)
+      {
+         return error;
+      }
+      streamPos_ = (streamPos_ + count) % streamLength_;
+      numVals -= count;
+   }
+   return DEVICE_OK;
+}
+
+// Refill the output buffer once a quarter of it has been generated.
+int DAQDevice::StreamSamples()
+{
+   uInt32 space = 0;
+   int error = DAQmxGetWriteSpaceAvail(task_, &space);
+   if (error)
+   {
+      return LogError(error, "GetWriteSpaceAvail");
+   }
+   if (space < (uInt32) streamBufferSize_ / 4)
+   {
+      return DEVICE_OK;
+   }
+   return WriteStream((long) space);
+}
+
+// Write numVals samples of the sequence, starting at offset, to the
+// output buffer. Only the devices supporting streaming implement it.
+int DAQDevice::WriteSamples(long /*offset*/, long /*numVals*/)
+{
+   return DEVICE_UNSUPPORTED_COMMAND;
+}
+
 // Cancel a running task.
 void DAQDevice::CancelTask()
 {
@@ -315,8 +733,11 @@ void DAQDevice::CancelTask()
    {
       core_->LogMessage(device_, ("Cancelling task for " + channel_).c_str(), false);
    }
+   // The stream thread must not write to the task anymore.
+   StopStream();
    // Automatically ends any triggering task.
    amPreparedToTrigger_ = false;
+   onDemandReady_ = false;
    // Note we explicitly do not check for or log errors here
    // as we may try to redundantly stop tasks and/or try to
    // stop tasks that do not exist yet.
@@ -344,6 +765,40 @@ int DAQDevice::SetupTask()
    return DEVICE_OK;
 }
 
+// Provide a committed, running task for software-timed writes and reads.
+// Creating a task is by far the slowest DAQmx operation, so the task is
+// kept and only rebuilt after task_ was used for something else
+// (triggered sequences, tests) or after an error.
+int DAQDevice::GetOnDemandTask()
+{
+   if (onDemandReady_)
+   {
+      return DEVICE_OK;
+   }
+   int error = SetupTask();
+   if (error)
+   {
+      return error;
+   }
+   error = CreateOnDemandChannel();
+   if (error)
+   {
+      return error;
+   }
+   error = DAQmxTaskControl(task_, DAQmx_Val_Task_Commit);
+   if (error)
+   {
+      return LogError(error, "TaskControl");
+   }
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      return LogError(error, "StartTask");
+   }
+   onDemandReady_ = true;
+   return DEVICE_OK;
+}
+
 // Log a message pertaining to the associated error.
 // Return the passed-in error code.
 int DAQDevice::LogError(int error, const char* func)
@@ -403,412 +858,4486 @@ std::string DAQDevice::GetNextEntry(std::string line, size_t& startIndex)
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// DigitalO implementation
-// ~~~~~~~~~~~~~~~~~~~~~~~~
+// NIHub implementation
+// ~~~~~~~~~~~~~~~~~~~~
 
-DigitalO::DigitalO() : numPos_(16), busy_(false), open_(false), state_(0)
+NIHub::NIHub() : initialized_(false)
 {
-   task_ = 0;
    InitializeDefaultErrorMessages();
-
-   // add custom error messages
-   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
-   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
-   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
-   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
-
-   // Output channel, which may be one or more lines or an entire port.
-   CPropertyAction* pAct = new CPropertyAction (this, &DigitalO::OnChannel);
-   int nRet = CreateStringProperty(g_PropertyChannel, "devname", false, pAct, true);
-   assert(DEVICE_OK == nRet);
-
-   // Output port -- a more convenient version of the above for users that
-   // don't need to specify individual lines.
-   pAct = new CPropertyAction(this, &DigitalO::OnPort);
-   nRet = CreateStringProperty(g_PropertyPort, "devname", false, pAct, true);
-   std::vector<std::string> devices = GetDevices();
-   if (devices.size() == 0)
-   {
-      AddAllowedValue(g_PropertyPort, "No valid devices found");
-   }
-   else
-   {
-      AddAllowedValue(g_PropertyPort, g_UseCustom);
-      SetProperty(g_PropertyPort, g_UseCustom);
-   }
-   for (std::vector<string>::iterator i = devices.begin(); i != devices.end(); ++i) {
-      std::vector<string> ports = GetDigitalOPortsForDevice(*i);
-      for (std::vector<string>::iterator j = ports.begin(); j != ports.end(); ++j) {
-         AddAllowedValue(g_PropertyPort, (*j).c_str());
-      }
-   }
-
-   pAct = new CPropertyAction(this, &DAQDevice::OnSequenceLength);
-   nRet = CreateStringProperty(g_PropertySequenceLength,
-      boost::lexical_cast<std::string>(maxSequenceLength_).c_str(), false, pAct, true);
-
-   assert(nRet == DEVICE_OK);
 }
 
-DigitalO::~DigitalO()
+NIHub::~NIHub()
 {
    Shutdown();
+   for (std::map<std::string, NISharedTask*>::iterator i = tasks_.begin();
+      i != tasks_.end(); ++i)
+   {
+      // Lines still loaded fall back to tasks of their own
+      i->second->DetachLines();
+      delete i->second;
+   }
 }
 
-void DigitalO::GetName(char* name) const
+void NIHub::GetName(char* name) const
 {
-   CDeviceUtils::CopyLimitedString(name, g_DeviceNameDigitalO);
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameHub);
 }
 
-
-int DigitalO::Initialize()
+int NIHub::Initialize()
 {
-   SetContext(GetCoreCallback(), this);
-   SetDeviceName();
-   // set property list
-   // -----------------
-   
    // Name
-   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameDigitalO, MM::String, true);
+   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameHub, MM::String, true);
    if (DEVICE_OK != nRet)
-   {
       return nRet;
-   }
 
    // Description
-   nRet = CreateProperty(MM::g_Keyword_Description, "Digital IO adapter", MM::String, true);
+   nRet = CreateProperty(MM::g_Keyword_Description, "NI cards with shared tasks", MM::String, true);
    if (DEVICE_OK != nRet)
-   {
       return nRet;
-   }
 
-   // Channel. Note this has a different name from g_PropertyChannel,
-   // which is the pre-init property; this version is just so you can
-   // see the pre-init property in the Device Property Browser.
-   nRet = CreateProperty("OutputChannel", channel_.c_str(), MM::String, true);
-   if (DEVICE_OK != nRet)
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int NIHub::Shutdown()
+{
+   // The lines keep their last values
+   for (std::map<std::string, NISharedTask*>::iterator i = tasks_.begin();
+      i != tasks_.end(); ++i)
    {
-      return nRet;
+      i->second->Cancel();
    }
+   initialized_ = false;
+   return DEVICE_OK;
+}
 
-   // TODO: this and the following two properties are copy/pasted in the
-   // DigitalO and AnalogO classes.
-   // Manual triggering override.
-   CPropertyAction* pAct = new CPropertyAction(this, &DAQDevice::OnTriggeringEnabled);
-   nRet = CreateIntegerProperty(g_PropertyTriggeringEnabled, 0, false, pAct, false);
-   if (DEVICE_OK != nRet)
+int NIHub::DetectInstalledDevices()
+{
+   std::vector<std::string> peripherals;
+   peripherals.push_back(g_DeviceNameDigitalO);
+   peripherals.push_back(g_DeviceNameAnalogO);
+   for (size_t i = 0; i < peripherals.size(); i++)
    {
-      return nRet;
+      MM::Device* pDev = ::CreateDevice(peripherals[i].c_str());
+      if (pDev)
+      {
+         AddInstalledDevice(pDev);
+      }
    }
+   return DEVICE_OK;
+}
 
-   // Input trigger sample rate.
-   pAct = new CPropertyAction(this, &DAQDevice::OnSampleRate);
-   nRet = CreateIntegerProperty(g_PropertySampleRate, samplesPerSec_, false,
-         pAct, false);
-   if (DEVICE_OK != nRet)
+// Provide the shared output task of a card, created on first use.
+NISharedTask* NIHub::GetSharedTask(const std::string& card, bool digital)
+{
+   std::string key = card + (digital ? "/do" : "/ao");
+   std::map<std::string, NISharedTask*>::iterator i = tasks_.find(key);
+   if (i != tasks_.end())
    {
-      return nRet;
+      return i->second;
    }
+   NISharedTask* task = new NISharedTask(digital);
+   tasks_[key] = task;
+   return task;
+}
 
-   // Input trigger line.
-   pAct = new CPropertyAction(this, &DAQDevice::OnInputTrigger);
-   nRet = CreateProperty(g_PropertyTriggerInput,
-      "", MM::String, false, pAct, false);
-   if (DEVICE_OK != nRet)
+
+///////////////////////////////////////////////////////////////////////////////
+// NISharedTask implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+NISharedTask::NISharedTask(bool digital) : digital_(digital), task_(0),
+   onDemandReady_(false), sequenceRunning_(false)
+{
+}
+
+NISharedTask::~NISharedTask()
+{
+   ClearTask();
+}
+
+// Add the channel of a line with its initial value, or find it if the
+// line was already added. The task is rebuilt with the new channel on
+// the next write.
+size_t NISharedTask::AddChannel(DAQDevice& line, const std::string& channel, double minV, double maxV,
+   float64 value)
+{
+   MMThreadGuard guard(lock_);
+   for (size_t i = 0; i < channels_.size(); ++i)
    {
-      return nRet;
+      if (channels_[i] == channel)
+      {
+         lines_[i] = &line;
+         minV_[i] = minV;
+         maxV_[i] = maxV;
+         return i;
+      }
    }
-   char terminalsBuf[4096];
-   int error = DAQmxGetDevTerminals(deviceName_.c_str(), terminalsBuf, 4096);
-   if (error)
+   ClearTask();
+   sequenceRunning_ = false;
+   channels_.push_back(channel);
+   lines_.push_back(&line);
+   minV_.push_back(minV);
+   maxV_.push_back(maxV);
+   values_.push_back(value);
+   sequences_.push_back(std::vector<float64>());
+   return channels_.size() - 1;
+}
+
+// Forget a line that is shut down. Its channel stays in the task and
+// keeps its last value.
+void NISharedTask::RemoveLine(DAQDevice& line)
+{
+   MMThreadGuard guard(lock_);
+   for (size_t i = 0; i < lines_.size(); ++i)
    {
-      return LogError(error, "GetDevTerminals");
+      if (lines_[i] == &line)
+      {
+         lines_[i] = 0;
+      }
    }
-   std::string terminals = terminalsBuf;
-   size_t index = std::string::npos;
-   do
+}
+
+// Release the lines still using the task before it is deleted.
+void NISharedTask::DetachLines()
+{
+   MMThreadGuard guard(lock_);
+   for (size_t i = 0; i < lines_.size(); ++i)
    {
-      std::string terminal = GetNextEntry(terminals, index);
-      AddAllowedValue(g_PropertyTriggerInput, terminal.c_str());
-      if (GetNumberOfPropertyValues(g_PropertyTriggerInput) == 1)
+      if (lines_[i] != 0)
       {
-         // Make this the default.
-         SetProperty(g_PropertyTriggerInput, terminal.c_str());
+         lines_[i]->shared_ = 0;
+         lines_[i] = 0;
       }
-   } while (index != std::string::npos);
-
-   SetupTask();
+   }
+}
 
-   // Determine the number of "positions".
-   // Create a temporary DO channel just to determine the number of lines.
-   int32 niRet = DAQmxCreateDOChan(task_, channel_.c_str(), "tempchan", DAQmx_Val_ChanForAllLines);
-   if (niRet != DAQmxSuccess)
+// Write a new value to one line; the other lines are written again with
+// their last values.
+int NISharedTask::Write(DAQDevice& line, size_t index, float64 value)
+{
+   MMThreadGuard guard(lock_);
+   values_[index] = value;
+   if (sequenceRunning_)
    {
-      return LogError(niRet, "CreateDOChan");
+      // The task is clocked by the sequence
+      return DEVICE_OK;
    }
-   uInt32 numLines = 0;
-   error = DAQmxGetDONumLines(task_, "tempchan", &numLines);
-   if (error)
+   return WriteOnDemand(line);
+}
+
+// Start the sequences of all lines on the sample clock of the line
+// starting them, which the other lines must match. Lines without a
+// sequence hold their last value.
+int NISharedTask::StartSequence(DAQDevice& line)
+{
+   MMThreadGuard guard(lock_);
+   if (sequenceRunning_)
    {
-	  return LogError(error, "GetDONumLines");
+      // Already started by another line
+      return DEVICE_OK;
    }
-   if (numLines > 0)
+   for (size_t i = 0; i < lines_.size(); ++i)
    {
-	  numPos_ = 1 << numLines;
+      if (lines_[i] != 0 &&
+         (lines_[i]->inputTrigger_ != line.inputTrigger_ ||
+          lines_[i]->samplesPerSec_ != line.samplesPerSec_))
+      {
+         return ERR_CLOCK_MISMATCH;
+      }
    }
-   else
+   size_t length = 0;
+   for (size_t i = 0; i < sequences_.size(); ++i)
    {
-	  numPos_ = 0; // Shouldn't happen
+      if (sequences_[i].size() == 0)
+      {
+         continue;
+      }
+      if (length != 0 && sequences_[i].size() != length)
+      {
+         return ERR_SEQUENCE_MISMATCH;
+      }
+      length = sequences_[i].size();
    }
-   // Reset the task to remove the temporary channel
-   SetupTask();
-
-   // create positions and labels
-   const int bufSize = 1024;
-   char buf[bufSize];
-   for (long i=0; i<numPos_; i++)
+   if (length == 0)
    {
-      snprintf(buf, bufSize, "%d", (unsigned)i);
-      SetPositionLabel(i, buf);
+      return DEVICE_OK;
    }
 
-   // State
-   pAct = new CPropertyAction (this, &DigitalO::OnState);
-   nRet = CreateProperty(MM::g_Keyword_State, "0", MM::Integer, false, pAct);
-   if (nRet != DEVICE_OK)
+   int error = CreateTask(line);
+   if (error)
    {
-      return nRet;
+      return error;
    }
-
-   // Label
-   pAct = new CPropertyAction(this, &DigitalO::OnLabel);
-   nRet = CreateProperty(MM::g_Keyword_Label, "0", MM::String, false, pAct);
-   if (nRet != DEVICE_OK)
+   error = DAQmxCfgSampClkTiming(task_, line.inputTrigger_.c_str(),
+      line.samplesPerSec_, DAQmx_Val_Rising, DAQmx_Val_ContSamps, length);
+   if (error)
    {
-	   return nRet;
+      ClearTask();
+      return line.LogError(error, "CfgSampClkTiming");
    }
-
-   // Gate Closed Position
-   nRet = CreateProperty(MM::g_Keyword_Closed_Position, "0", MM::Integer, false);
-   if (nRet != DEVICE_OK)
+   std::vector<float64> samples(length * channels_.size());
+   for (size_t k = 0; k < length; ++k)
    {
-      return nRet;
+      for (size_t i = 0; i < channels_.size(); ++i)
+      {
+         samples[k * channels_.size() + i] =
+            sequences_[i].size() == 0 ? values_[i] : sequences_[i][k];
+      }
    }
-
-   GetGateOpen(open_);
-
-   // Whether or not hardware triggering is available. Determined by
-   // attempting to set up a triggering task and erroring if it
-   // fails.
-   supportsTriggering_ = (TestTriggering() == 0);
-   pAct = new CPropertyAction(this, &DAQDevice::OnSupportsTriggering);
-   nRet = CreateIntegerProperty(g_PropertyCanTrigger,
-      supportsTriggering_, true, pAct);
-   if (DEVICE_OK != nRet)
+   error = WriteValues(line, (long) length, samples);
+   if (error)
    {
-      return nRet;
+      ClearTask();
+      return error;
    }
-
-   nRet = UpdateStatus();
-   if (nRet != DEVICE_OK)
+   error = DAQmxStartTask(task_);
+   if (error)
    {
-      return nRet;
+      ClearTask();
+      return line.LogError(error, "StartTask");
    }
-
-   initialized_ = true;
+   sequenceRunning_ = true;
    return DEVICE_OK;
 }
 
-int DigitalO::Shutdown()
+// Stop the sequences of all lines and restore their last values.
+int NISharedTask::StopSequence(DAQDevice& line)
 {
-   CancelTask();
-   
-   initialized_ = false;
-   return DEVICE_OK;
+   MMThreadGuard guard(lock_);
+   if (!sequenceRunning_)
+   {
+      return DEVICE_OK;
+   }
+   ClearTask();
+   sequenceRunning_ = false;
+   for (size_t i = 0; i < sequences_.size(); ++i)
+   {
+      sequences_[i].clear();
+   }
+   return WriteOnDemand(line);
 }
 
-
-///////////////////////////////////////////////////////////////////////////////
-// Action handlers
-///////////////////////////////////////////////////////////////////////////////
-
-int DigitalO::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
+// Attempt to set up a triggering task on all lines, loading their last
+// values so that the outputs do not change.
+int NISharedTask::TestTriggering(DAQDevice& line)
 {
-   if (eAct == MM::BeforeGet)
+   MMThreadGuard guard(lock_);
+   if (sequenceRunning_)
    {
-      pProp->Set((long)state_);
+      return DEVICE_OK;
    }
-   else if (eAct == MM::AfterSet)
+   const long numVals = 100;
+   int error = CreateTask(line);
+   if (error)
    {
-      bool gateOpen;
-      GetGateOpen(gateOpen);
-
-      long state;
-      pProp->Get(state);
-
-      if ((state == state_) && (open_ == gateOpen))
-         return DEVICE_OK;
-
-     // Set up a task for reading/writing digital values
-      long niRet = SetupTask();
-      if (niRet != DAQmxSuccess)
-      {
-         return niRet;
-      }
-
-      niRet = SetupTask();
-      if (niRet != DAQmxSuccess)
-      {
-          return niRet;
-      }
-      niRet = DAQmxCreateDOChan(task_, channel_.c_str(), "", DAQmx_Val_ChanForAllLines);
-      if (niRet != DAQmxSuccess)
+      return error;
+   }
+   error = DAQmxCfgSampClkTiming(task_, line.inputTrigger_.c_str(),
+      line.samplesPerSec_, DAQmx_Val_Rising, DAQmx_Val_ContSamps, numVals);
+   if (error)
+   {
+      error = line.LogError(error, "CfgSampClkTiming");
+   }
+   else
+   {
+      std::vector<float64> samples;
+      for (long k = 0; k < numVals; ++k)
       {
-         return LogError(niRet, "CreateDOChan");
-      }
-      niRet = DAQmxStartTask(task_);
-
-      if (gateOpen) {
-         uInt32 data;
-         int32 written;
-         data = state;
-         niRet = DAQmxWriteDigitalU32(task_, 1, 1, 10.0, DAQmx_Val_GroupByChannel, &data, &written, NULL);
-         if (niRet != DAQmxSuccess)
-         {
-            return LogError(niRet, "WriteDigitalU32");
-         }
+         samples.insert(samples.end(), values_.begin(), values_.end());
       }
-      else {
-         long closed_state;
-         GetProperty(MM::g_Keyword_Closed_Position, closed_state);
+      error = WriteValues(line, numVals, samples);
+   }
+   ClearTask();
+   return error;
+}
 
-         uInt32 data;
-         int32 written;
-         data = closed_state;
-         niRet = DAQmxWriteDigitalU32(task_, 1, 1, 10.0, DAQmx_Val_GroupByChannel, &data, &written, NULL);
-         if (niRet != DAQmxSuccess)
-         {
-            return LogError(niRet, "WriteDigitalU32");
-         }
-      }
+void NISharedTask::Cancel()
+{
+   MMThreadGuard guard(lock_);
+   ClearTask();
+   sequenceRunning_ = false;
+}
 
-      state_ = (int)state;
-      open_ = gateOpen;
-      pProp->Set((long)state_);
+// Create the task with the channels of all lines.
+int NISharedTask::CreateTask(DAQDevice& line)
+{
+   ClearTask();
+   int error = DAQmxCreateTask("", &task_);
+   if (error)
+   {
+      task_ = 0;
+      return line.LogError(error, "CreateTask");
    }
-   else if (eAct == MM::IsSequenceable)
+   for (size_t i = 0; i < channels_.size(); ++i)
    {
-      // Only if we believe we can trigger, and the user
-      // hasn't disabled triggering.
-      if (supportsTriggering_ && isTriggeringEnabled_)
+      if (digital_)
       {
-         pProp->SetSequenceable(maxSequenceLength_);
+         error = DAQmxCreateDOChan(task_, channels_[i].c_str(), "",
+            DAQmx_Val_ChanForAllLines);
       }
       else
       {
-         pProp->SetSequenceable(0);
+         error = DAQmxCreateAOVoltageChan(task_, channels_[i].c_str(), "",
+            minV_[i], maxV_[i], DAQmx_Val_Volts, "");
       }
-   }
-   else if (eAct == MM::AfterLoadSequence)
-   {
-      if (amPreparedToTrigger_)
-      {
-         // We're already ready to go.
-         return DEVICE_OK;
-	  }
-      // Load the sequence into NI's buffer, but don't start
-      // the task.
-      std::vector<std::string> sequence = pProp->GetSequence();
-      if (sequence.size() > maxSequenceLength_)
+      if (error)
       {
-         return DEVICE_SEQUENCE_TOO_LARGE;
+         ClearTask();
+         return line.LogError(error, digital_ ? "CreateDOChan" : "CreateAOVoltageChan");
       }
-      uInt32* values = new uInt32[sequence.size()];
-      for (long i = 0; i < sequence.size(); ++i)
+   }
+   return DEVICE_OK;
+}
+
+// Write the last values of all lines, creating the on-demand task if
+// needed. As for DAQDevice::GetOnDemandTask, the committed task is kept
+// between writes.
+int NISharedTask::WriteOnDemand(DAQDevice& line)
+{
+   int error;
+   if (!onDemandReady_)
+   {
+      error = CreateTask(line);
+      if (error)
       {
-         values[i] = boost::lexical_cast<uInt32>(sequence[i]);
+         return error;
       }
-      int error = SetupDigitalTriggering(values, (long) sequence.size());
-      delete values;
+      error = DAQmxTaskControl(task_, DAQmx_Val_Task_Commit);
       if (error)
       {
-         return error;
+         ClearTask();
+         return line.LogError(error, "TaskControl");
       }
-	  amPreparedToTrigger_ = true;
-   }
-   else if (eAct == MM::StartSequence)
-   {
-      // Start the triggering task now.
-      int error = DAQmxStartTask(task_);
+      error = DAQmxStartTask(task_);
       if (error)
       {
-          return LogError(error, "StartTask");
+         ClearTask();
+         return line.LogError(error, "StartTask");
       }
+      onDemandReady_ = true;
    }
-   else if (eAct == MM::StopSequence)
+   error = WriteValues(line, 1, values_);
+   if (error)
    {
-      CancelTask();
+      // Rebuild the task on the next write
+      ClearTask();
    }
-
-   return DEVICE_OK;
+   return error;
 }
 
-// Set up a digital triggering task: create the output channel,
-// load the sequence onto NI's buffer, and set up the triggering
-// rules.
-int DigitalO::SetupDigitalTriggering(uInt32* sequence, long numVals)
+// Write samples interleaved by line, one value per channel and sample.
+int NISharedTask::WriteValues(DAQDevice& line, long numVals, const std::vector<float64>& values)
 {
-   SetupTask();
-   int error = DAQmxCreateDOChan(task_, channel_.c_str(), "",
-         DAQmx_Val_ChanForAllLines);
-   if (error)
+   int32 numWritten = 0;
+   int error;
+   if (digital_)
    {
-       return LogError(error, "CreateDOChan");
+      std::vector<uInt32> states(values.begin(), values.end());
+      error = DAQmxWriteDigitalU32(task_, numVals, false, 10.0,
+         DAQmx_Val_GroupByScanNumber, &states[0], &numWritten, NULL);
    }
-   error = SetupClockInput(numVals);
-   if (error)
+   else
    {
+      error = DAQmxWriteAnalogF64(task_, numVals, false, 10.0,
+         DAQmx_Val_GroupByScanNumber, &values[0], &numWritten, NULL);
+   }
+   if (error)
+   {
+      return line.LogError(error, digital_ ? "WriteDigitalU32" : "WriteAnalogF64");
+   }
+   if (numWritten != numVals)
+   {
+      return ERR_WRITE_FAILED;
+   }
+   return DEVICE_OK;
+}
+
+void NISharedTask::ClearTask()
+{
+   if (task_ != 0)
+   {
+      DAQmxStopTask(task_);
+      DAQmxClearTask(task_);
+   }
+   task_ = 0;
+   onDemandReady_ = false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// DigitalO implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~
+
+DigitalO::DigitalO() : numPos_(16), busy_(false), open_(false), state_(0)
+{
+   task_ = 0;
+   InitializeDefaultErrorMessages();
+
+   // add custom error messages
+   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
+   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
+   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
+   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
+   SetErrorText(ERR_SEQUENCE_MISMATCH, "The sequences of the lines of the hub have different lengths");
+   SetErrorText(ERR_CLOCK_MISMATCH, "The lines of the hub have different trigger inputs or sample rates");
+
+   // Output channel, which may be one or more lines or an entire port.
+   CPropertyAction* pAct = new CPropertyAction (this, &DigitalO::OnChannel);
+   int nRet = CreateStringProperty(g_PropertyChannel, "devname", false, pAct, true);
+   assert(DEVICE_OK == nRet);
+
+   // Output port -- a more convenient version of the above for users that
+   // don't need to specify individual lines.
+   pAct = new CPropertyAction(this, &DigitalO::OnPort);
+   nRet = CreateStringProperty(g_PropertyPort, "devname", false, pAct, true);
+   std::vector<std::string> devices = GetDevices();
+   if (devices.size() == 0)
+   {
+      AddAllowedValue(g_PropertyPort, "No valid devices found");
+   }
+   else
+   {
+      AddAllowedValue(g_PropertyPort, g_UseCustom);
+      SetProperty(g_PropertyPort, g_UseCustom);
+   }
+   for (std::vector<string>::iterator i = devices.begin(); i != devices.end(); ++i) {
+      std::vector<string> ports = GetDigitalOPortsForDevice(*i);
+      for (std::vector<string>::iterator j = ports.begin(); j != ports.end(); ++j) {
+         AddAllowedValue(g_PropertyPort, (*j).c_str());
+      }
+   }
+
+   pAct = new CPropertyAction(this, &DAQDevice::OnSequenceLength);
+   nRet = CreateStringProperty(g_PropertySequenceLength,
+      boost::lexical_cast<std::string>(maxSequenceLength_).c_str(), false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // Streamed sequences are not limited by the card buffer.
+   pAct = new CPropertyAction(this, &DAQDevice::OnStreaming);
+   nRet = CreateStringProperty(g_PropertyStreaming, g_No, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue(g_PropertyStreaming, g_No);
+   AddAllowedValue(g_PropertyStreaming, g_Yes);
+
+   pAct = new CPropertyAction(this, &DAQDevice::OnStreamBufferSize);
+   nRet = CreateIntegerProperty(g_PropertyStreamBufferSize, streamBufferSize_, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+}
+
+DigitalO::~DigitalO()
+{
+   Shutdown();
+}
+
+void DigitalO::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameDigitalO);
+}
+
+
+int DigitalO::Initialize()
+{
+   SetContext(GetCoreCallback(), this);
+   SetDeviceName();
+   // set property list
+   // -----------------
+   
+   // Name
+   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameDigitalO, MM::String, true);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Description
+   nRet = CreateProperty(MM::g_Keyword_Description, "Digital IO adapter", MM::String, true);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Channel. Note this has a different name from g_PropertyChannel,
+   // which is the pre-init property; this version is just so you can
+   // see the pre-init property in the Device Property Browser.
+   nRet = CreateProperty("OutputChannel", channel_.c_str(), MM::String, true);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // TODO: this and the following two properties are copy/pasted in the
+   // DigitalO and AnalogO classes.
+   // Manual triggering override.
+   CPropertyAction* pAct = new CPropertyAction(this, &DAQDevice::OnTriggeringEnabled);
+   nRet = CreateIntegerProperty(g_PropertyTriggeringEnabled, 0, false, pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Input trigger sample rate.
+   pAct = new CPropertyAction(this, &DAQDevice::OnSampleRate);
+   nRet = CreateIntegerProperty(g_PropertySampleRate, samplesPerSec_, false,
+         pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Input trigger line.
+   pAct = new CPropertyAction(this, &DAQDevice::OnInputTrigger);
+   nRet = CreateProperty(g_PropertyTriggerInput,
+      "", MM::String, false, pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+   std::string terminals;
+   int error = QueryDevice(&DAQmxGetDevTerminals, "DevTerminals", deviceName_, terminals);
+   if (error)
+   {
+      return LogError(error, "GetDevTerminals");
+   }
+   size_t index = std::string::npos;
+   do
+   {
+      std::string terminal = GetNextEntry(terminals, index);
+      AddAllowedValue(g_PropertyTriggerInput, terminal.c_str());
+      if (GetNumberOfPropertyValues(g_PropertyTriggerInput) == 1)
+      {
+         // Make this the default.
+         SetProperty(g_PropertyTriggerInput, terminal.c_str());
+      }
+   } while (index != std::string::npos);
+
+
+   // Lines of a card grouped under a hub share its output task.
+   NIHub* hub = static_cast<NIHub*>(GetParentHub());
+   if (hub)
+   {
+      char hubLabel[MM::MaxStrLength];
+      hub->GetLabel(hubLabel);
+      SetParentID(hubLabel);
+      CreateHubIDProperty();
+      shared_ = hub->GetSharedTask(deviceName_, true);
+      sharedIndex_ = shared_->AddChannel(*this, channel_, 0.0, 0.0, state_);
+   }
+
+   // Determine the number of "positions".
+   // Create a temporary task and DO channel just to determine the number
+   // of lines, so that no task of our own holds them next to the shared one.
+   TaskHandle tempTask = 0;
+   int32 niRet = DAQmxCreateTask("", &tempTask);
+   if (niRet != DAQmxSuccess)
+   {
+      return LogError(niRet, "CreateTask");
+   }
+   niRet = DAQmxCreateDOChan(tempTask, channel_.c_str(), "tempchan", DAQmx_Val_ChanForAllLines);
+   if (niRet != DAQmxSuccess)
+   {
+      error = LogError(niRet, "CreateDOChan");
+      DAQmxClearTask(tempTask);
+      return error;
+   }
+   uInt32 numLines = 0;
+   error = DAQmxGetDONumLines(tempTask, "tempchan", &numLines);
+   if (error)
+   {
+      error = LogError(error, "GetDONumLines");
+      DAQmxClearTask(tempTask);
+      return error;
+   }
+   DAQmxClearTask(tempTask);
+   if (numLines > 0)
+   {
+	  numPos_ = 1 << numLines;
+   }
+   else
+   {
+	  numPos_ = 0; // Shouldn't happen
+   }
+   if (!shared_)
+   {
+      SetupTask();
+   }
+
+   // create positions and labels
+   const int bufSize = 1024;
+   char buf[bufSize];
+   for (long i=0; i<numPos_; i++)
+   {
+      snprintf(buf, bufSize, "%d", (unsigned)i);
+      SetPositionLabel(i, buf);
+   }
+
+   // State
+   pAct = new CPropertyAction (this, &DigitalO::OnState);
+   nRet = CreateProperty(MM::g_Keyword_State, "0", MM::Integer, false, pAct);
+   if (nRet != DEVICE_OK)
+   {
+      return nRet;
+   }
+
+   // Label
+   pAct = new CPropertyAction(this, &DigitalO::OnLabel);
+   nRet = CreateProperty(MM::g_Keyword_Label, "0", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+   {
+	   return nRet;
+   }
+
+   // Gate Closed Position
+   nRet = CreateProperty(MM::g_Keyword_Closed_Position, "0", MM::Integer, false);
+   if (nRet != DEVICE_OK)
+   {
+      return nRet;
+   }
+
+   GetGateOpen(open_);
+
+   // Whether or not hardware triggering is available. Determined by
+   // attempting to set up a triggering task and erroring if it
+   // fails.
+   supportsTriggering_ = (TestTriggering() == 0);
+   pAct = new CPropertyAction(this, &DAQDevice::OnSupportsTriggering);
+   nRet = CreateIntegerProperty(g_PropertyCanTrigger,
+      supportsTriggering_, true, pAct);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Timing of the on-demand calls and of the sequence loads.
+   nRet = CreateStatisticsProperties(this);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   nRet = UpdateStatus();
+   if (nRet != DEVICE_OK)
+   {
+      return nRet;
+   }
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int DigitalO::Shutdown()
+{
+   CancelTask();
+   if (shared_)
+   {
+      shared_->RemoveLine(*this);
+      shared_ = 0;
+   }
+   
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int DigitalO::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long)state_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      bool gateOpen;
+      GetGateOpen(gateOpen);
+
+      long state;
+      pProp->Get(state);
+
+      if ((state == state_) && (open_ == gateOpen))
+         return DEVICE_OK;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      uInt32 data = state;
+      if (!gateOpen) {
+         long closed_state;
+         GetProperty(MM::g_Keyword_Closed_Position, closed_state);
+         data = closed_state;
+      }
+      long niRet = WriteState(data);
+      if (niRet != DAQmxSuccess)
+      {
+         return niRet;
+      }
+      RecordCall(start);
+
+      state_ = (int)state;
+      open_ = gateOpen;
+      pProp->Set((long)state_);
+   }
+   else if (eAct == MM::IsSequenceable)
+   {
+      // Only if we believe we can trigger, and the user
+      // hasn't disabled triggering.
+      if (supportsTriggering_ && isTriggeringEnabled_)
+      {
+         pProp->SetSequenceable(GetMaxSequenceLength());
+      }
+      else
+      {
+         pProp->SetSequenceable(0);
+      }
+   }
+   else if (eAct == MM::AfterLoadSequence)
+   {
+      // Load the sequence into NI's buffer, but don't start
+      // the task.
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      std::vector<std::string> sequence = pProp->GetSequence();
+      if (sequence.size() > GetMaxSequenceLength())
+      {
+         return DEVICE_SEQUENCE_TOO_LARGE;
+      }
+      int error = ParseSequence(sequence);
+      if (error)
+      {
+         return error;
+      }
+      if (shared_)
+      {
+         // Loaded with the other lines of the card when they start
+         shared_->LoadSequence(sharedIndex_, loadBuffer_);
+         return DEVICE_OK;
+      }
+      if (amPreparedToTrigger_ && loadBuffer_ == sequence_)
+      {
+         // The stopped task still holds this sequence.
+         return DEVICE_OK;
+      }
+      // The previous sequence's storage is reused by the next load
+      sequence_.swap(loadBuffer_);
+      error = SetupDigitalTriggering();
+      if (error)
+      {
+         return error;
+      }
+	  amPreparedToTrigger_ = true;
+      RecordSequenceLoad(start);
+   }
+   else if (eAct == MM::StartSequence)
+   {
+      if (shared_)
+      {
+         return shared_->StartSequence(*this);
+      }
+      // Start the triggering task now.
+      int error = DAQmxStartTask(task_);
+      if (error)
+      {
+          return LogError(error, "StartTask");
+      }
+      return StartStream();
+   }
+   else if (eAct == MM::StopSequence)
+   {
+      if (shared_)
+      {
+         return shared_->StopSequence(*this);
+      }
+      if (streaming_)
+      {
+         CancelTask();
+         return DEVICE_OK;
+      }
+      // Keep the task and its buffer, so that the same sequence can
+      // be started again without being uploaded. Any state change
+      // rebuilds the task.
+      int error = DAQmxStopTask(task_);
+      if (error)
+      {
+         CancelTask();
+         return LogError(error, "StopTask");
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+// Parse a state without allocating.
+static bool ParseState(const std::string& text, uInt32& value)
+{
+   const char* c = text.c_str();
+   if (*c == '\0')
+   {
+      return false;
+   }
+   uInt64 result = 0;
+   for (; *c != '\0'; ++c)
+   {
+      if (*c < '0' || *c > '9')
+      {
+         return false;
+      }
+      result = result * 10 + (*c - '0');
+      if (result > 0xFFFFFFFFULL)
+      {
+         return false;
+      }
+   }
+   value = (uInt32) result;
+   return true;
+}
+
+// Parse a sequence of states into loadBuffer_, whose storage is kept
+// between loads.
+int DigitalO::ParseSequence(const std::vector<std::string>& sequence)
+{
+   loadBuffer_.resize(sequence.size());
+   for (size_t i = 0; i < sequence.size(); ++i)
+   {
+      if (!ParseState(sequence[i], loadBuffer_[i]))
+      {
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      if (loadBuffer_[i] >= (uInt32) numPos_)
+      {
+         return ERR_UNKNOWN_POSITION;
+      }
+   }
+   return DEVICE_OK;
+}
+
+// Write a state, with the other lines of the card when they share a task.
+int DigitalO::WriteState(uInt32 data)
+{
+   if (shared_)
+   {
+      return shared_->Write(*this, sharedIndex_, data);
+   }
+   // Reuse the task for writing digital values
+   int error = GetOnDemandTask();
+   if (error)
+   {
+      return error;
+   }
+   int32 written;
+   error = DAQmxWriteDigitalU32(task_, 1, 1, 10.0, DAQmx_Val_GroupByChannel, &data, &written, NULL);
+   if (error)
+   {
+      // Rebuild the task on the next write
+      CancelTask();
+      return LogError(error, "WriteDigitalU32");
+   }
+   return DEVICE_OK;
+}
+
+// Channel of the task used for the state changes.
+int DigitalO::CreateOnDemandChannel()
+{
+   int error = DAQmxCreateDOChan(task_, channel_.c_str(), "", DAQmx_Val_ChanForAllLines);
+   if (error)
+   {
+      return LogError(error, "CreateDOChan");
+   }
+   return DEVICE_OK;
+}
+
+// Set up a digital triggering task: create the output channel,
+// load sequence_ onto NI's buffer, or prepare its streaming, and
+// set up the triggering rules.
+int DigitalO::SetupDigitalTriggering()
+{
+   SetupTask();
+   int error = DAQmxCreateDOChan(task_, channel_.c_str(), "",
+         DAQmx_Val_ChanForAllLines);
+   if (error)
+   {
+       return LogError(error, "CreateDOChan");
+   }
+   long numVals = (long) sequence_.size();
+   error = SetupClockInput(streaming_ ? streamBufferSize_ : numVals);
+   if (error)
+   {
+      return error;
+   }
+   if (streaming_)
+   {
+      return PrepareStream(numVals);
+   }
+   return LoadBuffer(sequence_.data(), numVals);
+}
+
+// Write part of sequence_ when streaming.
+int DigitalO::WriteSamples(long offset, long numVals)
+{
+   return LoadBuffer(&sequence_[offset], numVals);
+}
+
+// Load a sequence of outputs onto NI's buffer.
+int DigitalO::LoadBuffer(uInt32* sequence, long numVals)
+{
+   int32 numWritten = 0;
+   // Wait 10s for writing to complete (maybe should vary based on length of
+   // data being written?)
+   int error = DAQmxWriteDigitalU32(task_, numVals, false, 10,
+       DAQmx_Val_GroupByScanNumber, sequence, &numWritten, NULL);
+   if (error)
+   {
+       return LogError(error, "WriteDigitalU32");
+   }
+   if (numWritten != numVals)
+   {
+       LogMessage(("Didn't write all of sequence; wrote only " + boost::lexical_cast<std::string>(numWritten)).c_str());
+       return 1;
+   }
+   return 0;
+}
+
+// Test whether triggering is possible, by attempting to set up a
+// dummy trigger sequence.
+int DigitalO::TestTriggering()
+{
+   if (shared_)
+   {
+      return shared_->TestTriggering(*this);
+   }
+   int numSamples = 32;
+   sequence_.resize(numSamples);
+   for (int i = 0; i < numSamples; ++i)
+   {
+       sequence_[i] = i % 16;
+   }
+   return SetupDigitalTriggering();
+}
+
+int DigitalO::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(channel_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(channel_);
+   }
+
+   return DEVICE_OK;
+}
+
+int DigitalO::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(port_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(port_);
+      if (strcmp(port_.c_str(), g_UseCustom) != 0)
+      {
+         // User wants to use one of our auto-detected ports.
+         channel_ = port_;
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AnalogO implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~
+
+AnalogO::AnalogO() :
+      busy_(false), disable_(false), minV_(0.0), maxV_(5.0), volts_(0.0), gatedVolts_(0.0), encoding_(0),
+      resolution_(0), gateOpen_(true), demo_(false), waveformShape_(g_WaveformNone),
+      waveformAmplitude_(1.0), waveformOffset_(0.0), waveformPeriod_(1000), waveformSamples_(1000),
+      waveformPoints_("0:0,0.5:1,1:0"), internalClock_(false), doubleBuffering_(false),
+      sequenceRunning_(false), sequenceStaged_(false), rampMode_(g_RampOff),
+      rampSlewRate_(1.0), rampDuration_(1.0), ramping_(false), output_(0.0)
+{
+   task_ = 0;
+   InitializeDefaultErrorMessages();
+
+   // add custom error messages
+   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
+   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
+   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
+   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
+   SetErrorText(ERR_SEQUENCE_MISMATCH, "The sequences of the lines of the hub have different lengths");
+   SetErrorText(ERR_CLOCK_MISMATCH, "The lines of the hub have different trigger inputs or sample rates");
+
+   // Output channel, a.k.a. port.
+   CPropertyAction* pAct = new CPropertyAction (this, &AnalogO::OnChannel);
+   int nRet = CreateStringProperty(g_PropertyChannel, "devname", false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // Output port -- a more convenient version of the above for users that
+   // don't need to specify individual lines.
+   pAct = new CPropertyAction(this, &AnalogO::OnPort);
+   nRet = CreateStringProperty(g_PropertyPort, "devname", false, pAct, true);
+   std::vector<std::string> devices = GetDevices();
+   if (devices.size() == 0)
+   {
+      AddAllowedValue(g_PropertyPort, "No valid devices found");
+   }
+   else
+   {
+      AddAllowedValue(g_PropertyPort, g_UseCustom);
+      SetProperty(g_PropertyPort, g_UseCustom);
+   }
+   for (std::vector<string>::iterator i = devices.begin(); i != devices.end(); ++i) {
+      std::vector<string> ports = GetAnalogOPortsForDevice(*i);
+      for (std::vector<string>::iterator j = ports.begin(); j != ports.end(); ++j) {
+         AddAllowedValue(g_PropertyPort, (*j).c_str());
+      }
+   }
+
+   pAct = new CPropertyAction(this, &DAQDevice::OnSequenceLength);
+   nRet = CreateStringProperty(g_PropertySequenceLength,
+      boost::lexical_cast<std::string>(maxSequenceLength_).c_str(), false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // Streamed sequences are not limited by the card buffer.
+   pAct = new CPropertyAction(this, &DAQDevice::OnStreaming);
+   nRet = CreateStringProperty(g_PropertyStreaming, g_No, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue(g_PropertyStreaming, g_No);
+   AddAllowedValue(g_PropertyStreaming, g_Yes);
+
+   pAct = new CPropertyAction(this, &DAQDevice::OnStreamBufferSize);
+   nRet = CreateIntegerProperty(g_PropertyStreamBufferSize, streamBufferSize_, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // demo
+   pAct = new CPropertyAction (this, &AnalogO::OnDemo);
+   nRet = CreateProperty(g_PropertyDemo, g_No, MM::String, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+   AddAllowedValue(g_PropertyDemo, g_No);
+   AddAllowedValue(g_PropertyDemo, g_Yes);
+
+   // MinVolts
+   // --------
+   pAct = new CPropertyAction (this, &AnalogO::OnMinVolts);
+   nRet = CreateProperty(g_PropertyMinVolts, "0.0", MM::Float, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // MaxVolts
+   // --------
+   pAct = new CPropertyAction (this, &AnalogO::OnMaxVolts);
+   nRet = CreateProperty(g_PropertyMaxVolts, "5.0", MM::Float, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+}
+
+AnalogO::~AnalogO()
+{
+   Shutdown();
+}
+
+void AnalogO::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameAnalogO);
+}
+
+
+int AnalogO::Initialize()
+{
+   SetContext(GetCoreCallback(), this);
+   SetDeviceName();
+   // set property list
+   // -----------------
+   char label[MM::MaxStrLength];
+   GetLabel(label);
+   
+   // Name
+   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameAnalogO, MM::String, true);
+   if (DEVICE_OK != nRet)
+      return nRet;
+
+   // Description
+   nRet = CreateProperty(MM::g_Keyword_Description, "NI DAC", MM::String, true);
+   if (DEVICE_OK != nRet)
+      return nRet;
+
+   // TODO: this and the following property are copy/pasted in the DigitalO
+   // and AnalogO classes.
+   // Manual triggering override.
+   CPropertyAction* pAct = new CPropertyAction(this, &DAQDevice::OnTriggeringEnabled);
+   nRet = CreateIntegerProperty(g_PropertyTriggeringEnabled, 0, false, pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Input trigger sample rate.
+   pAct = new CPropertyAction(this, &DAQDevice::OnSampleRate);
+   nRet = CreateIntegerProperty(g_PropertySampleRate, samplesPerSec_, false,
+         pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Input trigger line.
+   pAct = new CPropertyAction(this, &DAQDevice::OnInputTrigger);
+   nRet = CreateProperty(g_PropertyTriggerInput,
+      "", MM::String, false, pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+   std::string terminals;
+   int error = QueryDevice(&DAQmxGetDevTerminals, "DevTerminals", deviceName_, terminals);
+   if (error)
+   {
+      return LogError(error, "GetDevTerminals");
+   }
+   size_t index = std::string::npos;
+   do
+   {
+      std::string terminal = GetNextEntry(terminals, index);
+      AddAllowedValue(g_PropertyTriggerInput, terminal.c_str());
+      if (GetNumberOfPropertyValues(g_PropertyTriggerInput) == 1)
+      {
+         // Make this the default.
+         SetProperty(g_PropertyTriggerInput, terminal.c_str());
+      }
+   } while (index != std::string::npos);
+
+   // Lines of a card grouped under a hub share its output task.
+   NIHub* hub = static_cast<NIHub*>(GetParentHub());
+   if (hub)
+   {
+      char hubLabel[MM::MaxStrLength];
+      hub->GetLabel(hubLabel);
+      SetParentID(hubLabel);
+      CreateHubIDProperty();
+      shared_ = hub->GetSharedTask(deviceName_, false);
+      sharedIndex_ = shared_->AddChannel(*this, channel_, minV_, maxV_, volts_);
+   }
+
+   // Whether or not hardware triggering is available. Determined by
+   // attempting to set up a triggering task and erroring if it
+   // fails.
+   supportsTriggering_ = (TestTriggering() == 0);
+   pAct = new CPropertyAction(this, &DAQDevice::OnSupportsTriggering);
+   nRet = CreateIntegerProperty(g_PropertyCanTrigger,
+      supportsTriggering_, true, pAct);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Volts
+   // -----
+   pAct = new CPropertyAction (this, &AnalogO::OnVolts);
+   nRet = CreateProperty(g_PropertyVolts, "0.0", MM::Float, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   nRet = SetPropertyLimits(g_PropertyVolts, minV_, maxV_);
+   assert(nRet == DEVICE_OK);
+
+    //Disable
+    pAct = new CPropertyAction (this, &AnalogO::OnDisable);
+    nRet = CreateProperty(g_PropertyDisable, "false", MM::String, false, pAct);
+    AddAllowedValue(g_PropertyDisable, "false");
+    AddAllowedValue(g_PropertyDisable, "true");
+    assert(nRet == DEVICE_OK);
+
+   // Waveform generator
+   // ------------------
+   // The waveform spans WaveformOffset to WaveformOffset + WaveformAmplitude,
+   // the period and the length are in samples.
+   pAct = new CPropertyAction (this, &AnalogO::OnWaveformShape);
+   nRet = CreateProperty(g_PropertyWaveformShape, g_WaveformNone, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyWaveformShape, g_WaveformNone);
+   AddAllowedValue(g_PropertyWaveformShape, g_WaveformRamp);
+   AddAllowedValue(g_PropertyWaveformShape, g_WaveformSawtooth);
+   AddAllowedValue(g_PropertyWaveformShape, g_WaveformSine);
+   AddAllowedValue(g_PropertyWaveformShape, g_WaveformTriangle);
+   AddAllowedValue(g_PropertyWaveformShape, g_WaveformPiecewiseLinear);
+
+   pAct = new CPropertyAction (this, &AnalogO::OnWaveformAmplitude);
+   nRet = CreateFloatProperty(g_PropertyWaveformAmplitude, waveformAmplitude_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   pAct = new CPropertyAction (this, &AnalogO::OnWaveformOffset);
+   nRet = CreateFloatProperty(g_PropertyWaveformOffset, waveformOffset_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   pAct = new CPropertyAction (this, &AnalogO::OnWaveformPeriod);
+   nRet = CreateIntegerProperty(g_PropertyWaveformPeriod, waveformPeriod_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits(g_PropertyWaveformPeriod, 2, g_MaxWaveformSamples);
+
+   pAct = new CPropertyAction (this, &AnalogO::OnWaveformSamples);
+   nRet = CreateIntegerProperty(g_PropertyWaveformSamples, waveformSamples_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits(g_PropertyWaveformSamples, 2, g_MaxWaveformSamples);
+
+   // Piecewise-linear points, "phase:level" with both in [0, 1]
+   pAct = new CPropertyAction (this, &AnalogO::OnWaveformPoints);
+   nRet = CreateProperty(g_PropertyWaveformPoints, waveformPoints_.c_str(), MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   pAct = new CPropertyAction (this, &AnalogO::OnWaveformClock);
+   nRet = CreateProperty(g_PropertyWaveformClock, g_ClockTriggerInput, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyWaveformClock, g_ClockTriggerInput);
+   AddAllowedValue(g_PropertyWaveformClock, g_ClockInternal);
+
+   pAct = new CPropertyAction (this, &AnalogO::OnGenerateWaveform);
+   nRet = CreateProperty(g_PropertyGenerateWaveform, "Idle", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyGenerateWaveform, "Idle");
+   AddAllowedValue(g_PropertyGenerateWaveform, "Generate");
+
+   // Double buffering: the next sequence is staged while the current
+   // one runs and swapped in when it stops.
+   pAct = new CPropertyAction (this, &AnalogO::OnDoubleBuffering);
+   nRet = CreateProperty(g_PropertyDoubleBuffering, g_No, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyDoubleBuffering, g_No);
+   AddAllowedValue(g_PropertyDoubleBuffering, g_Yes);
+
+   // Ramps of the set-point changes, generated by the card at
+   // TriggerSampleRate: limited by a slew rate (V/ms), or lasting a
+   // fixed duration (ms).
+   pAct = new CPropertyAction (this, &AnalogO::OnRampMode);
+   nRet = CreateProperty(g_PropertyRampMode, g_RampOff, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyRampMode, g_RampOff);
+   AddAllowedValue(g_PropertyRampMode, g_RampSlewRate);
+   AddAllowedValue(g_PropertyRampMode, g_RampDuration);
+
+   pAct = new CPropertyAction (this, &AnalogO::OnRampSlewRate);
+   nRet = CreateProperty(g_PropertyRampSlewRate,
+      boost::lexical_cast<std::string>(rampSlewRate_).c_str(), MM::Float, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   pAct = new CPropertyAction (this, &AnalogO::OnRampDuration);
+   nRet = CreateProperty(g_PropertyRampDuration,
+      boost::lexical_cast<std::string>(rampDuration_).c_str(), MM::Float, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   // Timing of the on-demand calls and of the sequence loads.
+   nRet = CreateStatisticsProperties(this);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+
+   // set up task
+   // -----------
+   if (!demo_ && !shared_)
+   {
+      int niRet = GetOnDemandTask();
+      if (niRet)
+      {
+          return niRet;
+      }
+   }
+
+   nRet = UpdateStatus();
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   initialized_ = true;
+
+   return DEVICE_OK;
+}
+
+int AnalogO::Shutdown()
+{
+   if (!demo_)
+   {
+      CancelTask();
+   }
+   if (shared_)
+   {
+      shared_->RemoveLine(*this);
+      shared_ = 0;
+   }
+
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+int AnalogO::SetSignal(double volts)
+{
+   ostringstream txt;
+   txt << "2P >>>> AnalogO::SetVoltage() = " << volts; 
+   LogMessage(txt.str());
+   return SetProperty(g_PropertyVolts, CDeviceUtils::ConvertToString(volts));
+}
+
+int AnalogO::SetGateOpen(bool open)
+{
+   int ret(DEVICE_OK);
+
+   if (open)
+   {
+      // opening gate: restore voltage
+      if (!gateOpen_)
+         ret = ApplyVoltage(gatedVolts_);
+   }
+   else
+   {
+      // closing gate: set voltage to 0
+      if (gateOpen_)
+      {
+         ret = ApplyVoltage(0.0);
+      }
+   }
+
+   if (ret != DEVICE_OK)
+      return ret;
+
+   gateOpen_ = open;
+   return DEVICE_OK;
+}
+
+int AnalogO::GetGateOpen(bool& open)
+{
+   open = gateOpen_;
+   return DEVICE_OK;
+}
+
+int AnalogO::ApplyVoltage(double v)
+{
+   if (!demo_)
+   {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      float64 data[1];
+      data[0] = v;
+      if (disable_)	
+      {
+         data[0] = 0;
+      }
+      long niRet;
+      if (shared_)
+      {
+         // Written with the other lines of the card
+         niRet = shared_->Write(*this, sharedIndex_, data[0]);
+      }
+      else if (rampMode_.compare(g_RampOff) != 0)
+      {
+         niRet = RampVoltage(data[0]);
+      }
+      else
+      {
+         niRet = WriteVoltage(data[0]);
+      }
+      if (niRet)
+      {
+         return niRet;
+      }
+      if (!ramping_)
+      {
+         // A ramp updates the output when it stops
+         output_ = data[0];
+      }
+      RecordCall(start);
+   }
+   volts_ = v;
+   return DEVICE_OK;
+}
+
+// Write a single point on the on-demand task.
+int AnalogO::WriteVoltage(float64 v)
+{
+   // Any ramp is replaced by the on-demand write
+   int error = StopRamp();
+   if (error)
+   {
+      return error;
+   }
+   error = GetOnDemandTask();
+   if (error)
+   {
+      return error;
+   }
+   error = DAQmxWriteAnalogF64(task_, 1, 1, 10.0, DAQmx_Val_GroupByChannel, &v, NULL, NULL);
+   if (error)
+   {
+      // Rebuild the task on the next write
+      CancelTask();
+      return LogError(error, "WriteAnalogF64");
+   }
+   return DEVICE_OK;
+}
+
+// Go to v along a linear ramp from the last output, generated by the
+// card on its own clock. The on-demand task is switched to sample clock
+// timing for the ramp rather than rebuilt, and Busy() reports the ramp
+// until it is done. A ramp still running is stopped where it is, so
+// that the next one starts from the voltage actually output.
+int AnalogO::RampVoltage(float64 v)
+{
+   int error = StopRamp();
+   if (error)
+   {
+      return error;
+   }
+   double duration = rampDuration_;
+   if (rampMode_.compare(g_RampSlewRate) == 0)
+   {
+      duration = fabs(v - output_) / rampSlewRate_;
+   }
+   long numVals = (long) ceil(duration * 1e-3 * samplesPerSec_);
+   if (numVals > g_MaxWaveformSamples)
+   {
+      numVals = g_MaxWaveformSamples;
+   }
+   if (numVals < 2 || v == output_)
+   {
+      // Shorter than a sample period
+      return WriteVoltage(v);
+   }
+
+   ramp_.resize(numVals);
+   double step = (v - output_) / numVals;
+   for (long k = 0; k < numVals - 1; ++k)
+   {
+      ramp_[k] = output_ + step * (k + 1);
+   }
+   ramp_[numVals - 1] = v;
+
+   error = GetOnDemandTask();
+   if (error)
+   {
+      return error;
+   }
+   error = DAQmxStopTask(task_);
+   if (error)
+   {
+      error = LogError(error, "StopTask");
+      CancelTask();
+      return error;
+   }
+   error = DAQmxCfgSampClkTiming(task_, "", samplesPerSec_,
+      DAQmx_Val_Rising, DAQmx_Val_FiniteSamps, numVals);
+   if (error)
+   {
+      error = LogError(error, "CfgSampClkTiming");
+      CancelTask();
+      return error;
+   }
+   int32 numWritten = 0;
+   error = DAQmxWriteAnalogF64(task_, numVals, false, 10.0,
+      DAQmx_Val_GroupByChannel, &ramp_[0], &numWritten, NULL);
+   if (error)
+   {
+      error = LogError(error, "WriteAnalogF64");
+      CancelTask();
+      return error;
+   }
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      error = LogError(error, "StartTask");
+      CancelTask();
+      return error;
+   }
+   ramping_ = true;
+   return DEVICE_OK;
+}
+
+// End the ramp on task_, taking the voltage it reached as the output,
+// and switch the task back to on-demand writes.
+int AnalogO::StopRamp()
+{
+   if (!ramping_)
+   {
+      return DEVICE_OK;
+   }
+   ramping_ = false;
+   uInt64 generated = 0;
+   int error = DAQmxGetWriteTotalSampPerChanGenerated(task_, &generated);
+   if (error)
+   {
+      error = LogError(error, "GetWriteTotalSampPerChanGenerated");
+      CancelTask();
+      return error;
+   }
+   if (generated > 0)
+   {
+      output_ = ramp_[std::min((size_t) generated, ramp_.size()) - 1];
+   }
+   error = DAQmxStopTask(task_);
+   if (error)
+   {
+      error = LogError(error, "StopTask");
+      CancelTask();
+      return error;
+   }
+   error = DAQmxSetSampTimingType(task_, DAQmx_Val_OnDemand);
+   if (error)
+   {
+      error = LogError(error, "SetSampTimingType");
+      CancelTask();
+      return error;
+   }
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      error = LogError(error, "StartTask");
+      CancelTask();
+      return error;
+   }
+   return DEVICE_OK;
+}
+
+// Busy while the card generates a ramp.
+bool AnalogO::Busy()
+{
+   if (!ramping_)
+   {
+      return false;
+   }
+   bool32 done = 1;
+   if (DAQmxIsTaskDone(task_, &done) || done)
+   {
+      // Ready the task for the next on-demand write
+      StopRamp();
+   }
+   return ramping_;
+}
+
+// Take the last sample generated by the sequence on task_ as the
+// output, where the next ramp starts. Streams repeat sequence_ too.
+void AnalogO::UpdateOutput()
+{
+   uInt64 generated = 0;
+   if (sequence_.empty() ||
+      DAQmxGetWriteTotalSampPerChanGenerated(task_, &generated) || generated == 0)
+   {
+      return;
+   }
+   output_ = sequence_[(size_t) ((generated - 1) % sequence_.size())];
+}
+
+// Channel of the task used for the voltage changes.
+int AnalogO::CreateOnDemandChannel()
+{
+   int error = DAQmxCreateAOVoltageChan(task_, channel_.c_str(), "",
+      minV_, maxV_, DAQmx_Val_Volts, "");
+   if (error)
+   {
+      return LogError(error, "CreateAOVoltageChan");
+   }
+   return DEVICE_OK;
+}
+
+int AnalogO::StartDASequence()
+{
+   if (shared_)
+   {
+      // All the lines of the card start together
+      shared_->LoadSequence(sharedIndex_, sequence_);
+      return shared_->StartSequence(*this);
+   }
+   int error;
+   if (sequenceStaged_ && !sequenceRunning_)
+   {
+      // Staged after the task was stopped or rebuilt
+      error = SwapSequence();
+      if (error)
+      {
+         return error;
+      }
+   }
+   if (!amPreparedToTrigger_)
+   {
+      error = PrepareSequenceTask();
+      if (error)
+      {
+         return error;
+      }
+   }
+   amPreparedToTrigger_ = true;
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      return LogError(error, "StartTask");
+   }
+   sequenceRunning_ = true;
+   return StartStream();
+}
+
+int AnalogO::StopDASequence()
+{
+   if (shared_)
+   {
+      return shared_->StopSequence(*this);
+   }
+   if (sequenceRunning_)
+   {
+      UpdateOutput();
+   }
+   sequenceRunning_ = false;
+   if (doubleBuffering_ && !streaming_ && amPreparedToTrigger_)
+   {
+      // Keep the task, its channel and its clock for the next sequence
+      int error = DAQmxStopTask(task_);
+      if (error)
+      {
+         CancelTask();
+         return LogError(error, "StopTask");
+      }
+      return SwapSequence();
+   }
+   CancelTask();
+   return DEVICE_OK;
+}
+int AnalogO::ClearDASequence()
+{
+   sequence_.clear();
+   sequenceStaged_ = false;
+   return DEVICE_OK;
+}
+int AnalogO::AddToDASequence(double val)
+{
+   sequence_.push_back(val);
+   return DEVICE_OK;
+}
+int AnalogO::SendDASequence()
+{
+   // Streamed and shared sequences are written once they start
+   if (streaming_ || shared_)
+   {
+      return DEVICE_OK;
+   }
+   return LoadBuffer();
+}
+
+// Create the task of sequence_: channel, clock and buffer.
+int AnalogO::PrepareSequenceTask()
+{
+   ramping_ = false;
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   int error = SetupTask();
+   if (error)
+   {
+      return error;
+   }
+   error = DAQmxCreateAOVoltageChan(task_, channel_.c_str(), "",
+      minV_, maxV_, DAQmx_Val_Volts, "");
+   if (error)
+   {
+      return LogError(error, "CreateAOVoltageChan");
+   }
+   error = SetupSequenceClock(streaming_ ? streamBufferSize_ : (int) sequence_.size());
+   if (error)
+   {
+      return error;
+   }
+   error = streaming_ ? PrepareStream((long) sequence_.size()) : LoadBuffer();
+   if (error)
+   {
+      return error;
+   }
+   amPreparedToTrigger_ = true;
+   RecordSequenceLoad(start);
+   return DEVICE_OK;
+}
+
+// Stage the next sequence, without touching the running one. It is
+// swapped in when the current sequence stops, or right away if no
+// sequence is running.
+int AnalogO::StageSequence(const std::vector<std::string>& sequence)
+{
+   std::vector<float64> values(sequence.size());
+   for (size_t i = 0; i < sequence.size(); ++i)
+   {
+      try
+      {
+         values[i] = boost::lexical_cast<float64>(sequence[i]);
+      }
+      catch (boost::bad_lexical_cast&)
+      {
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+   }
+   nextSequence_.swap(values);
+   sequenceStaged_ = true;
+   if (sequenceRunning_)
+   {
+      return DEVICE_OK;
+   }
+   return SwapSequence();
+}
+
+// Replace sequence_ by the staged sequence and load it, so that the
+// next start only has to start the task. A stopped task of the same
+// length only needs its buffer rewritten; otherwise the task is
+// created again.
+int AnalogO::SwapSequence()
+{
+   if (!sequenceStaged_)
+   {
+      return DEVICE_OK;
+   }
+   sequenceStaged_ = false;
+   bool sameLength = (nextSequence_.size() == sequence_.size());
+   sequence_.swap(nextSequence_);
+   if (!amPreparedToTrigger_ || !sameLength || streaming_ || sequence_.empty())
+   {
+      return PrepareSequenceTask();
+   }
+   // Overwrite the buffer from its first sample
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   int error = DAQmxSetWriteRelativeTo(task_, DAQmx_Val_FirstSample);
+   if (error)
+   {
+      CancelTask();
+      return LogError(error, "SetWriteRelativeTo");
+   }
+   error = DAQmxSetWriteOffset(task_, 0);
+   if (error)
+   {
+      CancelTask();
+      return LogError(error, "SetWriteOffset");
+   }
+   error = LoadBuffer();
+   if (error)
+   {
+      CancelTask();
+      return error;
+   }
+   RecordSequenceLoad(start);
+   return DEVICE_OK;
+}
+
+// Load our analog sequence onto the NI buffer. The sequence is handed
+// to DAQmx as is, without copy.
+int AnalogO::LoadBuffer()
+{
+   if (sequence_.empty())
+   {
+      return DEVICE_OK;
+   }
+   return WriteSamples(0, (long) sequence_.size());
+}
+
+// Write part of the sequence onto the NI buffer.
+int AnalogO::WriteSamples(long offset, long numVals)
+{
+   int32 numWritten = 0;
+   int error = DAQmxWriteAnalogF64(task_, (int32) numVals, false, -1,
+      DAQmx_Val_GroupByChannel, &sequence_[offset], &numWritten, NULL);
+   if (error)
+   {
+      return LogError(error, "WriteAnalogF64");
+   }
+   if (numWritten != numVals)
+   {
+      LogMessage(("Didn't write complete analog sequence to buffer: wrote " +
+         boost::lexical_cast<string>(numWritten) + " of " +
+         boost::lexical_cast<string>(numVals) + " values").c_str());
+      return 1;
+   }
+   return DEVICE_OK;
+}
+
+// Attempt to set up and run a triggering task.
+int AnalogO::TestTriggering()
+{
+   if (shared_)
+   {
+      return shared_->TestTriggering(*this);
+   }
+   // Always build the task from scratch, also when double buffering
+   if (sequenceRunning_)
+   {
+      UpdateOutput();
+   }
+   CancelTask();
+   sequenceRunning_ = false;
+   ramping_ = false;
+   int error = ClearDASequence();
+   if (error)
+   {
+      return error;
+   }
+   for (int i = 0; i < 100; ++i)
+   {
+      error = AddToDASequence(maxV_ / 10.0 * (i % 10));
+      if (error)
+      {
+         return error;
+      }
+   }
+   return StartDASequence();
+}
+
+// Sample clock of the sequences: the trigger input advances the sequence
+// one sample at a time, the internal clock plays it continuously at
+// samplesPerSec_.
+int AnalogO::SetupSequenceClock(int numVals)
+{
+   if (!internalClock_)
+   {
+      return SetupClockInput(numVals);
+   }
+   int error = DAQmxCfgSampClkTiming(task_, "", samplesPerSec_,
+      DAQmx_Val_Rising, DAQmx_Val_ContSamps, numVals);
+   if (error)
+   {
+      return LogError(error, "CfgSampClkTiming");
+   }
+   return DEVICE_OK;
+}
+
+// Generate the waveform in sequence_. Each shape is computed in a single
+// pass over the buffer without branches, so that the compiler can
+// vectorise the loops.
+int AnalogO::GenerateWaveform()
+{
+   const long n = waveformSamples_;
+   const double period = (double) waveformPeriod_;
+   const double invPeriod = 1.0 / period;
+   const double amplitude = waveformAmplitude_;
+   const double offset = waveformOffset_;
+
+   sequence_.resize(n);
+   double* values = &sequence_[0];
+
+   if (waveformShape_ == g_WaveformRamp)
+   {
+      // A single ramp over the whole waveform
+      const double step = amplitude / (n - 1);
+      for (long k = 0; k < n; ++k)
+      {
+         values[k] = offset + step * k;
+      }
+   }
+   else if (waveformShape_ == g_WaveformSawtooth)
+   {
+      for (long k = 0; k < n; ++k)
+      {
+         double phase = k * invPeriod;
+         values[k] = offset + amplitude * (phase - std::floor(phase));
+      }
+   }
+   else if (waveformShape_ == g_WaveformTriangle)
+   {
+      for (long k = 0; k < n; ++k)
+      {
+         double phase = k * invPeriod;
+         phase -= std::floor(phase);
+         values[k] = offset + amplitude * (1.0 - std::fabs(2.0 * phase - 1.0));
+      }
+   }
+   else if (waveformShape_ == g_WaveformSine)
+   {
+      // Starts at the offset, as the other shapes
+      const double omega = 2.0 * 3.14159265358979323846 * invPeriod;
+      for (long k = 0; k < n; ++k)
+      {
+         values[k] = offset + 0.5 * amplitude * (1.0 - std::cos(omega * k));
+      }
+   }
+   else if (waveformShape_ == g_WaveformPiecewiseLinear)
+   {
+      // Parse the "phase:level" points
+      std::vector<std::pair<double, double> > points;
+      std::istringstream list(waveformPoints_);
+      std::string entry;
+      while (std::getline(list, entry, ','))
+      {
+         size_t colon = entry.find(':');
+         if (colon == std::string::npos)
+         {
+            return DEVICE_INVALID_PROPERTY_VALUE;
+         }
+         try
+         {
+            points.push_back(std::make_pair(
+               boost::lexical_cast<double>(boost::algorithm::trim_copy(entry.substr(0, colon))),
+               boost::lexical_cast<double>(boost::algorithm::trim_copy(entry.substr(colon + 1)))));
+         }
+         catch (boost::bad_lexical_cast&)
+         {
+            return DEVICE_INVALID_PROPERTY_VALUE;
+         }
+      }
+      if (points.empty())
+      {
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      std::sort(points.begin(), points.end());
+
+      // One period is interpolated, then repeated
+      const long periodSamples = waveformPeriod_ < n ? waveformPeriod_ : n;
+      size_t segment = 0;
+      for (long k = 0; k < periodSamples; ++k)
+      {
+         double phase = k * invPeriod;
+         while (segment + 1 < points.size() && points[segment + 1].first <= phase)
+         {
+            ++segment;
+         }
+         double level;
+         if (phase <= points[0].first)
+         {
+            level = points[0].second;
+         }
+         else if (segment + 1 >= points.size())
+         {
+            level = points[segment].second;
+         }
+         else
+         {
+            double x0 = points[segment].first;
+            double x1 = points[segment + 1].first;
+            level = points[segment].second +
+               (points[segment + 1].second - points[segment].second) * (phase - x0) / (x1 - x0);
+         }
+         values[k] = offset + amplitude * level;
+      }
+      for (long k = periodSamples; k < n; ++k)
+      {
+         values[k] = values[k - periodSamples];
+      }
+   }
+   else
+   {
+      sequence_.clear();
+      return DEVICE_OK;
+   }
+
+   // Keep the waveform within the limits of the channel
+   for (long k = 0; k < n; ++k)
+   {
+      values[k] = values[k] < minV_ ? minV_ : (values[k] > maxV_ ? maxV_ : values[k]);
+   }
+   return DEVICE_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int AnalogO::OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(gatedVolts_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double v;
+      pProp->Get(v);
+      gatedVolts_ = v;
+
+      if (gateOpen_)
+      {
+         return ApplyVoltage(v);
+      }
+   }
+   else if (eAct == MM::IsSequenceable)
+   {
+      // Only if we believe we can trigger, and the user
+      // hasn't disabled triggering.
+      if (supportsTriggering_ && isTriggeringEnabled_)
+      {
+         pProp->SetSequenceable(GetMaxSequenceLength());
+      }
+      else
+      {
+         pProp->SetSequenceable(0);
+      }
+   }
+   else if (eAct == MM::AfterLoadSequence)
+   {
+      std::vector<std::string> sequence = pProp->GetSequence();
+      if (sequence.size() > GetMaxSequenceLength())
+      {
+         return DEVICE_SEQUENCE_TOO_LARGE;
+      }
+      if (doubleBuffering_ && !shared_)
+      {
+         return StageSequence(sequence);
+      }
+      // Transfer the sequence into our internal storage.
+      ClearDASequence();
+      if (!shared_)
+      {
+         SetupTask();
+      }
+      for (long i = 0; i < sequence.size(); ++i)
+      {
+         AddToDASequence(boost::lexical_cast<float64>(sequence[i]));
+      }
+   }
+   else if (eAct == MM::StartSequence)
+   {
+      return StartDASequence();
+   }
+   else if (eAct == MM::StopSequence)
+   {
+      int error = StopDASequence();
+      if (error || doubleBuffering_)
+      {
+         // The sequence stays loaded on the stopped task
+         return error;
+      }
+      error = ClearDASequence();
+      if (error)
+      {
+         return error;
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnMinVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(minV_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(minV_);
+      // The channel limits are part of the task
+      onDemandReady_ = false;
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnMaxVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(maxV_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(maxV_);
+      // The channel limits are part of the task
+      onDemandReady_ = false;
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnDisable(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set( (disable_ ? "true" : "false"));
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        string temp;
+        pProp->Get(temp);
+        disable_ = (temp == "true");
+        ApplyVoltage(gatedVolts_);
+    }
+
+    return DEVICE_OK;
+}
+
+int AnalogO::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(channel_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(channel_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(port_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(port_);
+      if (strcmp(port_.c_str(), g_UseCustom) != 0)
+      {
+         // User wants to use one of our auto-detected ports.
+         channel_ = port_;
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnDemo(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(demo_ ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      string val;
+      pProp->Get(val);
+      if (val.compare(g_Yes) == 0)
+         demo_ = true;
+      else
+         demo_ = false;
+   }
+
+   return DEVICE_OK;
+}
+
+
+int AnalogO::OnDoubleBuffering(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(doubleBuffering_ ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      string val;
+      pProp->Get(val);
+      doubleBuffering_ = (val.compare(g_Yes) == 0);
+      if (!doubleBuffering_)
+      {
+         sequenceStaged_ = false;
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnRampMode(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(rampMode_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(rampMode_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnRampSlewRate(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(rampSlewRate_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double slewRate;
+      pProp->Get(slewRate);
+      if (slewRate <= 0.0)
+      {
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      rampSlewRate_ = slewRate;
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnRampDuration(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(rampDuration_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double duration;
+      pProp->Get(duration);
+      if (duration < 0.0)
+      {
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      rampDuration_ = duration;
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnWaveformShape(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(waveformShape_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(waveformShape_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnWaveformAmplitude(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(waveformAmplitude_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(waveformAmplitude_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnWaveformOffset(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(waveformOffset_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(waveformOffset_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnWaveformPeriod(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(waveformPeriod_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(waveformPeriod_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnWaveformSamples(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(waveformSamples_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(waveformSamples_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnWaveformPoints(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(waveformPoints_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(waveformPoints_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnWaveformClock(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(internalClock_ ? g_ClockInternal : g_ClockTriggerInput);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      string val;
+      pProp->Get(val);
+      internalClock_ = (val.compare(g_ClockInternal) == 0);
+      // The clock of a loaded sequence is outdated
+      amPreparedToTrigger_ = false;
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogO::OnGenerateWaveform(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set("Idle");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      string val;
+      pProp->Get(val);
+      if (val.compare("Generate") == 0)
+      {
+         pProp->Set("Idle");
+         // Replace the sequence, it is sent to the card by StartDASequence
+         if (sequenceRunning_)
+         {
+            UpdateOutput();
+         }
+         CancelTask();
+         sequenceRunning_ = false;
+         sequenceStaged_ = false;
+         return GenerateWaveform();
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// MultiAnalogO implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+MultiAnalogO::MultiAnalogO() :
+      initialized_(false), minV_(0.0), maxV_(5.0), numChannels_(0),
+      sequenceRunning_(false)
+{
+   task_ = 0;
+   InitializeDefaultErrorMessages();
+
+   // add custom error messages
+   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
+   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
+   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
+   SetErrorText(ERR_SEQUENCE_MISMATCH, "The sequences of the channels have different lengths");
+
+   // Output channels, as a DAQmx list of physical channels
+   // (e.g. "Dev1/ao0:3" or "Dev1/ao0, Dev1/ao2").
+   CPropertyAction* pAct = new CPropertyAction (this, &MultiAnalogO::OnChannel);
+   int nRet = CreateStringProperty(g_PropertyChannel, "devname", false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   pAct = new CPropertyAction(this, &DAQDevice::OnSequenceLength);
+   nRet = CreateStringProperty(g_PropertySequenceLength,
+      boost::lexical_cast<std::string>(maxSequenceLength_).c_str(), false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // MinVolts
+   // --------
+   pAct = new CPropertyAction (this, &MultiAnalogO::OnMinVolts);
+   nRet = CreateProperty(g_PropertyMinVolts, "0.0", MM::Float, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // MaxVolts
+   // --------
+   pAct = new CPropertyAction (this, &MultiAnalogO::OnMaxVolts);
+   nRet = CreateProperty(g_PropertyMaxVolts, "5.0", MM::Float, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+}
+
+MultiAnalogO::~MultiAnalogO()
+{
+   Shutdown();
+}
+
+void MultiAnalogO::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameMultiAnalogO);
+}
+
+int MultiAnalogO::Initialize()
+{
+   SetContext(GetCoreCallback(), this);
+   SetDeviceName();
+
+   // Name
+   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameMultiAnalogO, MM::String, true);
+   if (DEVICE_OK != nRet)
+      return nRet;
+
+   // Description
+   nRet = CreateProperty(MM::g_Keyword_Description, "NI multi-channel DAC", MM::String, true);
+   if (DEVICE_OK != nRet)
+      return nRet;
+
+   // Manual triggering override.
+   CPropertyAction* pAct = new CPropertyAction(this, &DAQDevice::OnTriggeringEnabled);
+   nRet = CreateIntegerProperty(g_PropertyTriggeringEnabled, 0, false, pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Input trigger sample rate.
+   pAct = new CPropertyAction(this, &DAQDevice::OnSampleRate);
+   nRet = CreateIntegerProperty(g_PropertySampleRate, samplesPerSec_, false,
+         pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Input trigger line.
+   pAct = new CPropertyAction(this, &DAQDevice::OnInputTrigger);
+   nRet = CreateProperty(g_PropertyTriggerInput,
+      "", MM::String, false, pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+   std::string terminals;
+   int error = QueryDevice(&DAQmxGetDevTerminals, "DevTerminals", deviceName_, terminals);
+   if (error)
+   {
+      return LogError(error, "GetDevTerminals");
+   }
+   size_t index = std::string::npos;
+   do
+   {
+      std::string terminal = GetNextEntry(terminals, index);
+      AddAllowedValue(g_PropertyTriggerInput, terminal.c_str());
+      if (GetNumberOfPropertyValues(g_PropertyTriggerInput) == 1)
+      {
+         // Make this the default.
+         SetProperty(g_PropertyTriggerInput, terminal.c_str());
+      }
+   } while (index != std::string::npos);
+
+   // The task determines how many channels the list expands to.
+   error = GetOnDemandTask();
+   if (error)
+   {
+      return error;
+   }
+   error = DAQmxGetTaskNumChans(task_, &numChannels_);
+   if (error)
+   {
+      return LogError(error, "GetTaskNumChans");
+   }
+   volts_.assign(numChannels_, 0.0);
+   sequences_.assign(numChannels_, std::vector<float64>());
+
+   // Volts of each channel
+   for (uInt32 i = 0; i < numChannels_; ++i)
+   {
+      std::string name = g_PropertyVolts + boost::lexical_cast<std::string>(i);
+      CPropertyActionEx* pActEx = new CPropertyActionEx(this, &MultiAnalogO::OnVolts, i);
+      nRet = CreateProperty(name.c_str(), "0.0", MM::Float, false, pActEx);
+      if (nRet != DEVICE_OK)
+         return nRet;
+      SetPropertyLimits(name.c_str(), minV_, maxV_);
+   }
+
+   // Volts of all channels, comma-separated, written in a single update.
+   pAct = new CPropertyAction (this, &MultiAnalogO::OnAllVolts);
+   nRet = CreateProperty(g_PropertyAllVolts, "", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   // Whether or not hardware triggering is available.
+   supportsTriggering_ = (TestTriggering() == 0);
+   pAct = new CPropertyAction(this, &DAQDevice::OnSupportsTriggering);
+   nRet = CreateIntegerProperty(g_PropertyCanTrigger,
+      supportsTriggering_, true, pAct);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   nRet = WriteVolts();
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int MultiAnalogO::Shutdown()
+{
+   CancelTask();
+   sequenceRunning_ = false;
+
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+// All the channels of the list in one task.
+int MultiAnalogO::CreateOnDemandChannel()
+{
+   int error = DAQmxCreateAOVoltageChan(task_, channel_.c_str(), "",
+      minV_, maxV_, DAQmx_Val_Volts, "");
+   if (error)
+   {
+      return LogError(error, "CreateAOVoltageChan");
+   }
+   return DEVICE_OK;
+}
+
+// Write one sample on every channel: the values are interleaved and
+// the card updates all the channels at once.
+int MultiAnalogO::WriteVolts()
+{
+   if (sequenceRunning_)
+   {
+      // The task is clocked by the sequence
+      return DEVICE_OK;
+   }
+   int error = GetOnDemandTask();
+   if (error)
+   {
+      return error;
+   }
+   error = DAQmxWriteAnalogF64(task_, 1, 1, 10.0, DAQmx_Val_GroupByScanNumber,
+      &volts_[0], NULL, NULL);
+   if (error)
+   {
+      CancelTask();
+      return LogError(error, "WriteAnalogF64");
+   }
+   return DEVICE_OK;
+}
+
+// Start the sequences of all channels on a single sample clock. Channels
+// without a sequence hold their current value.
+int MultiAnalogO::StartSequence()
+{
+   if (sequenceRunning_)
+   {
+      // Already started by another channel
+      return DEVICE_OK;
+   }
+   size_t length = 0;
+   for (uInt32 i = 0; i < numChannels_; ++i)
+   {
+      if (sequences_[i].size() == 0)
+      {
+         continue;
+      }
+      if (length != 0 && sequences_[i].size() != length)
+      {
+         return ERR_SEQUENCE_MISMATCH;
+      }
+      length = sequences_[i].size();
+   }
+   if (length == 0)
+   {
+      return DEVICE_OK;
+   }
+
+   int error = SetupTask();
+   if (error)
+   {
+      return error;
+   }
+   error = CreateOnDemandChannel();
+   if (error)
+   {
+      return error;
+   }
+   error = SetupClockInput((int) length);
+   if (error)
+   {
+      return error;
+   }
+   error = LoadBuffer((long) length);
+   if (error)
+   {
+      return error;
+   }
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      return LogError(error, "StartTask");
+   }
+   amPreparedToTrigger_ = true;
+   sequenceRunning_ = true;
+   return DEVICE_OK;
+}
+
+int MultiAnalogO::StopSequence()
+{
+   if (!sequenceRunning_)
+   {
+      return DEVICE_OK;
+   }
+   CancelTask();
+   sequenceRunning_ = false;
+   for (uInt32 i = 0; i < numChannels_; ++i)
+   {
+      sequences_[i].clear();
+   }
+   // Restore the single-point values
+   return WriteVolts();
+}
+
+// Load the interleaved sequences of all channels onto the NI buffer.
+int MultiAnalogO::LoadBuffer(long numVals)
+{
+   std::vector<float64> values(numVals * numChannels_);
+   for (long k = 0; k < numVals; ++k)
+   {
+      for (uInt32 i = 0; i < numChannels_; ++i)
+      {
+         values[k * numChannels_ + i] =
+            sequences_[i].size() == 0 ? volts_[i] : sequences_[i][k];
+      }
+   }
+   int32 numWritten = 0;
+   int error = DAQmxWriteAnalogF64(task_, numVals, false, -1,
+      DAQmx_Val_GroupByScanNumber, &values[0], &numWritten, NULL);
+   if (error)
+   {
+      return LogError(error, "WriteAnalogF64");
+   }
+   if (numWritten != numVals)
+   {
+      LogMessage(("Didn't write complete analog sequence to buffer: wrote " +
+         boost::lexical_cast<string>(numWritten) + " of " +
+         boost::lexical_cast<string>(numVals) + " values").c_str());
+      return 1;
+   }
+   return DEVICE_OK;
+}
+
+// Attempt to set up a triggering task on all channels.
+int MultiAnalogO::TestTriggering()
+{
+   const long numVals = 100;
+   int error = SetupTask();
+   if (error)
+   {
+      return error;
+   }
+   error = CreateOnDemandChannel();
+   if (!error)
+   {
+      error = SetupClockInput(numVals);
+   }
+   if (!error)
+   {
+      for (uInt32 i = 0; i < numChannels_; ++i)
+      {
+         sequences_[i].resize(numVals);
+         for (long k = 0; k < numVals; ++k)
+         {
+            sequences_[i][k] = maxV_ / 10.0 * (k % 10);
+         }
+      }
+      error = LoadBuffer(numVals);
+      for (uInt32 i = 0; i < numChannels_; ++i)
+      {
+         sequences_[i].clear();
+      }
+   }
+   CancelTask();
+   return error;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int MultiAnalogO::OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct, long channel)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(volts_[channel]);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(volts_[channel]);
+      return WriteVolts();
+   }
+   else if (eAct == MM::IsSequenceable)
+   {
+      if (supportsTriggering_ && isTriggeringEnabled_)
+      {
+         pProp->SetSequenceable(maxSequenceLength_);
+      }
+      else
+      {
+         pProp->SetSequenceable(0);
+      }
+   }
+   else if (eAct == MM::AfterLoadSequence)
+   {
+      std::vector<std::string> sequence = pProp->GetSequence();
+      if (sequence.size() > (size_t) maxSequenceLength_)
+      {
+         return DEVICE_SEQUENCE_TOO_LARGE;
+      }
+      sequences_[channel].resize(sequence.size());
+      for (size_t i = 0; i < sequence.size(); ++i)
+      {
+         try
+         {
+            sequences_[channel][i] = boost::lexical_cast<float64>(sequence[i]);
+         }
+         catch (boost::bad_lexical_cast&)
+         {
+            sequences_[channel].clear();
+            return DEVICE_INVALID_PROPERTY_VALUE;
+         }
+         if (sequences_[channel][i] < minV_ || sequences_[channel][i] > maxV_)
+         {
+            sequences_[channel].clear();
+            return DEVICE_INVALID_PROPERTY_VALUE;
+         }
+      }
+   }
+   else if (eAct == MM::StartSequence)
+   {
+      return StartSequence();
+   }
+   else if (eAct == MM::StopSequence)
+   {
+      return StopSequence();
+   }
+
+   return DEVICE_OK;
+}
+
+int MultiAnalogO::OnAllVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      std::ostringstream txt;
+      for (uInt32 i = 0; i < numChannels_; ++i)
+      {
+         if (i > 0)
+         {
+            txt << ",";
+         }
+         txt << volts_[i];
+      }
+      pProp->Set(txt.str().c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string val;
+      pProp->Get(val);
+      std::vector<float64> volts;
+      std::istringstream list(val);
+      std::string entry;
+      while (std::getline(list, entry, ','))
+      {
+         try
+         {
+            volts.push_back(boost::lexical_cast<float64>(boost::algorithm::trim_copy(entry)));
+         }
+         catch (boost::bad_lexical_cast&)
+         {
+            return DEVICE_INVALID_PROPERTY_VALUE;
+         }
+         if (volts.back() < minV_ || volts.back() > maxV_)
+         {
+            return DEVICE_INVALID_PROPERTY_VALUE;
+         }
+      }
+      if (volts.size() != numChannels_)
+      {
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      volts_ = volts;
+      return WriteVolts();
+   }
+
+   return DEVICE_OK;
+}
+
+int MultiAnalogO::OnMinVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(minV_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(minV_);
+   }
+
+   return DEVICE_OK;
+}
+
+int MultiAnalogO::OnMaxVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(maxV_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(maxV_);
+   }
+
+   return DEVICE_OK;
+}
+
+int MultiAnalogO::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(channel_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(channel_);
+   }
+
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CounterO implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~
+
+CounterO::CounterO() :
+      initialized_(false), frequency_(1000.0), dutyCycle_(0.5), pulseCount_(0),
+      running_(false), sequenceRunning_(false)
+{
+   task_ = 0;
+   InitializeDefaultErrorMessages();
+
+   // add custom error messages
+   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
+   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
+   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
+   SetErrorText(ERR_SEQUENCE_MISMATCH, "The frequency and duty cycle sequences have different lengths");
+
+   // Output counter (e.g. "Dev1/ctr0"); the pulses come out of its
+   // default output terminal.
+   CPropertyAction* pAct = new CPropertyAction (this, &CounterO::OnChannel);
+   int nRet = CreateStringProperty(g_PropertyChannel, "devname", false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // Output port -- a more convenient version of the above.
+   pAct = new CPropertyAction(this, &CounterO::OnPort);
+   nRet = CreateStringProperty(g_PropertyPort, "devname", false, pAct, true);
+   std::vector<std::string> devices = GetDevices();
+   if (devices.size() == 0)
+   {
+      AddAllowedValue(g_PropertyPort, "No valid devices found");
+   }
+   else
+   {
+      AddAllowedValue(g_PropertyPort, g_UseCustom);
+      SetProperty(g_PropertyPort, g_UseCustom);
+   }
+
+   for (std::vector<string>::iterator i = devices.begin(); i != devices.end(); ++i) {
+      std::vector<string> ports = GetCounterOPortsForDevice(*i);
+      for (std::vector<string>::iterator j = ports.begin(); j != ports.end(); ++j) {
+         AddAllowedValue(g_PropertyPort, (*j).c_str());
+      }
+   }
+
+   pAct = new CPropertyAction(this, &DAQDevice::OnSequenceLength);
+   nRet = CreateStringProperty(g_PropertySequenceLength,
+      boost::lexical_cast<std::string>(maxSequenceLength_).c_str(), false, pAct, true);
+   assert(nRet == DEVICE_OK);
+}
+
+CounterO::~CounterO()
+{
+   Shutdown();
+}
+
+void CounterO::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameCounterO);
+}
+
+int CounterO::Initialize()
+{
+   SetContext(GetCoreCallback(), this);
+   SetDeviceName();
+
+   // Name
+   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameCounterO, MM::String, true);
+   if (DEVICE_OK != nRet)
+      return nRet;
+
+   // Description
+   nRet = CreateProperty(MM::g_Keyword_Description, "NI counter pulse train", MM::String, true);
+   if (DEVICE_OK != nRet)
+      return nRet;
+
+   // Manual triggering override.
+   CPropertyAction* pAct = new CPropertyAction(this, &DAQDevice::OnTriggeringEnabled);
+   nRet = CreateIntegerProperty(g_PropertyTriggeringEnabled, 0, false, pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Input trigger sample rate.
+   pAct = new CPropertyAction(this, &DAQDevice::OnSampleRate);
+   nRet = CreateIntegerProperty(g_PropertySampleRate, samplesPerSec_, false,
+         pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Input trigger line, advancing the sequences.
+   pAct = new CPropertyAction(this, &DAQDevice::OnInputTrigger);
+   nRet = CreateProperty(g_PropertyTriggerInput,
+      "", MM::String, false, pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Start trigger of the pulse train.
+   pAct = new CPropertyAction(this, &CounterO::OnStartTrigger);
+   nRet = CreateProperty(g_PropertyStartTrigger, g_StartImmediately, MM::String,
+      false, pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+   AddAllowedValue(g_PropertyStartTrigger, g_StartImmediately);
+
+   std::string terminals;
+   int error = QueryDevice(&DAQmxGetDevTerminals, "DevTerminals", deviceName_, terminals);
+   if (error)
+   {
+      return LogError(error, "GetDevTerminals");
+   }
+   size_t index = std::string::npos;
+   do
+   {
+      std::string terminal = GetNextEntry(terminals, index);
+      AddAllowedValue(g_PropertyTriggerInput, terminal.c_str());
+      AddAllowedValue(g_PropertyStartTrigger, terminal.c_str());
+      if (GetNumberOfPropertyValues(g_PropertyTriggerInput) == 1)
+      {
+         // Make this the default.
+         SetProperty(g_PropertyTriggerInput, terminal.c_str());
+      }
+   } while (index != std::string::npos);
+
+   // Frequency of the pulses, in Hz
+   pAct = new CPropertyAction (this, &CounterO::OnFrequency);
+   nRet = CreateProperty(g_PropertyFrequency,
+      boost::lexical_cast<std::string>(frequency_).c_str(), MM::Float, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   // Fraction of the period the output is high
+   pAct = new CPropertyAction (this, &CounterO::OnDutyCycle);
+   nRet = CreateProperty(g_PropertyDutyCycle,
+      boost::lexical_cast<std::string>(dutyCycle_).c_str(), MM::Float, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   // Number of pulses of the train, 0 for a continuous train
+   pAct = new CPropertyAction (this, &CounterO::OnPulseCount);
+   nRet = CreateIntegerProperty(g_PropertyPulseCount, pulseCount_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   // Generate the pulses. Setting it to Yes again restarts a finite train.
+   pAct = new CPropertyAction (this, &CounterO::OnRunning);
+   nRet = CreateProperty(g_PropertyRunning, g_No, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyRunning, g_No);
+   AddAllowedValue(g_PropertyRunning, g_Yes);
+
+   // Whether or not hardware triggering is available.
+   supportsTriggering_ = (TestTriggering() == 0);
+   pAct = new CPropertyAction(this, &DAQDevice::OnSupportsTriggering);
+   nRet = CreateIntegerProperty(g_PropertyCanTrigger,
+      supportsTriggering_, true, pAct);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int CounterO::Shutdown()
+{
+   CancelTask();
+   running_ = false;
+   sequenceRunning_ = false;
+
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+// A finite train started from software is busy until its last pulse.
+// Trains waiting for a start trigger are not, the trigger may never come.
+bool CounterO::Busy()
+{
+   if (!running_ || sequenceRunning_ || pulseCount_ == 0 || !startTrigger_.empty())
+   {
+      return false;
+   }
+   bool32 done = 1;
+   if (DAQmxIsTaskDone(task_, &done))
+   {
+      return false;
+   }
+   return done == 0;
+}
+
+int CounterO::CreateOnDemandChannel()
+{
+   int error = DAQmxCreateCOPulseChanFreq(task_, channel_.c_str(), "",
+      DAQmx_Val_Hz, DAQmx_Val_Low, 0.0, frequency_, dutyCycle_);
+   if (error)
+   {
+      return LogError(error, "CreateCOPulseChanFreq");
+   }
+   return DEVICE_OK;
+}
+
+// Start the pulse train with the current parameters. The counter
+// generates the pulses itself, there is no buffer to fill.
+int CounterO::StartPulses()
+{
+   int error = SetupTask();
+   if (error)
+   {
+      return error;
+   }
+   error = CreateOnDemandChannel();
+   if (error)
+   {
+      return error;
+   }
+   if (pulseCount_ > 0)
+   {
+      error = DAQmxCfgImplicitTiming(task_, DAQmx_Val_FiniteSamps, pulseCount_);
+   }
+   else
+   {
+      error = DAQmxCfgImplicitTiming(task_, DAQmx_Val_ContSamps, 1000);
+   }
+   if (error)
+   {
+      return LogError(error, "CfgImplicitTiming");
+   }
+   if (!startTrigger_.empty())
+   {
+      error = DAQmxCfgDigEdgeStartTrig(task_, startTrigger_.c_str(), DAQmx_Val_Rising);
+      if (error)
+      {
+         return LogError(error, "CfgDigEdgeStartTrig");
+      }
+   }
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      return LogError(error, "StartTask");
+   }
+   return DEVICE_OK;
+}
+
+// Apply a new frequency or duty cycle. A continuous train is updated
+// on the fly, from the end of the current pulse; a finite one restarts.
+int CounterO::UpdatePulses()
+{
+   if (!running_ || sequenceRunning_)
+   {
+      return DEVICE_OK;
+   }
+   if (pulseCount_ > 0)
+   {
+      return StartPulses();
+   }
+   int error = DAQmxWriteCtrFreqScalar(task_, false, 10.0, frequency_, dutyCycle_, NULL);
+   if (error)
+   {
+      running_ = false;
+      CancelTask();
+      return LogError(error, "WriteCtrFreqScalar");
+   }
+   return DEVICE_OK;
+}
+
+// Read a sequence of pulse parameters, each in the range (0, maxVal).
+int CounterO::LoadSequence(MM::PropertyBase* pProp, std::vector<float64>& sequence,
+   double maxVal)
+{
+   std::vector<std::string> values = pProp->GetSequence();
+   if (values.size() > (size_t) maxSequenceLength_)
+   {
+      return DEVICE_SEQUENCE_TOO_LARGE;
+   }
+   sequence.resize(values.size());
+   for (size_t i = 0; i < values.size(); ++i)
+   {
+      try
+      {
+         sequence[i] = boost::lexical_cast<float64>(values[i]);
+      }
+      catch (boost::bad_lexical_cast&)
+      {
+         sequence.clear();
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      if (sequence[i] <= 0.0 || sequence[i] >= maxVal)
+      {
+         sequence.clear();
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+   }
+   return DEVICE_OK;
+}
+
+// Start the sequences: each edge of the input trigger applies the
+// next frequency and duty cycle to the running train. A parameter
+// without a sequence keeps its current value.
+int CounterO::StartSequence()
+{
+   if (sequenceRunning_)
+   {
+      // Already started by the other property
+      return DEVICE_OK;
+   }
+   size_t length = frequencySequence_.size();
+   if (length == 0)
+   {
+      length = dutyCycleSequence_.size();
+   }
+   else if (dutyCycleSequence_.size() != 0 && dutyCycleSequence_.size() != length)
+   {
+      return ERR_SEQUENCE_MISMATCH;
+   }
+   if (length == 0)
+   {
+      return DEVICE_OK;
+   }
+
+   int error = SetupTask();
+   if (error)
+   {
+      return error;
+   }
+   error = CreateOnDemandChannel();
+   if (error)
+   {
+      return error;
+   }
+   error = SetupClockInput((int) length);
+   if (error)
+   {
+      return error;
+   }
+   error = LoadBuffer((long) length);
+   if (error)
+   {
+      return error;
+   }
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      return LogError(error, "StartTask");
+   }
+   amPreparedToTrigger_ = true;
+   sequenceRunning_ = true;
+   return DEVICE_OK;
+}
+
+int CounterO::StopSequence()
+{
+   if (!sequenceRunning_)
+   {
+      return DEVICE_OK;
+   }
+   CancelTask();
+   sequenceRunning_ = false;
+   frequencySequence_.clear();
+   dutyCycleSequence_.clear();
+   if (running_)
+   {
+      // Back to the train set from software
+      return StartPulses();
+   }
+   return DEVICE_OK;
+}
+
+// Load the pulse parameters of the sequences onto the NI buffer.
+int CounterO::LoadBuffer(long numVals)
+{
+   std::vector<float64> frequencies(numVals);
+   std::vector<float64> dutyCycles(numVals);
+   for (long k = 0; k < numVals; ++k)
+   {
+      frequencies[k] = frequencySequence_.size() == 0 ? frequency_ : frequencySequence_[k];
+      dutyCycles[k] = dutyCycleSequence_.size() == 0 ? dutyCycle_ : dutyCycleSequence_[k];
+   }
+   int32 numWritten = 0;
+   int error = DAQmxWriteCtrFreq(task_, numVals, false, 10.0,
+      DAQmx_Val_GroupByChannel, &frequencies[0], &dutyCycles[0], &numWritten, NULL);
+   if (error)
+   {
+      return LogError(error, "WriteCtrFreq");
+   }
+   if (numWritten != numVals)
+   {
+      LogMessage(("Didn't write complete pulse sequence to buffer: wrote " +
+         boost::lexical_cast<string>(numWritten) + " of " +
+         boost::lexical_cast<string>(numVals) + " values").c_str());
+      return 1;
+   }
+   return DEVICE_OK;
+}
+
+// Attempt to set up a triggering task on the counter.
+int CounterO::TestTriggering()
+{
+   const long numVals = 100;
+   int error = SetupTask();
+   if (error)
+   {
+      return error;
+   }
+   error = CreateOnDemandChannel();
+   if (!error)
+   {
+      error = SetupClockInput(numVals);
+   }
+   if (!error)
+   {
+      frequencySequence_.resize(numVals);
+      for (long k = 0; k < numVals; ++k)
+      {
+         frequencySequence_[k] = frequency_ * (k % 10 + 1) / 10.0;
+      }
+      error = LoadBuffer(numVals);
+      frequencySequence_.clear();
+   }
+   CancelTask();
+   if (running_ && !sequenceRunning_)
+   {
+      // The test replaced the task of the train
+      StartPulses();
+   }
+   return error;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int CounterO::OnFrequency(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(frequency_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double frequency;
+      pProp->Get(frequency);
+      if (frequency <= 0.0)
+      {
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      frequency_ = frequency;
+      return UpdatePulses();
+   }
+   else if (eAct == MM::IsSequenceable)
+   {
+      if (supportsTriggering_ && isTriggeringEnabled_)
+      {
+         pProp->SetSequenceable(maxSequenceLength_);
+      }
+      else
+      {
+         pProp->SetSequenceable(0);
+      }
+   }
+   else if (eAct == MM::AfterLoadSequence)
+   {
+      return LoadSequence(pProp, frequencySequence_, HUGE_VAL);
+   }
+   else if (eAct == MM::StartSequence)
+   {
+      return StartSequence();
+   }
+   else if (eAct == MM::StopSequence)
+   {
+      return StopSequence();
+   }
+
+   return DEVICE_OK;
+}
+
+int CounterO::OnDutyCycle(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(dutyCycle_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double dutyCycle;
+      pProp->Get(dutyCycle);
+      if (dutyCycle <= 0.0 || dutyCycle >= 1.0)
+      {
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      dutyCycle_ = dutyCycle;
+      return UpdatePulses();
+   }
+   else if (eAct == MM::IsSequenceable)
+   {
+      if (supportsTriggering_ && isTriggeringEnabled_)
+      {
+         pProp->SetSequenceable(maxSequenceLength_);
+      }
+      else
+      {
+         pProp->SetSequenceable(0);
+      }
+   }
+   else if (eAct == MM::AfterLoadSequence)
+   {
+      return LoadSequence(pProp, dutyCycleSequence_, 1.0);
+   }
+   else if (eAct == MM::StartSequence)
+   {
+      return StartSequence();
+   }
+   else if (eAct == MM::StopSequence)
+   {
+      return StopSequence();
+   }
+
+   return DEVICE_OK;
+}
+
+int CounterO::OnPulseCount(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(pulseCount_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long pulseCount;
+      pProp->Get(pulseCount);
+      if (pulseCount < 0)
+      {
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      pulseCount_ = pulseCount;
+      if (running_ && !sequenceRunning_)
+      {
+         return StartPulses();
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int CounterO::OnStartTrigger(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(startTrigger_.empty() ? g_StartImmediately : startTrigger_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string val;
+      pProp->Get(val);
+      startTrigger_ = (val.compare(g_StartImmediately) == 0) ? "" : val;
+      if (running_ && !sequenceRunning_)
+      {
+         return StartPulses();
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int CounterO::OnRunning(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(running_ ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string val;
+      pProp->Get(val);
+      running_ = (val.compare(g_Yes) == 0);
+      if (sequenceRunning_)
+      {
+         // Applied when the sequence stops
+         return DEVICE_OK;
+      }
+      if (!running_)
+      {
+         CancelTask();
+         return DEVICE_OK;
+      }
+      int error = StartPulses();
+      if (error)
+      {
+         running_ = false;
+         CancelTask();
+      }
+      return error;
+   }
+
+   return DEVICE_OK;
+}
+
+int CounterO::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(channel_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(channel_);
+   }
+
+   return DEVICE_OK;
+}
+
+int CounterO::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(port_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(port_);
+      if (strcmp(port_.c_str(), g_UseCustom) != 0)
+      {
+         // User wants to use one of our auto-detected counters.
+         channel_ = port_;
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AnalogI implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~
+
+AnalogI::AnalogI() :
+      busy_(false), minV_(0.0), maxV_(5.0), volts_(0.0), encoding_(0),
+      resolution_(0), thread_(0), continuous_(false), averaging_(g_AveragingNone),
+      window_(100), traceLength_(100), traceDecimation_(10), written_(0), average_(0.0),
+      acquisitionError_(0),
+      debugLog_(0), debugLogEnabled_(false), debugLogWritten_(0), debugLogStart_(0),
+      triggered_(false), triggeredFrames_(100),
+      samplesPerFrame_(1), samplesRead_(0), frameThread_(0)
+{
+   task_ = 0;
+   InitializeDefaultErrorMessages();
+
+   // add custom error messages
+   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
+   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
+   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
+   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
+
+   // Output channel, a.k.a. port.
+   CPropertyAction* pAct = new CPropertyAction (this, &AnalogI::OnChannel);
+   int nRet = CreateStringProperty(g_PropertyChannel, "devname", false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // Input port -- a more convenient version of the above for users that
+   // don't need to specify individual lines.
+   pAct = new CPropertyAction(this, &AnalogI::OnPort);
+   nRet = CreateStringProperty(g_PropertyPort, "devname", false, pAct, true);
+   std::vector<std::string> devices = GetDevices();
+   if (devices.size() == 0)
+   {
+      AddAllowedValue(g_PropertyPort, "No valid devices found");
+   }
+   else
+   {
+      AddAllowedValue(g_PropertyPort, g_UseCustom);
+      SetProperty(g_PropertyPort, g_UseCustom);
+   }
+
+   for (std::vector<string>::iterator i = devices.begin(); i != devices.end(); ++i) {
+      std::vector<string> ports = GetAnalogIPortsForDevice(*i);
+      for (std::vector<string>::iterator j = ports.begin(); j != ports.end(); ++j) {
+         AddAllowedValue(g_PropertyPort, (*j).c_str());
+      }
+   }
+
+
+   // MinVolts
+   // --------
+   pAct = new CPropertyAction (this, &AnalogI::OnMinVolts);
+   nRet = CreateProperty(g_PropertyMinVolts, "0.0", MM::Float, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+
+   // MaxVolts
+   // --------
+   pAct = new CPropertyAction (this, &AnalogI::OnMaxVolts);
+   nRet = CreateProperty(g_PropertyMaxVolts, "5.0", MM::Float, false, pAct, true);
+   assert(nRet == DEVICE_OK);
+}
+
+AnalogI::~AnalogI()
+{
+   Shutdown();
+   delete[] debugLog_;
+}
+
+void AnalogI::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameAnalogI);
+}
+
+
+int AnalogI::Initialize()
+{
+   SetContext(GetCoreCallback(), this);
+   SetDeviceName();
+   // set property list
+   // -----------------
+   char label[MM::MaxStrLength];
+   GetLabel(label);
+
+   // Name
+   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameAnalogI, MM::String, true);
+   if (DEVICE_OK != nRet)
+      return nRet;
+
+   // Description
+   nRet = CreateProperty(MM::g_Keyword_Description, "NI DAC", MM::String, true);
+   if (DEVICE_OK != nRet)
+      return nRet;
+
+   // Input trigger sample rate.
+   CPropertyAction* pAct = new CPropertyAction(this, &DAQDevice::OnSampleRate);
+   nRet = CreateIntegerProperty(g_PropertySampleRate, samplesPerSec_, false,
+         pAct, false);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // Volts
+   // -----
+   pAct = new CPropertyAction (this, &AnalogI::OnVolts);
+   nRet = CreateProperty(g_PropertyVolts, "0.0", MM::Float, true, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   //nRet = SetPropertyLimits(g_PropertyVolts, minV_, maxV_);
+   //assert(nRet == DEVICE_OK);
+
+   // Continuous acquisition at the sample rate, filling a ring buffer.
+   pAct = new CPropertyAction (this, &AnalogI::OnContinuous);
+   nRet = CreateProperty(g_PropertyContinuous, g_No, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyContinuous, g_No);
+   AddAllowedValue(g_PropertyContinuous, g_Yes);
+
+   // Averaging of the Volts value during continuous acquisition.
+   pAct = new CPropertyAction (this, &AnalogI::OnAveraging);
+   nRet = CreateProperty(g_PropertyAveraging, g_AveragingNone, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyAveraging, g_AveragingNone);
+   AddAllowedValue(g_PropertyAveraging, g_AveragingBoxcar);
+   AddAllowedValue(g_PropertyAveraging, g_AveragingExponential);
+
+   // Number of samples of the boxcar, or time constant (in samples) of
+   // the exponential average.
+   pAct = new CPropertyAction (this, &AnalogI::OnAveragingWindow);
+   nRet = CreateIntegerProperty(g_PropertyAveragingWindow, window_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits(g_PropertyAveragingWindow, 1, g_RingSize / 2);
+
+   // Decimated trace: the last TraceLength points, each the mean of
+   // TraceDecimation samples.
+   pAct = new CPropertyAction (this, &AnalogI::OnTrace);
+   nRet = CreateProperty(g_PropertyTrace, "", MM::String, true, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   pAct = new CPropertyAction (this, &AnalogI::OnTraceLength);
+   nRet = CreateIntegerProperty(g_PropertyTraceLength, traceLength_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits(g_PropertyTraceLength, 1, 1000);
+
+   pAct = new CPropertyAction (this, &AnalogI::OnTraceDecimation);
+   nRet = CreateIntegerProperty(g_PropertyTraceDecimation, traceDecimation_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits(g_PropertyTraceDecimation, 1, 1000);
+
+   // Input trigger line of the triggered acquisition.
+   pAct = new CPropertyAction(this, &DAQDevice::OnInputTrigger);
+   nRet = CreateProperty(g_PropertyTriggerInput, "", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   std::string terminals;
+   int error = QueryDevice(&DAQmxGetDevTerminals, "DevTerminals", deviceName_, terminals);
+   if (error)
+   {
+      return LogError(error, "GetDevTerminals");
+   }
+   size_t index = std::string::npos;
+   do
+   {
+      std::string terminal = GetNextEntry(terminals, index);
+      AddAllowedValue(g_PropertyTriggerInput, terminal.c_str());
+      if (GetNumberOfPropertyValues(g_PropertyTriggerInput) == 1)
+      {
+         // Make this the default.
+         SetProperty(g_PropertyTriggerInput, terminal.c_str());
+      }
+   } while (index != std::string::npos);
+
+   // Hardware-timed acquisition of TriggeredFrames frames, one per
+   // trigger. Each frame is one sample, or a block of SamplesPerFrame
+   // samples at the sample rate.
+   pAct = new CPropertyAction (this, &AnalogI::OnTriggeredAcquisition);
+   nRet = CreateProperty(g_PropertyTriggeredAcquisition, g_TriggeredIdle, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyTriggeredAcquisition, g_TriggeredIdle);
+   AddAllowedValue(g_PropertyTriggeredAcquisition, g_TriggeredArmed);
+
+   pAct = new CPropertyAction (this, &AnalogI::OnTriggeredFrames);
+   nRet = CreateIntegerProperty(g_PropertyTriggeredFrames, triggeredFrames_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits(g_PropertyTriggeredFrames, 1, g_MaxTriggeredFrames);
+
+   pAct = new CPropertyAction (this, &AnalogI::OnSamplesPerFrame);
+   nRet = CreateIntegerProperty(g_PropertySamplesPerFrame, samplesPerFrame_, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits(g_PropertySamplesPerFrame, 1, g_MaxSamplesPerFrame);
+
+   pAct = new CPropertyAction (this, &AnalogI::OnFramesAcquired);
+   nRet = CreateIntegerProperty(g_PropertyFramesAcquired, 0, true, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   // Mean of each acquired frame.
+   pAct = new CPropertyAction (this, &AnalogI::OnFrameValues);
+   nRet = CreateProperty(g_PropertyFrameValues, "", MM::String, true, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   // Timing of the on-demand calls and of the sequence loads.
+   nRet = CreateStatisticsProperties(this);
+   if (DEVICE_OK != nRet)
+   {
+      return nRet;
+   }
+
+   // In-memory log of the reads, off by default. It is kept out of the
+   // core log to avoid adding jitter to the reads.
+   pAct = new CPropertyAction (this, &AnalogI::OnDebugLog);
+   nRet = CreateProperty(g_PropertyDebugLog, g_No, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyDebugLog, g_No);
+   AddAllowedValue(g_PropertyDebugLog, g_Yes);
+
+   pAct = new CPropertyAction (this, &AnalogI::OnDumpDebugLog);
+   nRet = CreateProperty(g_PropertyDumpDebugLog, "Idle", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyDumpDebugLog, "Idle");
+   AddAllowedValue(g_PropertyDumpDebugLog, "Dump");
+
+   // set up task
+   // -----------
+      int niRet = GetOnDemandTask();
+      if (niRet)
+      {
+          return niRet;
+      }
+
+   Trace("Initialize: task ready");
+
+   nRet = UpdateStatus();
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   initialized_ = true;
+
+   return DEVICE_OK;
+}
+
+int AnalogI::Shutdown()
+{
+   StopTriggered();
+   StopContinuous();
+   CancelTask();
+
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+int AnalogI::GetSignal(double& volts)
+{
+	// During continuous acquisition the value comes from the ring buffer
+	if (continuous_)
+	{
+		// The ring buffer is not updated anymore
+		int error = acquisitionError_.load();
+		if (error)
+		{
+			return error;
+		}
+		unsigned long written = written_.load(std::memory_order_acquire);
+		if (written == 0)
+		{
+			volts = volts_;
+		}
+		else if (averaging_ == g_AveragingBoxcar)
+		{
+			volts = GetBoxcarAverage(window_);
+		}
+		else if (averaging_ == g_AveragingExponential)
+		{
+			volts = average_.load();
+		}
+		else
+		{
+			volts = ring_[(written - 1) % g_RingSize];
+		}
+		return DEVICE_OK;
+	}
+
+	// The task is busy with the triggered acquisition
+	if (triggered_)
+	{
+		MMThreadGuard guard(framesLock_);
+		volts = volts_;
+		return DEVICE_OK;
+	}
+
+	// the task is created once and reused for every read
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	long niRet = GetOnDemandTask();
+	if(niRet)
+		return niRet;
+
+	float64 read[1];
+	niRet = DAQmxReadAnalogF64(task_, 1, 10.0, DAQmx_Val_GroupByChannel, read, 1, NULL, NULL);
+	if(niRet){
+		Trace("GetSignal: read failed", niRet);
+		CancelTask();
+		return LogError(niRet, "ReadAnalogF64");
+	}
+
+	volts = read[0];
+	RecordCall(start);
+	Trace("GetSignal: V", volts);
+
+	return DEVICE_OK;
+}
+
+// Channel of the task used for the reads.
+int AnalogI::CreateOnDemandChannel()
+{
+   // here the terminal has been chosen to default, see NI manual for other choices
+   int error = DAQmxCreateAIVoltageChan(task_, channel_.c_str(), "", DAQmx_Val_Cfg_Default,
+      minV_, maxV_, DAQmx_Val_Volts, "");
+   if (error)
+   {
+      return LogError(error, "CreateAIVoltageChan");
+   }
+   return DEVICE_OK;
+}
+
+// Set up a hardware-clocked continuous acquisition and start the thread
+// moving the samples into the ring buffer.
+int AnalogI::StartContinuous()
+{
+   StopTriggered();
+   int error = SetupTask();
+   if (error)
+   {
+      return error;
+   }
+   error = CreateOnDemandChannel();
+   if (error)
+   {
+      return error;
+   }
+   // The DAQmx buffer holds one second of samples
+   error = DAQmxCfgSampClkTiming(task_, "", samplesPerSec_,
+      DAQmx_Val_Rising, DAQmx_Val_ContSamps, samplesPerSec_);
+   if (error)
+   {
+      CancelTask();
+      return LogError(error, "CfgSampClkTiming");
+   }
+
+   long blockSize = (long) (samplesPerSec_ * g_BlockDuration);
+   block_.resize(blockSize > 0 ? blockSize : 1);
+   ring_.resize(g_RingSize);
+   written_.store(0);
+   acquisitionError_.store(0);
+
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      CancelTask();
+      return LogError(error, "StartTask");
+   }
+
+   thread_ = new AnalogIAcquisitionThread(*this);
+   thread_->Start();
+   continuous_ = true;
+   return DEVICE_OK;
+}
+
+void AnalogI::StopContinuous()
+{
+   continuous_ = false;
+   if (thread_ != 0)
+   {
+      delete thread_;
+      thread_ = 0;
+   }
+   // The next on-demand read rebuilds its task
+   CancelTask();
+}
+
+// Arm a hardware-timed acquisition of triggeredFrames_ frames, each
+// started by an edge on inputTrigger_. With a single sample per frame
+// the trigger is the sample clock; larger frames are blocks clocked at
+// samplesPerSec_ by a retriggerable start trigger.
+int AnalogI::StartTriggered()
+{
+   StopContinuous();
+   StopTriggered();
+   int error = SetupTask();
+   if (error)
+   {
+      return error;
+   }
+   error = CreateOnDemandChannel();
+   if (error)
+   {
+      return error;
+   }
+   long total = triggeredFrames_ * samplesPerFrame_;
+   if (samplesPerFrame_ == 1)
+   {
+      // Finite, so that triggers after the last frame are ignored
+      // instead of overflowing the buffer
+      error = SetupClockInput((int) total, DAQmx_Val_FiniteSamps);
+      if (error)
+      {
+         CancelTask();
+         return error;
+      }
+   }
+   else
+   {
+      error = DAQmxCfgSampClkTiming(task_, "", samplesPerSec_,
+         DAQmx_Val_Rising, DAQmx_Val_FiniteSamps, samplesPerFrame_);
+      if (error)
+      {
+         CancelTask();
+         return LogError(error, "CfgSampClkTiming");
+      }
+      error = DAQmxCfgDigEdgeStartTrig(task_, inputTrigger_.c_str(), DAQmx_Val_Rising);
+      if (error)
+      {
+         CancelTask();
+         return LogError(error, "CfgDigEdgeStartTrig");
+      }
+      error = DAQmxSetStartTrigRetriggerable(task_, true);
+      if (error)
+      {
+         CancelTask();
+         return LogError(error, "SetStartTrigRetriggerable");
+      }
+      error = DAQmxCfgInputBuffer(task_, (uInt32) total);
+      if (error)
+      {
+         CancelTask();
+         return LogError(error, "CfgInputBuffer");
+      }
+   }
+
+   frameSamples_.resize(total);
+   samplesRead_ = 0;
+
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      CancelTask();
+      return LogError(error, "StartTask");
+   }
+   triggered_ = true;
+   if (samplesPerFrame_ > 1)
+   {
+      // The retriggerable task never completes by itself
+      frameThread_ = new AnalogIFrameThread(*this);
+      frameThread_->Start();
+   }
+   return DEVICE_OK;
+}
+
+// Stop the triggered acquisition, keeping the frames acquired so far.
+void AnalogI::StopTriggered()
+{
+   if (frameThread_ != 0)
+   {
+      delete frameThread_;
+      frameThread_ = 0;
+   }
+   if (!triggered_)
+   {
+      return;
+   }
+   CollectFrames();
+   triggered_ = false;
+   CancelTask();
+}
+
+// Move the samples acquired since the last call into frameSamples_,
+// without waiting. The task is released once all frames are in, or
+// on an error, keeping the frames read so far.
+int AnalogI::CollectFrames()
+{
+   MMThreadGuard guard(framesLock_);
+   if (!triggered_)
+   {
+      return DEVICE_OK;
+   }
+   uInt32 available = 0;
+   int error = DAQmxGetReadAvailSampPerChan(task_, &available);
+   if (error)
+   {
+      error = LogError(error, "GetReadAvailSampPerChan");
+      // Done with task_ before the other threads see the acquisition stopped
+      CancelTask();
+      triggered_ = false;
+      return error;
+   }
+   long remaining = (long) frameSamples_.size() - samplesRead_;
+   if ((long) available > remaining)
+   {
+      available = (uInt32) remaining;
+   }
+   if (available > 0)
+   {
+      int32 read = 0;
+      error = DAQmxReadAnalogF64(task_, (int32) available, 0.0, DAQmx_Val_GroupByScanNumber,
+         &frameSamples_[samplesRead_], available, &read, NULL);
+      if (error)
+      {
+         error = LogError(error, "ReadAnalogF64");
+         CancelTask();
+         triggered_ = false;
+         return error;
+      }
+      samplesRead_ += read;
+      if (read > 0)
+      {
+         volts_ = frameSamples_[samplesRead_ - 1];
+      }
+   }
+   if (samplesRead_ == (long) frameSamples_.size())
+   {
+      CancelTask();
+      triggered_ = false;
+   }
+   return DEVICE_OK;
+}
+
+// Mean of each complete frame, comma-separated.
+std::string AnalogI::GetFrameValues()
+{
+   MMThreadGuard guard(framesLock_);
+   std::ostringstream values;
+   long frames = samplesRead_ / samplesPerFrame_;
+   for (long f = 0; f < frames; ++f)
+   {
+      double sum = 0.0;
+      for (long k = 0; k < samplesPerFrame_; ++k)
+      {
+         sum += frameSamples_[f * samplesPerFrame_ + k];
+      }
+      if (f > 0)
+      {
+         values << ",";
+      }
+      values << sum / samplesPerFrame_;
+   }
+   return values.str();
+}
+
+// Read the samples acquired since the last call, waiting at most for
+// one block.
+int AnalogI::AcquireSamples()
+{
+   int32 read = 0;
+   int error = DAQmxReadAnalogF64(task_, (int32) block_.size(), 1.0,
+      DAQmx_Val_GroupByScanNumber, &block_[0], (uInt32) block_.size(), &read, NULL);
+   if (error)
+   {
+      // Stops the thread, reported by GetSignal
+      error = LogError(error, "ReadAnalogF64");
+      acquisitionError_.store(error);
       return error;
    }
-   return LoadBuffer(sequence, numVals);
+
+   unsigned long written = written_.load(std::memory_order_relaxed);
+   double average = average_.load(std::memory_order_relaxed);
+   double alpha = 1.0 / window_;
+   for (int32 i = 0; i < read; ++i)
+   {
+      ring_[(written + i) % g_RingSize] = block_[i];
+      average = (written + i == 0) ? block_[i] : average + alpha * (block_[i] - average);
+   }
+   average_.store(average);
+   written_.store(written + read, std::memory_order_release);
+   return DEVICE_OK;
 }
 
-// Load a sequence of outputs onto NI's buffer.
-int DigitalO::LoadBuffer(uInt32* sequence, long numVals)
+// Mean of the last samples of the ring buffer.
+double AnalogI::GetBoxcarAverage(long window)
 {
-   int32 numWritten = 0;
-   // Wait 10s for writing to complete (maybe should vary based on length of
-   // data being written?)
-   int error = DAQmxWriteDigitalU32(task_, numVals, false, 10,
-       DAQmx_Val_GroupByScanNumber, sequence, &numWritten, NULL);
-   if (error)
+   for (;;)
    {
-       return LogError(error, "WriteDigitalU32");
+      unsigned long written = written_.load(std::memory_order_acquire);
+      unsigned long n = written < (unsigned long) window ? written : window;
+      if (n == 0)
+      {
+         return volts_;
+      }
+      double sum = 0.0;
+      for (unsigned long k = written - n; k < written; ++k)
+      {
+         sum += ring_[k % g_RingSize];
+      }
+      // Retry if the acquisition thread overwrote the oldest samples in the meantime
+      if (written_.load(std::memory_order_acquire) - (written - n) <= g_RingSize)
+      {
+         return sum / n;
+      }
    }
-   if (numWritten != numVals)
+}
+
+// Comma-separated list of the decimated trace, oldest point first.
+std::string AnalogI::GetTrace()
+{
+   for (;;)
    {
-       LogMessage(("Didn't write all of sequence; wrote only " + boost::lexical_cast<std::string>(numWritten)).c_str());
-       return 1;
+      unsigned long written = written_.load(std::memory_order_acquire);
+      unsigned long points = written / traceDecimation_;
+      if (points > (unsigned long) traceLength_)
+      {
+         points = traceLength_;
+      }
+      if (points * traceDecimation_ > g_RingSize)
+      {
+         points = g_RingSize / traceDecimation_;
+      }
+
+      std::ostringstream trace;
+      unsigned long start = written - points * traceDecimation_;
+      for (unsigned long p = 0; p < points; ++p)
+      {
+         double sum = 0.0;
+         for (long k = 0; k < traceDecimation_; ++k)
+         {
+            sum += ring_[(start + p * traceDecimation_ + k) % g_RingSize];
+         }
+         if (p > 0)
+         {
+            trace << ",";
+         }
+         trace << sum / traceDecimation_;
+      }
+      // Retry if the acquisition thread overwrote the oldest samples in the meantime
+      if (written_.load(std::memory_order_acquire) - start <= g_RingSize)
+      {
+         return trace.str();
+      }
    }
-   return 0;
 }
 
-// Test whether triggering is possible, by attempting to set up a
-// dummy trigger sequence.
-int DigitalO::TestTriggering()
+// Record an event in the debug log. Writers only claim a slot with an
+// atomic increment, so the reads are never blocked by the log.
+void AnalogI::Trace(const char* event, double value)
+{
+   if (!debugLogEnabled_.load(std::memory_order_acquire))
+   {
+      return;
+   }
+   unsigned long index = debugLogWritten_.fetch_add(1);
+   DebugLogEntry& entry = debugLog_[index % g_DebugLogSize];
+   entry.sequence.store(0, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+   entry.event.store(event, std::memory_order_relaxed);
+   entry.value.store(value, std::memory_order_relaxed);
+   entry.time.store(GetCurrentMMTime().getMsec(), std::memory_order_relaxed);
+   entry.sequence.store(index + 1, std::memory_order_release);
+}
+
+// Write the debug log to the core log, oldest event first.
+void AnalogI::DumpTrace()
+{
+   unsigned long written = debugLogWritten_.load();
+   unsigned long n = written - debugLogStart_;
+   if (n > g_DebugLogSize)
+   {
+      n = g_DebugLogSize;
+   }
+   for (unsigned long k = written - n; k < written; ++k)
+   {
+      // Skip the entries being written or already overwritten
+      const DebugLogEntry& entry = debugLog_[k % g_DebugLogSize];
+      unsigned long sequence = entry.sequence.load(std::memory_order_acquire);
+      if (sequence != k + 1)
+      {
+         continue;
+      }
+      const char* event = entry.event.load(std::memory_order_relaxed);
+      double value = entry.value.load(std::memory_order_relaxed);
+      double time = entry.time.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (entry.sequence.load(std::memory_order_relaxed) != sequence)
+      {
+         continue;
+      }
+      ostringstream txt;
+      txt << "AnalogI " << time << " ms: " << event << " " << value;
+      LogMessage(txt.str(), false);
+   }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int AnalogI::OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+		double v;
+		int ret = GetSignal(v);
+		if (ret != DEVICE_OK)
+			return ret;
+
+		pProp->Set(v);
+		volts_ = v;
+   }
+   return DEVICE_OK;
+}
+
+int AnalogI::OnMinVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(minV_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(minV_);
+      // The channel limits are part of the task
+      onDemandReady_ = false;
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnMaxVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(maxV_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(maxV_);
+      // The channel limits are part of the task
+      onDemandReady_ = false;
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnContinuous(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(continuous_ ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      string val;
+      pProp->Get(val);
+      bool continuous = (val.compare(g_Yes) == 0);
+      if (continuous == continuous_)
+      {
+         return DEVICE_OK;
+      }
+      if (continuous)
+      {
+         int error = StartContinuous();
+         if (error)
+         {
+            pProp->Set(g_No);
+            return error;
+         }
+      }
+      else
+      {
+         StopContinuous();
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnAveraging(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(averaging_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(averaging_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnAveragingWindow(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(window_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(window_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnTrace(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(GetTrace().c_str());
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnTraceLength(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(traceLength_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(traceLength_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnTraceDecimation(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(traceDecimation_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(traceDecimation_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnTriggeredAcquisition(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      CollectFrames();
+      pProp->Set(triggered_ ? g_TriggeredArmed : g_TriggeredIdle);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      string val;
+      pProp->Get(val);
+      if (val.compare(g_TriggeredArmed) == 0)
+      {
+         int error = StartTriggered();
+         if (error)
+         {
+            pProp->Set(g_TriggeredIdle);
+            return error;
+         }
+      }
+      else
+      {
+         StopTriggered();
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnTriggeredFrames(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(triggeredFrames_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      // Used by the next acquisition
+      pProp->Get(triggeredFrames_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnSamplesPerFrame(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(samplesPerFrame_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (triggered_)
+      {
+         // The frames being acquired have the current size
+         return DEVICE_CAN_NOT_SET_PROPERTY;
+      }
+      pProp->Get(samplesPerFrame_);
+      samplesRead_ = 0;
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnFramesAcquired(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      CollectFrames();
+      MMThreadGuard guard(framesLock_);
+      pProp->Set(samplesRead_ / samplesPerFrame_);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnFrameValues(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      CollectFrames();
+      pProp->Set(GetFrameValues().c_str());
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnDebugLog(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(debugLogEnabled_ ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      string val;
+      pProp->Get(val);
+      bool enabled = (val.compare(g_Yes) == 0);
+      if (enabled && !debugLogEnabled_)
+      {
+         // The log is allocated once and kept until the device is
+         // deleted, writers may still be using it after it is disabled.
+         if (debugLog_ == 0)
+         {
+            debugLog_ = new DebugLogEntry[g_DebugLogSize]();
+         }
+         debugLogStart_ = debugLogWritten_.load();
+      }
+      debugLogEnabled_.store(enabled, std::memory_order_release);
+   }
+
+   return DEVICE_OK;
+}
+
+int AnalogI::OnDumpDebugLog(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-   int numSamples = 32;
-   uInt32 *sequence = new uInt32[numSamples];
-   for (int i = 0; i < numSamples; ++i)
+   if (eAct == MM::BeforeGet)
    {
-       sequence[i] = i % 16;
+      pProp->Set("Idle");
    }
-   int result = SetupDigitalTriggering(sequence, numSamples);
-   delete sequence;
-   return result;
+   else if (eAct == MM::AfterSet)
+   {
+      string val;
+      pProp->Get(val);
+      if (val.compare("Dump") == 0)
+      {
+         DumpTrace();
+         pProp->Set("Idle");
+      }
+   }
+
+   return DEVICE_OK;
 }
 
-int DigitalO::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
+int AnalogI::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
    {
@@ -822,7 +5351,7 @@ int DigitalO::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
-int DigitalO::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
+int AnalogI::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
    {
@@ -843,30 +5372,29 @@ int DigitalO::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// AnalogO implementation
+// DigitalI implementation
 // ~~~~~~~~~~~~~~~~~~~~~~~
 
-AnalogO::AnalogO() :
-      busy_(false), disable_(false), minV_(0.0), maxV_(5.0), volts_(0.0), gatedVolts_(0.0), encoding_(0),
-      resolution_(0), gateOpen_(true), demo_(false)
+DigitalI::DigitalI() :
+      initialized_(false), numLines_(0), edges_(g_EdgesBoth), notifyChanges_(false),
+      thread_(0), detecting_(false), timestampTask_(0), lastTicks_(0), ticks_(0),
+      lastHostTime_(0.0), written_(0), state_(0)
 {
    task_ = 0;
    InitializeDefaultErrorMessages();
 
    // add custom error messages
-   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
    SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
-   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
    SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
 
-   // Output channel, a.k.a. port.
-   CPropertyAction* pAct = new CPropertyAction (this, &AnalogO::OnChannel);
+   // Input lines (e.g. "Dev1/port0/line0:3"), one bit of the states each.
+   CPropertyAction* pAct = new CPropertyAction (this, &DigitalI::OnChannel);
    int nRet = CreateStringProperty(g_PropertyChannel, "devname", false, pAct, true);
    assert(nRet == DEVICE_OK);
 
-   // Output port -- a more convenient version of the above for users that
+   // Input port -- a more convenient version of the above for users that
    // don't need to specify individual lines.
-   pAct = new CPropertyAction(this, &AnalogO::OnPort);
+   pAct = new CPropertyAction(this, &DigitalI::OnPort);
    nRet = CreateStringProperty(g_PropertyPort, "devname", false, pAct, true);
    std::vector<std::string> devices = GetDevices();
    if (devices.size() == 0)
@@ -878,486 +5406,632 @@ AnalogO::AnalogO() :
       AddAllowedValue(g_PropertyPort, g_UseCustom);
       SetProperty(g_PropertyPort, g_UseCustom);
    }
+
    for (std::vector<string>::iterator i = devices.begin(); i != devices.end(); ++i) {
-      std::vector<string> ports = GetAnalogOPortsForDevice(*i);
+      std::vector<string> ports = GetDigitalIPortsForDevice(*i);
       for (std::vector<string>::iterator j = ports.begin(); j != ports.end(); ++j) {
          AddAllowedValue(g_PropertyPort, (*j).c_str());
       }
    }
-
-   pAct = new CPropertyAction(this, &DAQDevice::OnSequenceLength);
-   nRet = CreateStringProperty(g_PropertySequenceLength,
-      boost::lexical_cast<std::string>(maxSequenceLength_).c_str(), false, pAct, true);
-   assert(nRet == DEVICE_OK);
-
-   // demo
-   pAct = new CPropertyAction (this, &AnalogO::OnDemo);
-   nRet = CreateProperty(g_PropertyDemo, g_No, MM::String, false, pAct, true);
-   assert(nRet == DEVICE_OK);
-   AddAllowedValue(g_PropertyDemo, g_No);
-   AddAllowedValue(g_PropertyDemo, g_Yes);
-
-   // MinVolts
-   // --------
-   pAct = new CPropertyAction (this, &AnalogO::OnMinVolts);
-   nRet = CreateProperty(g_PropertyMinVolts, "0.0", MM::Float, false, pAct, true);
-   assert(nRet == DEVICE_OK);
-
-   // MaxVolts
-   // --------
-   pAct = new CPropertyAction (this, &AnalogO::OnMaxVolts);
-   nRet = CreateProperty(g_PropertyMaxVolts, "5.0", MM::Float, false, pAct, true);
-   assert(nRet == DEVICE_OK);
 }
 
-AnalogO::~AnalogO()
+DigitalI::~DigitalI()
 {
    Shutdown();
 }
 
-void AnalogO::GetName(char* name) const
+void DigitalI::GetName(char* name) const
 {
-   CDeviceUtils::CopyLimitedString(name, g_DeviceNameAnalogO);
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameDigitalI);
 }
 
-
-int AnalogO::Initialize()
+int DigitalI::Initialize()
 {
    SetContext(GetCoreCallback(), this);
    SetDeviceName();
-   // set property list
-   // -----------------
-   char label[MM::MaxStrLength];
-   GetLabel(label);
-   
+
    // Name
-   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameAnalogO, MM::String, true);
+   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameDigitalI, MM::String, true);
    if (DEVICE_OK != nRet)
       return nRet;
 
    // Description
-   nRet = CreateProperty(MM::g_Keyword_Description, "NI DAC", MM::String, true);
-   if (DEVICE_OK != nRet)
-      return nRet;
-
-   // TODO: this and the following property are copy/pasted in the DigitalO
-   // and AnalogO classes.
-   // Manual triggering override.
-   CPropertyAction* pAct = new CPropertyAction(this, &DAQDevice::OnTriggeringEnabled);
-   nRet = CreateIntegerProperty(g_PropertyTriggeringEnabled, 0, false, pAct, false);
+   nRet = CreateProperty(MM::g_Keyword_Description, "NI digital input", MM::String, true);
    if (DEVICE_OK != nRet)
-   {
       return nRet;
-   }
 
-   // Input trigger sample rate.
-   pAct = new CPropertyAction(this, &DAQDevice::OnSampleRate);
-   nRet = CreateIntegerProperty(g_PropertySampleRate, samplesPerSec_, false,
-         pAct, false);
-   if (DEVICE_OK != nRet)
+   // set up task
+   // -----------
+   nRet = GetOnDemandTask();
+   if (nRet)
    {
       return nRet;
    }
-
-   // Input trigger line.
-   pAct = new CPropertyAction(this, &DAQDevice::OnInputTrigger);
-   nRet = CreateProperty(g_PropertyTriggerInput,
-      "", MM::String, false, pAct, false);
-   if (DEVICE_OK != nRet)
+   nRet = DAQmxGetTaskNumChans(task_, &numLines_);
+   if (nRet)
    {
-      return nRet;
+      return LogError(nRet, "GetTaskNumChans");
    }
-   char terminalsBuf[4096];
-    int error = DAQmxGetDevTerminals(deviceName_.c_str(), terminalsBuf, 4096);
-   if (error)
+   if (numLines_ > g_MaxDigitalInputLines)
    {
-      return LogError(error, "GetDevTerminals");
+      LogMessage("DigitalI supports at most 32 lines");
+      return ERR_INITIALIZE_FAILED;
    }
-   std::string terminals = terminalsBuf;
-   size_t index = std::string::npos;
-   do
-   {
-      std::string terminal = GetNextEntry(terminals, index);
-      AddAllowedValue(g_PropertyTriggerInput, terminal.c_str());
-      if (GetNumberOfPropertyValues(g_PropertyTriggerInput) == 1)
-      {
-         // Make this the default.
-         SetProperty(g_PropertyTriggerInput, terminal.c_str());
-      }
-   } while (index != std::string::npos);
+   edgeCounts_.assign(numLines_, 0);
+   lastEdges_.assign(numLines_, -1.0);
 
-   // Whether or not hardware triggering is available. Determined by
-   // attempting to set up a triggering task and erroring if it
-   // fails.
-   supportsTriggering_ = (TestTriggering() == 0);
-   pAct = new CPropertyAction(this, &DAQDevice::OnSupportsTriggering);
-   nRet = CreateIntegerProperty(g_PropertyCanTrigger,
-      supportsTriggering_, true, pAct);
-   if (DEVICE_OK != nRet)
-   {
+   // States of the lines, bit i for line i
+   CPropertyAction* pAct = new CPropertyAction (this, &DigitalI::OnLineStates);
+   nRet = CreateIntegerProperty(g_PropertyLineStates, 0, true, pAct);
+   if (nRet != DEVICE_OK)
       return nRet;
-   }
 
-   // Volts
-   // -----
-   pAct = new CPropertyAction (this, &AnalogO::OnVolts);
-   nRet = CreateProperty(g_PropertyVolts, "0.0", MM::Float, false, pAct);
+   // Timestamp the changes of the lines into the ring buffer
+   pAct = new CPropertyAction (this, &DigitalI::OnChangeDetection);
+   nRet = CreateProperty(g_PropertyChangeDetection, g_No, MM::String, false, pAct);
    if (nRet != DEVICE_OK)
       return nRet;
+   AddAllowedValue(g_PropertyChangeDetection, g_No);
+   AddAllowedValue(g_PropertyChangeDetection, g_Yes);
 
-   nRet = SetPropertyLimits(g_PropertyVolts, minV_, maxV_);
-   assert(nRet == DEVICE_OK);
-
-    //Disable
-    pAct = new CPropertyAction (this, &AnalogO::OnDisable);
-    nRet = CreateProperty(g_PropertyDisable, "false", MM::String, false, pAct);
-    AddAllowedValue(g_PropertyDisable, "false");
-    AddAllowedValue(g_PropertyDisable, "true");
-    assert(nRet == DEVICE_OK);
-
-
-   // set up task
-   // -----------
-   if (!demo_)
-   {
-      int niRet = SetupTask();
-      if (niRet)
-      {
-          return niRet;
-      }
-      niRet = DAQmxCreateAOVoltageChan(task_, channel_.c_str(), "", minV_, maxV_, DAQmx_Val_Volts, "");
-      if (niRet != DAQmxSuccess)
-      {
-         return LogError(niRet, "CreateAOVoltageChan");
-      }
-
-       niRet = DAQmxStartTask(task_);
-       if (niRet)
-       {
-           return LogError(niRet, "StartTask");
-       }
-   }
-
-   nRet = UpdateStatus();
+   // Edges counted, and timed by the last edges
+   pAct = new CPropertyAction (this, &DigitalI::OnEdges);
+   nRet = CreateProperty(g_PropertyEdges, edges_.c_str(), MM::String, false, pAct);
    if (nRet != DEVICE_OK)
       return nRet;
+   AddAllowedValue(g_PropertyEdges, g_EdgesRising);
+   AddAllowedValue(g_PropertyEdges, g_EdgesFalling);
+   AddAllowedValue(g_PropertyEdges, g_EdgesBoth);
+
+   // Counter timestamping the changes on the card, None to use the
+   // host clock when the changes are read
+   pAct = new CPropertyAction (this, &DigitalI::OnTimestampCounter);
+   nRet = CreateProperty(g_PropertyTimestampCounter, g_TimestampHostClock, MM::String,
+      false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyTimestampCounter, g_TimestampHostClock);
 
-   initialized_ = true;
-
-   return DEVICE_OK;
-}
-
-int AnalogO::Shutdown()
-{
-   if (!demo_)
-   {
-      DAQmxStopTask(task_);
-       DAQmxClearTask(task_);
-   }
-
-   initialized_ = false;
-   return DEVICE_OK;
-}
-
-int AnalogO::SetSignal(double volts)
-{
-   ostringstream txt;
-   txt << "2P >>>> AnalogO::SetVoltage() = " << volts; 
-   LogMessage(txt.str());
-   return SetProperty(g_PropertyVolts, CDeviceUtils::ConvertToString(volts));
-}
-
-int AnalogO::SetGateOpen(bool open)
-{
-   int ret(DEVICE_OK);
-
-   if (open)
-   {
-      // opening gate: restore voltage
-      if (!gateOpen_)
-         ret = ApplyVoltage(gatedVolts_);
-   }
-   else
-   {
-      // closing gate: set voltage to 0
-      if (gateOpen_)
-      {
-         ret = ApplyVoltage(0.0);
-      }
-   }
-
-   if (ret != DEVICE_OK)
-      return ret;
-
-   gateOpen_ = open;
-   return DEVICE_OK;
-}
-
-int AnalogO::GetGateOpen(bool& open)
-{
-   open = gateOpen_;
-   return DEVICE_OK;
-}
-
-int AnalogO::ApplyVoltage(double v)
-{
-   if (!demo_)
-   {
-      long niRet = SetupTask();
-      if (niRet)
-      {
-          return niRet;
-      }
-      niRet = DAQmxCreateAOVoltageChan(task_,
-          channel_.c_str(), "", minV_, maxV_,
-          DAQmx_Val_Volts, "");
-      if (niRet)
-      {
-          return LogError(niRet, "CreateAOVoltageChan");
-      }
-      niRet = DAQmxStartTask(task_);
-      if (niRet)
-      {
-          return LogError(niRet, "StartTask");
-      }
-      float64 data[1];
-      data[0] = v;
-      if (disable_)	
-      {
-         data[0] = 0;
-      }
-      niRet = DAQmxWriteAnalogF64(task_, 1, 1, 10.0, DAQmx_Val_GroupByChannel, data, NULL, NULL);
-      if (niRet != DAQmxSuccess)
-      {
-         return LogError(niRet, "WriteAnalogF64");
-      }
-   }
-   volts_ = v;
-   return DEVICE_OK;
-}
-
-int AnalogO::StartDASequence()
-{
-   int error;
-   if (!amPreparedToTrigger_)
+   std::string counters;
+   int error = QueryDevice(&DAQmxGetDevCIPhysicalChans, "DevCIPhysicalChans",
+      deviceName_, counters);
+   if (error)
    {
-      error = SetupTask();
-      if (error)
-      {
-   	     return error;
-      }
-      error = DAQmxCreateAOVoltageChan(task_, channel_.c_str(), "",
-         minV_, maxV_, DAQmx_Val_Volts, "");
-      if (error)
-      {
-   	     return LogError(error, "CreateAOVoltageChan");
-      }
-      error = SetupClockInput((int) sequence_.size());
-      if (error)
-      {
-   	    return error;
-      }
-      error = LoadBuffer();
-      if (error)
-      {
-         return error;
-      }
+      return LogError(error, "GetDevCIPhysicalChans");
    }
-   amPreparedToTrigger_ = true;
-   error = DAQmxStartTask(task_);
-   if (error)
+   size_t index = std::string::npos;
+   do
    {
-      return LogError(error, "StartTask");
+      std::string counter = GetNextEntry(counters, index);
+      if (!counter.empty())
+      {
+         AddAllowedValue(g_PropertyTimestampCounter, counter.c_str());
+      }
+   } while (index != std::string::npos);
+
+   // Notify the core of each change of the lines
+   pAct = new CPropertyAction (this, &DigitalI::OnNotifyChanges);
+   nRet = CreateProperty(g_PropertyNotifyChanges, g_No, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(g_PropertyNotifyChanges, g_No);
+   AddAllowedValue(g_PropertyNotifyChanges, g_Yes);
+
+   // Edges counted on each line, and time (ms) of the last one
+   for (uInt32 i = 0; i < numLines_; ++i)
+   {
+      std::string line = boost::lexical_cast<std::string>(i);
+      CPropertyActionEx* pActEx = new CPropertyActionEx(this, &DigitalI::OnEdgeCount, i);
+      nRet = CreateIntegerProperty((g_PropertyEdgeCount + line).c_str(), 0, true, pActEx);
+      if (nRet != DEVICE_OK)
+         return nRet;
+      pActEx = new CPropertyActionEx(this, &DigitalI::OnLastEdge, i);
+      nRet = CreateFloatProperty((g_PropertyLastEdge + line).c_str(), -1.0, true, pActEx);
+      if (nRet != DEVICE_OK)
+         return nRet;
    }
+
+   // Changes detected since the detection started
+   pAct = new CPropertyAction (this, &DigitalI::OnChanges);
+   nRet = CreateIntegerProperty(g_PropertyChanges, 0, true, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   // Changes per second over the recent changes
+   pAct = new CPropertyAction (this, &DigitalI::OnEdgeRate);
+   nRet = CreateFloatProperty(g_PropertyEdgeRate, 0.0, true, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   // Recent changes as "time:states", oldest first
+   pAct = new CPropertyAction (this, &DigitalI::OnRecentEdges);
+   nRet = CreateStringProperty(g_PropertyRecentEdges, "", true, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   nRet = UpdateStatus();
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   initialized_ = true;
    return DEVICE_OK;
 }
 
-int AnalogO::StopDASequence()
+int DigitalI::Shutdown()
 {
+   StopDetection();
    CancelTask();
+
+   initialized_ = false;
    return DEVICE_OK;
 }
-int AnalogO::ClearDASequence()
-{
-   sequence_.clear();
-   return DEVICE_OK;
-}
-int AnalogO::AddToDASequence(double val)
+
+// One channel per line, each read as its bit of the port.
+int DigitalI::CreateOnDemandChannel()
 {
-   sequence_.push_back(val);
+   int error = DAQmxCreateDIChan(task_, channel_.c_str(), "", DAQmx_Val_ChanPerLine);
+   if (error)
+   {
+      return LogError(error, "CreateDIChan");
+   }
    return DEVICE_OK;
 }
-int AnalogO::SendDASequence()
-{
-   return LoadBuffer();
-}
 
-// Load our analog sequence onto the NI buffer.
-int AnalogO::LoadBuffer()
+// Software-timed read of the lines.
+int DigitalI::ReadLineStates(uInt32& state)
 {
-   float64* values = new float64[sequence_.size()];
-   for (int i = 0; i < sequence_.size(); ++i)
+   int error = GetOnDemandTask();
+   if (error)
    {
-      values[i] = sequence_[i];
+      return error;
    }
-   int32 numWritten = 0;
-   int error = DAQmxWriteAnalogF64(task_, (int32) sequence_.size(), false, -1,
-      DAQmx_Val_GroupByChannel, values, &numWritten, NULL);
-   delete values;
+   uInt32 values[g_MaxDigitalInputLines];
+   int32 read = 0;
+   error = DAQmxReadDigitalU32(task_, 1, 10.0, DAQmx_Val_GroupByScanNumber,
+      values, g_MaxDigitalInputLines, &read, NULL);
    if (error)
    {
-      return LogError(error, "WriteAnalogF64");
+      CancelTask();
+      return LogError(error, "ReadDigitalU32");
    }
-   if (numWritten != sequence_.size())
+   state = 0;
+   for (uInt32 c = 0; c < numLines_; ++c)
    {
-      LogMessage(("Didn't write complete analog sequence to buffer: wrote " +
-         boost::lexical_cast<string>(numWritten) + " of " +
-         boost::lexical_cast<string>(sequence_.size()) + " values").c_str());
-      return 1;
+      if (values[c] != 0)
+      {
+         state |= 1u << c;
+      }
    }
    return DEVICE_OK;
 }
 
-// Attempt to set up and run a triggering task.
-int AnalogO::TestTriggering()
+// Sample the lines on each of their changes and start the thread moving
+// the changes into the ring buffer. Both edges are detected on the card
+// so that every state is seen; Edges only selects the edges counted.
+int DigitalI::StartDetection()
 {
-   int error = StopDASequence();
+   uInt32 state = 0;
+   int error = ReadLineStates(state);
    if (error)
    {
       return error;
    }
-   error = ClearDASequence();
+   {
+      MMThreadGuard guard(lock_);
+      state_ = state;
+      edgeCounts_.assign(numLines_, 0);
+      lastEdges_.assign(numLines_, -1.0);
+   }
+   ring_.resize(g_EdgeRingSize);
+   written_.store(0);
+   block_.resize(g_EdgeBlockSize * numLines_);
+   ticksBlock_.resize(g_EdgeBlockSize);
+   lastTicks_ = 0;
+   ticks_ = 0;
+   lastHostTime_ = 0.0;
+
+   error = SetupTask();
    if (error)
    {
       return error;
    }
-   for (int i = 0; i < 100; ++i)
+   error = CreateOnDemandChannel();
+   if (error)
    {
-      error = AddToDASequence(maxV_ / 10.0 * (i % 10));
+      CancelTask();
+      return error;
+   }
+   error = DAQmxCfgChangeDetectionTiming(task_, channel_.c_str(), channel_.c_str(),
+      DAQmx_Val_ContSamps, g_EdgeRingSize);
+   if (error)
+   {
+      CancelTask();
+      return LogError(error, "CfgChangeDetectionTiming");
+   }
+
+   // The counter runs before the first change can be detected
+   start_ = std::chrono::steady_clock::now();
+   if (timestampCounter_ != g_TimestampHostClock && !timestampCounter_.empty())
+   {
+      error = StartTimestamps();
       if (error)
       {
+         StopDetection();
          return error;
       }
    }
-   return StartDASequence();
+   error = DAQmxStartTask(task_);
+   if (error)
+   {
+      StopDetection();
+      return LogError(error, "StartTask");
+   }
+
+   thread_ = new DigitalIDetectionThread(*this);
+   thread_->Start();
+   detecting_ = true;
+   return DEVICE_OK;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-// Action handlers
-///////////////////////////////////////////////////////////////////////////////
+// Count the card timebase with timestampCounter_, sampling the count on
+// each change detection event.
+int DigitalI::StartTimestamps()
+{
+   int error = DAQmxCreateTask("", &timestampTask_);
+   if (error)
+   {
+      timestampTask_ = 0;
+      return LogError(error, "CreateTask");
+   }
+   error = DAQmxCreateCICountEdgesChan(timestampTask_, timestampCounter_.c_str(), "",
+      DAQmx_Val_Rising, 0, DAQmx_Val_CountUp);
+   if (error)
+   {
+      return LogError(error, "CreateCICountEdgesChan");
+   }
+   std::string timebase = "/" + deviceName_ + "/20MHzTimebase";
+   error = DAQmxSetCICountEdgesTerm(timestampTask_, timestampCounter_.c_str(),
+      timebase.c_str());
+   if (error)
+   {
+      return LogError(error, "SetCICountEdgesTerm");
+   }
+   std::string clock = "/" + deviceName_ + "/ChangeDetectionEvent";
+   error = DAQmxCfgSampClkTiming(timestampTask_, clock.c_str(), g_MaxChangeRate,
+      DAQmx_Val_Rising, DAQmx_Val_ContSamps, g_EdgeRingSize);
+   if (error)
+   {
+      return LogError(error, "CfgSampClkTiming");
+   }
+   error = DAQmxStartTask(timestampTask_);
+   if (error)
+   {
+      return LogError(error, "StartTask");
+   }
+   return DEVICE_OK;
+}
 
-int AnalogO::OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+void DigitalI::StopDetection()
 {
-   if (eAct == MM::BeforeGet)
+   detecting_ = false;
+   if (thread_ != 0)
    {
-      pProp->Set(gatedVolts_);
+      delete thread_;
+      thread_ = 0;
    }
-   else if (eAct == MM::AfterSet)
+   if (timestampTask_ != 0)
    {
-      double v;
-      pProp->Get(v);
-      gatedVolts_ = v;
+      DAQmxStopTask(timestampTask_);
+      DAQmxClearTask(timestampTask_);
+      timestampTask_ = 0;
+   }
+   // The next on-demand read rebuilds its task
+   CancelTask();
+}
 
-      if (gateOpen_)
+// Time (ms since the start) of a change from its count of the timebase.
+// The counter wraps every 2^32 ticks (about 215 s); the wraps between
+// two changes are recovered from the host time of the reads.
+double DigitalI::GetTimestamp(uInt32 ticks, double hostTime)
+{
+   uInt32 delta = ticks - lastTicks_;
+   double missed = (hostTime - lastHostTime_) * g_TimestampTimebaseRate - delta;
+   unsigned long long wraps = missed > 0 ? (unsigned long long) (missed / 4294967296.0 + 0.5) : 0;
+   ticks_ += (wraps << 32) + delta;
+   lastTicks_ = ticks;
+   lastHostTime_ = hostTime;
+   return ticks_ * 1000.0 / g_TimestampTimebaseRate;
+}
+
+// Read the changes detected since the last call.
+int DigitalI::AcquireEdges()
+{
+   uInt32 available = 0;
+   int error = DAQmxGetReadAvailSampPerChan(task_, &available);
+   if (error)
+   {
+      return LogError(error, "GetReadAvailSampPerChan");
+   }
+   if (available == 0)
+   {
+      return DEVICE_OK;
+   }
+   if (timestampTask_ != 0)
+   {
+      // Only the changes already timestamped
+      uInt32 counts = 0;
+      error = DAQmxGetReadAvailSampPerChan(timestampTask_, &counts);
+      if (error)
       {
-         return ApplyVoltage(v);
+         return LogError(error, "GetReadAvailSampPerChan");
+      }
+      available = std::min(available, counts);
+      if (available == 0)
+      {
+         return DEVICE_OK;
       }
    }
-   else if (eAct == MM::IsSequenceable)
+   if (available > g_EdgeBlockSize)
    {
-      // Only if we believe we can trigger, and the user
-      // hasn't disabled triggering.
-      if (supportsTriggering_ && isTriggeringEnabled_)
+      available = g_EdgeBlockSize;
+   }
+   int32 read = 0;
+   error = DAQmxReadDigitalU32(task_, (int32) available, 1.0, DAQmx_Val_GroupByScanNumber,
+      &block_[0], (uInt32) block_.size(), &read, NULL);
+   if (error)
+   {
+      return LogError(error, "ReadDigitalU32");
+   }
+   if (timestampTask_ != 0)
+   {
+      // Sampled by the same events, one count per change
+      int32 counts = 0;
+      error = DAQmxReadCounterU32(timestampTask_, read, 1.0, &ticksBlock_[0],
+         (uInt32) ticksBlock_.size(), &counts, NULL);
+      if (error)
       {
-         pProp->SetSequenceable(maxSequenceLength_);
+         return LogError(error, "ReadCounterU32");
       }
-      else
+      // Never pair a change with a timestamp of an earlier block
+      read = std::min(read, counts);
+   }
+   double hostTime = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_).count();
+
+   unsigned long written = written_.load(std::memory_order_relaxed);
+   uInt32 state;
+   {
+      MMThreadGuard guard(lock_);
+      uInt32 rising = (edges_ != g_EdgesFalling) ? 0xFFFFFFFF : 0;
+      uInt32 falling = (edges_ != g_EdgesRising) ? 0xFFFFFFFF : 0;
+      for (int32 i = 0; i < read; ++i)
       {
-         pProp->SetSequenceable(0);
+         state = 0;
+         for (uInt32 c = 0; c < numLines_; ++c)
+         {
+            if (block_[i * numLines_ + c] != 0)
+            {
+               state |= 1u << c;
+            }
+         }
+         double time = (timestampTask_ != 0) ? GetTimestamp(ticksBlock_[i], hostTime) :
+            hostTime * 1000.0;
+         uInt32 counted = (state & ~state_ & rising) | (~state & state_ & falling);
+         for (uInt32 c = 0; c < numLines_; ++c)
+         {
+            if (counted & (1u << c))
+            {
+               ++edgeCounts_[c];
+               lastEdges_[c] = time;
+            }
+         }
+         state_ = state;
+         EdgeEntry& entry = ring_[(written + i) % g_EdgeRingSize];
+         entry.time = time;
+         entry.state = state;
       }
+      state = state_;
+      // Published with the entries, for the readers holding lock_
+      written_.store(written + read, std::memory_order_release);
    }
-   else if (eAct == MM::AfterLoadSequence)
+
+   if (notifyChanges_ && read > 0)
    {
-      // Transfer the sequence into our internal storage.
-      ClearDASequence();
-      SetupTask();
-      std::vector<std::string> sequence = pProp->GetSequence();
-      if (sequence.size() > maxSequenceLength_)
+      OnPropertyChanged(g_PropertyLineStates, CDeviceUtils::ConvertToString((long) state));
+      OnPropertyChanged(g_PropertyChanges,
+         CDeviceUtils::ConvertToString((long) (written + read)));
+   }
+   return DEVICE_OK;
+}
+
+int DigitalI::OnLineStates(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      uInt32 state = 0;
+      if (detecting_)
       {
-         return DEVICE_SEQUENCE_TOO_LARGE;
+         // The task is busy with the change detection
+         MMThreadGuard guard(lock_);
+         state = state_;
       }
-      for (long i = 0; i < sequence.size(); ++i)
+      else
       {
-         AddToDASequence(boost::lexical_cast<float64>(sequence[i]));
+         int error = ReadLineStates(state);
+         if (error)
+         {
+            return error;
+         }
       }
+      pProp->Set((long) state);
    }
-   else if (eAct == MM::StartSequence)
+
+   return DEVICE_OK;
+}
+
+int DigitalI::OnChangeDetection(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
    {
-      return StartDASequence();
+      pProp->Set(detecting_ ? g_Yes : g_No);
    }
-   else if (eAct == MM::StopSequence)
+   else if (eAct == MM::AfterSet)
    {
-      int error = StopDASequence();
-      if (error)
+      string val;
+      pProp->Get(val);
+      bool detecting = (val.compare(g_Yes) == 0);
+      if (detecting == detecting_)
       {
-         return error;
+         return DEVICE_OK;
       }
-      error = ClearDASequence();
-      if (error)
+      if (detecting)
       {
-         return error;
+         int error = StartDetection();
+         if (error)
+         {
+            pProp->Set(g_No);
+            return error;
+         }
+      }
+      else
+      {
+         StopDetection();
       }
    }
 
    return DEVICE_OK;
 }
 
-int AnalogO::OnMinVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+int DigitalI::OnEdges(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
    {
-      pProp->Set(minV_);
+      pProp->Set(edges_.c_str());
    }
    else if (eAct == MM::AfterSet)
    {
-      pProp->Get(minV_);
+      // Read by the detection thread under the lock
+      MMThreadGuard guard(lock_);
+      pProp->Get(edges_);
    }
 
    return DEVICE_OK;
 }
 
-int AnalogO::OnMaxVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+// Takes effect when the change detection starts.
+int DigitalI::OnTimestampCounter(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
    {
-      pProp->Set(maxV_);
+      pProp->Set(timestampCounter_.empty() ? g_TimestampHostClock : timestampCounter_.c_str());
    }
    else if (eAct == MM::AfterSet)
    {
-      pProp->Get(maxV_);
+      pProp->Get(timestampCounter_);
    }
 
    return DEVICE_OK;
 }
 
-int AnalogO::OnDisable(MM::PropertyBase* pProp, MM::ActionType eAct)
+int DigitalI::OnNotifyChanges(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-    if (eAct == MM::BeforeGet)
-    {
-        pProp->Set( (disable_ ? "true" : "false"));
-    }
-    else if (eAct == MM::AfterSet)
-    {
-        string temp;
-        pProp->Get(temp);
-        disable_ = (temp == "true");
-        ApplyVoltage(gatedVolts_);
-    }
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(notifyChanges_ ? g_Yes : g_No);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      string val;
+      pProp->Get(val);
+      notifyChanges_ = (val.compare(g_Yes) == 0);
+   }
+
+   return DEVICE_OK;
+}
+
+int DigitalI::OnEdgeCount(MM::PropertyBase* pProp, MM::ActionType eAct, long line)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      MMThreadGuard guard(lock_);
+      pProp->Set((long) edgeCounts_[line]);
+   }
+
+   return DEVICE_OK;
+}
+
+int DigitalI::OnLastEdge(MM::PropertyBase* pProp, MM::ActionType eAct, long line)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      MMThreadGuard guard(lock_);
+      pProp->Set(lastEdges_[line]);
+   }
+
+   return DEVICE_OK;
+}
+
+int DigitalI::OnChanges(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long) written_.load(std::memory_order_acquire));
+   }
+
+   return DEVICE_OK;
+}
+
+int DigitalI::OnEdgeRate(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      // The acquisition thread writes ring_ under lock_
+      MMThreadGuard guard(lock_);
+      unsigned long written = written_.load(std::memory_order_acquire);
+      unsigned long changes = written < g_RateEdges ? written : g_RateEdges;
+      double rate = 0.0;
+      if (changes > 1)
+      {
+         double first = ring_[(written - changes) % g_EdgeRingSize].time;
+         double last = ring_[(written - 1) % g_EdgeRingSize].time;
+         if (last > first)
+         {
+            rate = (changes - 1) * 1000.0 / (last - first);
+         }
+      }
+      pProp->Set(rate);
+   }
+
+   return DEVICE_OK;
+}
+
+int DigitalI::OnRecentEdges(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      std::ostringstream edges;
+      {
+         // The acquisition thread writes ring_ under lock_
+         MMThreadGuard guard(lock_);
+         unsigned long written = written_.load(std::memory_order_acquire);
+         unsigned long changes = written < g_RecentEdges ? written : g_RecentEdges;
+         for (unsigned long i = written - changes; i < written; ++i)
+         {
+            const EdgeEntry& entry = ring_[i % g_EdgeRingSize];
+            if (i > written - changes)
+            {
+               edges << ",";
+            }
+            edges << entry.time << ":" << entry.state;
+         }
+      }
+      pProp->Set(edges.str().c_str());
+   }
 
-    return DEVICE_OK;
+   return DEVICE_OK;
 }
 
-int AnalogO::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
+int DigitalI::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
    {
@@ -1371,7 +6045,7 @@ int AnalogO::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
-int AnalogO::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
+int DigitalI::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
    if (eAct == MM::BeforeGet)
    {
@@ -1390,329 +6064,147 @@ int AnalogO::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
    return DEVICE_OK;
 }
 
-int AnalogO::OnDemo(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   if (eAct == MM::BeforeGet)
-   {
-      pProp->Set(demo_ ? g_Yes : g_No);
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      string val;
-      pProp->Get(val);
-      if (val.compare(g_Yes) == 0)
-         demo_ = true;
-      else
-         demo_ = false;
-   }
-
-   return DEVICE_OK;
-}
-
 
 ///////////////////////////////////////////////////////////////////////////////
-// AnalogI implementation
-// ~~~~~~~~~~~~~~~~~~~~~~~
+// AnalogIAcquisitionThread implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-AnalogI::AnalogI() :
-      busy_(false), minV_(0.0), maxV_(5.0), volts_(0.0), encoding_(0),
-      resolution_(0)
+AnalogIAcquisitionThread::AnalogIAcquisitionThread(AnalogI& input) :
+   input_(input), stop_(true)
 {
-   task_ = 0;
-   InitializeDefaultErrorMessages();
-
-   // add custom error messages
-   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
-   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
-   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
-   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
+}
 
-   // Output channel, a.k.a. port.
-   CPropertyAction* pAct = new CPropertyAction (this, &AnalogI::OnChannel);
-   int nRet = CreateStringProperty(g_PropertyChannel, "devname", false, pAct, true);
-   assert(nRet == DEVICE_OK);
+AnalogIAcquisitionThread::~AnalogIAcquisitionThread()
+{
+   Stop();
+   wait();
+}
 
-   // Input port -- a more convenient version of the above for users that
-   // don't need to specify individual lines.
-   pAct = new CPropertyAction(this, &AnalogI::OnPort);
-   nRet = CreateStringProperty(g_PropertyPort, "devname", false, pAct, true);
-   std::vector<std::string> devices = GetDevices();
-   if (devices.size() == 0)
-   {
-      AddAllowedValue(g_PropertyPort, "No valid devices found");
-   }
-   else
+int AnalogIAcquisitionThread::svc()
+{
+   while (!stop_)
    {
-      AddAllowedValue(g_PropertyPort, g_UseCustom);
-      SetProperty(g_PropertyPort, g_UseCustom);
-   }
-
-	ofstream log;
-	log.open (g_logpath, ios::app);
-	log << "--------- AnalogI --------\n";
-	log << "---- Available input ports: " << "\n";
-
-
-   for (std::vector<string>::iterator i = devices.begin(); i != devices.end(); ++i) {
-      std::vector<string> ports = GetAnalogIPortsForDevice(*i);
-      for (std::vector<string>::iterator j = ports.begin(); j != ports.end(); ++j) {
-         AddAllowedValue(g_PropertyPort, (*j).c_str());
-		 log << (*j).c_str() << "\n";
+      // Each read returns after one block, which keeps the thread
+      // responsive to Stop()
+      if (input_.AcquireSamples() != DEVICE_OK)
+      {
+         break;
       }
    }
+   return 0;
+}
 
-   log.close();
-
+void AnalogIAcquisitionThread::Start()
+{
+   stop_ = false;
+   activate();
+}
 
-   // MinVolts
-   // --------
-   pAct = new CPropertyAction (this, &AnalogI::OnMinVolts);
-   nRet = CreateProperty(g_PropertyMinVolts, "0.0", MM::Float, false, pAct, true);
-   assert(nRet == DEVICE_OK);
 
-   // MaxVolts
-   // --------
-   pAct = new CPropertyAction (this, &AnalogI::OnMaxVolts);
-   nRet = CreateProperty(g_PropertyMaxVolts, "5.0", MM::Float, false, pAct, true);
-   assert(nRet == DEVICE_OK);
-}
+///////////////////////////////////////////////////////////////////////////////
+// AnalogIFrameThread implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-AnalogI::~AnalogI()
+AnalogIFrameThread::AnalogIFrameThread(AnalogI& input) :
+   input_(input), stop_(true)
 {
-   Shutdown();
 }
 
-void AnalogI::GetName(char* name) const
+AnalogIFrameThread::~AnalogIFrameThread()
 {
-   CDeviceUtils::CopyLimitedString(name, g_DeviceNameAnalogI);
+   Stop();
+   wait();
 }
 
-
-int AnalogI::Initialize()
+int AnalogIFrameThread::svc()
 {
-   SetContext(GetCoreCallback(), this);
-   SetDeviceName();
-   // set property list
-   // -----------------
-   char label[MM::MaxStrLength];
-   GetLabel(label);
-   
-   	ofstream log;
-	log.open (g_logpath, ios::app);
-	log << "---- Properties initialization " << "\n";
-
-   // Name
-   int nRet = CreateProperty(MM::g_Keyword_Name, g_DeviceNameAnalogI, MM::String, true);
-   if (DEVICE_OK != nRet)
-      return nRet;
-
-	log << "Name" << "\n";
-
-   // Description
-   nRet = CreateProperty(MM::g_Keyword_Description, "NI DAC", MM::String, true);
-   if (DEVICE_OK != nRet)
-      return nRet;
-
-	log << "Description" << "\n";
-
-   // Input trigger sample rate.
-   CPropertyAction* pAct = new CPropertyAction(this, &DAQDevice::OnSampleRate);
-   nRet = CreateIntegerProperty(g_PropertySampleRate, samplesPerSec_, false,
-         pAct, false);
-   if (DEVICE_OK != nRet)
+   // CollectFrames releases the task after the last frame or an error
+   while (!stop_ && input_.IsTriggered())
    {
-      return nRet;
-   }
-   
-	log << "Sample rate" << "\n";
-
-   // Volts
-   // -----
-   pAct = new CPropertyAction (this, &AnalogI::OnVolts);
-   nRet = CreateProperty(g_PropertyVolts, "0.0", MM::Float, true, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-
-   
-	log << "Volts" << "\n";
-
-   //nRet = SetPropertyLimits(g_PropertyVolts, minV_, maxV_);
-   //assert(nRet == DEVICE_OK);
-
-   // set up task
-   // -----------
-      int niRet = SetupTask();
-      if (niRet)
-      {
-          return niRet;
-      }
-	  
-   log << "Set-up init" << "\n";
-
-      niRet = DAQmxCreateAIVoltageChan(task_, channel_.c_str(), "", DAQmx_Val_Cfg_Default, minV_, maxV_, DAQmx_Val_Volts, ""); // here the terminal has been chosen to default, see NI manual for other choices
-      if (niRet != DAQmxSuccess)
+      if (input_.CollectFrames() != DEVICE_OK)
       {
-         return LogError(niRet, "CreateAIVoltageChan");
+         break;
       }
-
-   log << "Create AI voltage channel" << "\n";
-
-       niRet = DAQmxStartTask(task_);
-       if (niRet)
-       {
-           return LogError(niRet, "StartTask");
-       }
-  
-
-   log << "Start task done" << "\n";
-
-   nRet = UpdateStatus();
-   if (nRet != DEVICE_OK)
-      return nRet;
-
-   initialized_ = true;
-
-   log.close();
-
-   return DEVICE_OK;
-}
-
-int AnalogI::Shutdown()
-{
-   DAQmxStopTask(task_);
-   DAQmxClearTask(task_);
-
-   initialized_ = false;
-   return DEVICE_OK;
+      CDeviceUtils::SleepMs(g_FramePollPeriod);
+   }
+   return 0;
 }
 
-int AnalogI::GetSignal(double& volts)
+void AnalogIFrameThread::Start()
 {
-	ofstream log;
-	log.open (g_logpath, ios::app);
-	log << "---- Get signal " << "\n";
-
-	long niRet = SetupTask();
-	if(niRet)
-		return niRet;
-
-		log << "Set-up task" << "\n";
-	
-	niRet = DAQmxCreateAIVoltageChan(task_, channel_.c_str(), "", DAQmx_Val_Cfg_Default, minV_, maxV_, DAQmx_Val_Volts, "");
-	if(niRet)
-		return LogError(niRet, "CreateAIVoltageChan");
-    
-    log << "Create AnalogI channel" << "\n";
-
-	niRet = DAQmxStartTask(task_);
-	if(niRet)
-		return LogError(niRet, "StartTask");
-	    
-    log << "Start task" << "\n";
-
-	float64 read[1];
-	niRet = DAQmxReadAnalogF64(task_, 1, 10.0, DAQmx_Val_GroupByChannel, read, 1, NULL, NULL);
-	if(niRet)
-		return LogError(niRet, "ReadAnalogF64");
-
-    log << "Read analog64" << "\n";
-
-	volts = read[0];
-
-	    
-    log << "V ="<< volts << "\n";
-
-	log.close();
-	return DEVICE_OK;
+   stop_ = false;
+   activate();
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// Action handlers
-///////////////////////////////////////////////////////////////////////////////
+// DigitalIDetectionThread implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 
-int AnalogI::OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+DigitalIDetectionThread::DigitalIDetectionThread(DigitalI& input) :
+   input_(input), stop_(true)
 {
-   if (eAct == MM::BeforeGet)
-   {
-		double v;
-
-		ofstream log;
-		log.open (g_logpath, ios::app);
-		log << "------ Property action " << "\n";
-
-		GetSignal(v);
-
-		log << "------ Get signal " << "\n";
-
-		pProp->Set(v);
-
-		log << "------ Set value " << "\n";
-
-		volts_ = v;
-
-		log.close();
-   }
-   return DEVICE_OK;
 }
 
-int AnalogI::OnMinVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+DigitalIDetectionThread::~DigitalIDetectionThread()
 {
-   if (eAct == MM::BeforeGet)
-   {
-      pProp->Set(minV_);
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      pProp->Get(minV_);
-   }
-
-   return DEVICE_OK;
+   Stop();
+   wait();
 }
 
-int AnalogI::OnMaxVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+int DigitalIDetectionThread::svc()
 {
-   if (eAct == MM::BeforeGet)
-   {
-      pProp->Set(maxV_);
-   }
-   else if (eAct == MM::AfterSet)
+   while (!stop_)
    {
-      pProp->Get(maxV_);
+      // Changes are buffered by the card between the reads
+      if (input_.AcquireEdges() != DEVICE_OK)
+      {
+         break;
+      }
+      CDeviceUtils::SleepMs(g_DetectionPollPeriod);
    }
+   return 0;
+}
 
-   return DEVICE_OK;
+void DigitalIDetectionThread::Start()
+{
+   stop_ = false;
+   activate();
 }
 
-int AnalogI::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
+
+///////////////////////////////////////////////////////////////////////////////
+// DAQStreamThread implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+DAQStreamThread::DAQStreamThread(DAQDevice& device) :
+   device_(device), stop_(true)
 {
-   if (eAct == MM::BeforeGet)
-   {
-      pProp->Set(channel_.c_str());
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      pProp->Get(channel_);
-   }
+}
 
-   return DEVICE_OK;
+DAQStreamThread::~DAQStreamThread()
+{
+   Stop();
+   wait();
 }
 
-int AnalogI::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
+int DAQStreamThread::svc()
 {
-   if (eAct == MM::BeforeGet)
-   {
-      pProp->Set(port_.c_str());
-   }
-   else if (eAct == MM::AfterSet)
+   while (!stop_)
    {
-      pProp->Get(port_);
-      if (strcmp(port_.c_str(), g_UseCustom) != 0)
+      // Errors, e.g. an underflow of the output buffer, are logged by
+      // the device and end the stream
+      if (device_.StreamSamples() != DEVICE_OK)
       {
-         // User wants to use one of our auto-detected ports.
-         channel_ = port_;
+         break;
       }
+      CDeviceUtils::SleepMs(g_StreamPollPeriod);
    }
+   return 0;
+}
 
-   return DEVICE_OK;
-}
\ No newline at end of file
+void DAQStreamThread::Start()
+{
+   stop_ = false;
+   activate();
+}
@@ -17,6 +17,9 @@
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
+#include <atomic>
+#include <chrono>
 #include <boost/lexical_cast.hpp>
 
 
@@ -30,10 +33,15 @@
 #define ERR_WRITE_FAILED 415
 #define ERR_CLOSE_FAILED 416
 #define ERR_BOARD_NOT_FOUND 417
+#define ERR_SEQUENCE_MISMATCH 418
+#define ERR_CLOCK_MISMATCH 419
 #define ERR_PORT_CHANGE_FORBIDDEN    10004
 #define ERR_UNRECOGNIZED_ANSWER      10009
 #define ERR_OFFSET 10100
 
+class DAQStreamThread;
+class NISharedTask;
+
 // Generic DAQmx device. This unifies logic that is shared
 // across the other classes in this file.
 class DAQDevice
@@ -47,6 +55,8 @@ public:
    std::vector<std::string> GetDigitalOPortsForDevice(std::string device);
    std::vector<std::string> GetAnalogOPortsForDevice(std::string device);
    std::vector<std::string> GetAnalogIPortsForDevice(std::string device);
+   std::vector<std::string> GetDigitalIPortsForDevice(std::string device);
+   std::vector<std::string> GetCounterOPortsForDevice(std::string device);
    std::string GetPort(std::string line);
 
    int OnTriggeringEnabled(MM::PropertyBase* pProp, MM::ActionType eAct);
@@ -54,14 +64,57 @@ public:
    int OnSupportsTriggering(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnInputTrigger(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnSequenceLength(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStreaming(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStreamBufferSize(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStatistics(MM::PropertyBase* pProp, MM::ActionType eAct, long statistic);
+   int OnResetStatistics(MM::PropertyBase* pProp, MM::ActionType eAct);
    virtual int TestTriggering() = 0;
 
+   // Called by the stream thread.
+   int StreamSamples();
+
 protected:
    void SetDeviceName();
    int CreateTriggerProperties();
    int SetupTask();
    void CancelTask();
-   int SetupClockInput(int numVals);
+   int GetOnDemandTask();
+   virtual int CreateOnDemandChannel() = 0;
+   int SetupClockInput(int numVals, int32 sampleMode = DAQmx_Val_ContSamps);
+   long GetMaxSequenceLength() const;
+   int PrepareStream(long numVals);
+   int StartStream();
+   void StopStream();
+   int WriteStream(long numVals);
+   virtual int WriteSamples(long offset, long numVals);
+   // Create the call timing properties; device is the derived device
+   // object, which owns the properties.
+   template <class T>
+   int CreateStatisticsProperties(T* device)
+   {
+      const char* names[] = {"Calls", "Call latency p50 (ms)",
+         "Call latency p99 (ms)", "Sequence load (ms)"};
+      for (long i = 0; i < 4; ++i)
+      {
+         int ret = device->CreateProperty(names[i], "0", i == 0 ? MM::Integer : MM::Float,
+            true, new MM::ActionEx<T>(device, &DAQDevice::OnStatistics, i));
+         if (ret != DEVICE_OK)
+         {
+            return ret;
+         }
+      }
+      int ret = device->CreateProperty("Reset statistics", "Idle", MM::String, false,
+         new MM::Action<T>(device, &DAQDevice::OnResetStatistics));
+      if (ret != DEVICE_OK)
+      {
+         return ret;
+      }
+      device->AddAllowedValue("Reset statistics", "Idle");
+      return device->AddAllowedValue("Reset statistics", "Reset");
+   }
+   void RecordCall(std::chrono::steady_clock::time_point start);
+   void RecordSequenceLoad(std::chrono::steady_clock::time_point start);
+   double GetLatencyPercentile(double percentile);
    int LogError(int error, const char* func);
    std::string GetNextEntry(std::string line, size_t& index);
 
@@ -86,12 +139,129 @@ protected:
    // Indicates if we have loaded a sequence onto the card and
    // am waiting for trigger inputs.
    bool amPreparedToTrigger_;
+   // Indicates that task_ is the committed, running task used for
+   // on-demand writes and reads; any other use of task_ clears it.
+   bool onDemandReady_;
+   // Sequences are streamed to a non-regenerative output buffer
+   // instead of being loaded upfront, their length is not limited
+   // by maxSequenceLength_.
+   bool streaming_;
+   // Size of the output buffer when streaming, in samples.
+   long streamBufferSize_;
+   // Length of the streamed sequence and next sample to write.
+   long streamLength_;
+   long streamPos_;
+   DAQStreamThread* streamThread_;
+   // Durations (ms) of the last on-demand calls and of the last
+   // sequence load.
+   std::vector<double> latencies_;
+   unsigned long calls_;
+   double sequenceLoadTime_;
+
+   // Task of the card shared with the other lines of an NIHub, 0 when
+   // the device owns task_, and our channel in it.
+   NISharedTask* shared_;
+   size_t sharedIndex_;
 
 private:
+   friend class NISharedTask;
+
    MM::Core* core_;
    MM::Device* device_;
 };
 
+// Keeps the output buffer of a streaming DAQDevice filled.
+class DAQStreamThread : public MMDeviceThreadBase
+{
+public:
+   DAQStreamThread(DAQDevice& device);
+   ~DAQStreamThread();
+   int svc();
+   int open (void*) { return 0;}
+   int close(unsigned long) {return 0;}
+
+   void Start();
+   void Stop() {stop_ = true;}
+
+private:
+   DAQDevice& device_;
+   volatile bool stop_;
+};
+
+// Output task shared by the lines of one card that belong to an NIHub.
+// The lines are written, committed, started and stopped together, and
+// their sequences run on a single sample clock, which must be set the
+// same on all lines. Each write drives all the lines, those not written
+// yet with the value they had when they were added.
+class NISharedTask
+{
+public:
+   NISharedTask(bool digital);
+   ~NISharedTask();
+
+   size_t AddChannel(DAQDevice& line, const std::string& channel, double minV, double maxV,
+      float64 value);
+   void RemoveLine(DAQDevice& line);
+   void DetachLines();
+   int Write(DAQDevice& line, size_t index, float64 value);
+   template <class T>
+   void LoadSequence(size_t index, const std::vector<T>& sequence)
+   {
+      MMThreadGuard guard(lock_);
+      sequences_[index].assign(sequence.begin(), sequence.end());
+   }
+   int StartSequence(DAQDevice& line);
+   int StopSequence(DAQDevice& line);
+   int TestTriggering(DAQDevice& line);
+   void Cancel();
+
+private:
+   int CreateTask(DAQDevice& line);
+   int WriteOnDemand(DAQDevice& line);
+   int WriteValues(DAQDevice& line, long numVals, const std::vector<float64>& values);
+   void ClearTask();
+
+   bool digital_;
+   TaskHandle task_;
+   // Channels of the lines, in the order of the task, and the devices
+   // using them (0 once shut down).
+   std::vector<std::string> channels_;
+   std::vector<DAQDevice*> lines_;
+   std::vector<double> minV_;
+   std::vector<double> maxV_;
+   // Last value written to each line.
+   std::vector<float64> values_;
+   // Sequence loaded for each line, empty if none.
+   std::vector<std::vector<float64> > sequences_;
+   // task_ is committed and running for on-demand writes.
+   bool onDemandReady_;
+   bool sequenceRunning_;
+   MMThreadLock lock_;
+};
+
+// Groups the lines of each card into a shared analog output task and
+// a shared digital output task.
+class NIHub : public HubBase<NIHub>
+{
+public:
+   NIHub();
+   ~NIHub();
+
+   int Initialize();
+   int Shutdown();
+   void GetName(char* name) const;
+   bool Busy() {return false;}
+
+   int DetectInstalledDevices();
+
+   NISharedTask* GetSharedTask(const std::string& card, bool digital);
+
+private:
+   bool initialized_;
+   // Shared tasks by card and type, e.g. "Dev1/ao".
+   std::map<std::string, NISharedTask*> tasks_;
+};
+
 //////////////////////////////////////////////////////////////////////////////
 // SignalIO class
 // Analog output
@@ -109,7 +279,7 @@ public:
    int Shutdown();
   
    void GetName(char* name) const;      
-   bool Busy() {return false;}
+   bool Busy();
   
    // SignalIO api
    // ------------
@@ -125,7 +295,7 @@ public:
    }
    int GetDASequenceMaxLength(long& maxLength) const
    {
-	   maxLength = maxSequenceLength_;
+	   maxLength = GetMaxSequenceLength();
 	   return DEVICE_OK;
    }
    int StartDASequence();
@@ -149,6 +319,18 @@ public:
    int OnDisable(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnVD(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnDemo(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnWaveformShape(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnWaveformAmplitude(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnWaveformOffset(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnWaveformPeriod(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnWaveformSamples(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnWaveformPoints(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnWaveformClock(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnGenerateWaveform(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDoubleBuffering(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRampMode(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRampSlewRate(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRampDuration(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 
 private:
@@ -167,11 +349,154 @@ private:
 
    int LoadBuffer();
    int ApplyVoltage(double v);
+   int WriteVoltage(float64 v);
+   int RampVoltage(float64 v);
+   int StopRamp();
+   void UpdateOutput();
    long GetListIndex();
+   int CreateOnDemandChannel();
+   int SetupSequenceClock(int numVals);
+   int GenerateWaveform();
+   int WriteSamples(long offset, long numVals);
+   int PrepareSequenceTask();
+   int StageSequence(const std::vector<std::string>& sequence);
+   int SwapSequence();
 
    bool demo_;
+
+   // Waveform generator, the waveform is generated in sequence_
+   // which is handed as is to DAQmx.
+   std::string waveformShape_;
+   double waveformAmplitude_;
+   double waveformOffset_;
+   long waveformPeriod_;
+   long waveformSamples_;
+   std::string waveformPoints_;
+   // Sequences are clocked at samplesPerSec_ instead of the trigger input.
+   bool internalClock_;
+
+   // Double buffering: nextSequence_ is staged while sequence_ runs.
+   bool doubleBuffering_;
+   bool sequenceRunning_;
+   bool sequenceStaged_;
+   std::vector<double> nextSequence_;
+
+   // Ramps: set-point changes are generated by the card as linear ramps
+   // limited by rampSlewRate_ (V/ms), or lasting rampDuration_ (ms).
+   std::string rampMode_;
+   double rampSlewRate_;
+   double rampDuration_;
+   // A ramp is being generated on task_, which has sample clock
+   // timing until StopRamp switches it back to on-demand writes.
+   bool ramping_;
+   // Last voltage output, where the next ramp starts.
+   double output_;
+   std::vector<float64> ramp_;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Generic class
+// Analog output on several channels sharing a single task
+//////////////////////////////////////////////////////////////////////////////
+
+class MultiAnalogO : public CGenericBase<MultiAnalogO>, public DAQDevice
+{
+public:
+   MultiAnalogO();
+   ~MultiAnalogO();
+
+   // MMDevice API
+   // ------------
+   int Initialize();
+   int Shutdown();
+
+   void GetName(char* name) const;
+   bool Busy() {return false;}
+
+   // Inherited from DAQDevice
+   int TestTriggering();
+
+   // action interface
+   // ----------------
+   int OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnMinVolts(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnMaxVolts(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct, long channel);
+   int OnAllVolts(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   int CreateOnDemandChannel();
+   int WriteVolts();
+   int StartSequence();
+   int StopSequence();
+   int LoadBuffer(long numVals);
+
+   bool initialized_;
+   double minV_;
+   double maxV_;
+   uInt32 numChannels_;
+   // Last value of each channel, written together.
+   std::vector<float64> volts_;
+   // Sequence loaded for each channel, empty if none.
+   std::vector<std::vector<float64> > sequences_;
+   bool sequenceRunning_;
+};
+
+// Counter output generating hardware-timed pulse trains.
+class CounterO : public CGenericBase<CounterO>, public DAQDevice
+{
+public:
+   CounterO();
+   ~CounterO();
+
+   // MMDevice API
+   // ------------
+   int Initialize();
+   int Shutdown();
+
+   void GetName(char* name) const;
+   bool Busy();
+
+   // Inherited from DAQDevice
+   int TestTriggering();
+
+   // action interface
+   // ----------------
+   int OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPort(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFrequency(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDutyCycle(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPulseCount(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStartTrigger(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRunning(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   int CreateOnDemandChannel();
+   int StartPulses();
+   int UpdatePulses();
+   int LoadSequence(MM::PropertyBase* pProp, std::vector<float64>& sequence,
+      double maxVal);
+   int StartSequence();
+   int StopSequence();
+   int LoadBuffer(long numVals);
+
+   bool initialized_;
+   float64 frequency_;
+   float64 dutyCycle_;
+   // Number of pulses of the train, 0 for a continuous train.
+   long pulseCount_;
+   // Terminal starting the train, empty to start immediately.
+   std::string startTrigger_;
+   bool running_;
+   // Pulse parameters for each trigger, empty if not sequenced.
+   std::vector<float64> frequencySequence_;
+   std::vector<float64> dutyCycleSequence_;
+   bool sequenceRunning_;
 };
 
+class AnalogIAcquisitionThread;
+class AnalogIFrameThread;
+
 class AnalogI : public CSignalIOBase<AnalogI>, public DAQDevice
 {
 public:
@@ -210,6 +535,25 @@ public:
    int OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnMinVolts(MM::PropertyBase* pProp, MM::ActionType eAct);
    int OnMaxVolts(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnContinuous(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnAveraging(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnAveragingWindow(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTrace(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTraceLength(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTraceDecimation(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDebugLog(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDumpDebugLog(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTriggeredAcquisition(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTriggeredFrames(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSamplesPerFrame(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFramesAcquired(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFrameValues(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+   // Called by the acquisition thread.
+   int AcquireSamples();
+   // Called by the frame thread.
+   int CollectFrames();
+   bool IsTriggered() const {return triggered_;}
 
 private:
    bool initialized_;
@@ -221,7 +565,97 @@ private:
    unsigned int resolution_;
 
    long GetListIndex();
+   int CreateOnDemandChannel();
+   int StartContinuous();
+   void StopContinuous();
+   double GetBoxcarAverage(long window);
+   std::string GetTrace();
+   void Trace(const char* event, double value = 0.0);
+   void DumpTrace();
+   int StartTriggered();
+   void StopTriggered();
+   std::string GetFrameValues();
+
+   // Continuous acquisition: the acquisition thread is the only writer
+   // of the ring buffer.
+   AnalogIAcquisitionThread* thread_;
+   bool continuous_;
+   std::string averaging_;
+   long window_;
+   long traceLength_;
+   long traceDecimation_;
+   std::vector<float64> ring_;
+   std::vector<float64> block_;
+   // Number of samples written in the ring buffer.
+   std::atomic<unsigned long> written_;
+   // Exponential moving average, updated with each sample.
+   std::atomic<double> average_;
+   // Error that stopped the acquisition thread, 0 while it runs.
+   std::atomic<int> acquisitionError_;
+
+   // Debug log: events are static strings, nothing is formatted
+   // until the log is dumped. Each entry is published by its sequence
+   // number (index + 1, 0 while it is written).
+   struct DebugLogEntry
+   {
+      std::atomic<unsigned long> sequence;
+      std::atomic<const char*> event;
+      std::atomic<double> value;
+      std::atomic<double> time;
+   };
+   DebugLogEntry* debugLog_;
+   std::atomic<bool> debugLogEnabled_;
+   std::atomic<unsigned long> debugLogWritten_;
+   // First entry written since the log was enabled.
+   unsigned long debugLogStart_;
+
+   // Triggered acquisition: samples of all the frames, filled as they
+   // are read from the card by the frame thread and by the property
+   // reads, under framesLock_.
+   std::atomic<bool> triggered_;
+   long triggeredFrames_;
+   long samplesPerFrame_;
+   std::vector<float64> frameSamples_;
+   long samplesRead_;
+   AnalogIFrameThread* frameThread_;
+   MMThreadLock framesLock_;
+};
+
+class AnalogIAcquisitionThread : public MMDeviceThreadBase
+{
+public:
+   AnalogIAcquisitionThread(AnalogI& input);
+   ~AnalogIAcquisitionThread();
+   int svc();
+   int open (void*) { return 0;}
+   int close(unsigned long) {return 0;}
+
+   void Start();
+   void Stop() {stop_ = true;}
+
+private:
+   AnalogI& input_;
+   volatile bool stop_;
+};
+
+// Moves the frames of a triggered acquisition out of the DAQmx buffer,
+// so that the task is released after the last frame even when nobody
+// reads them, before further triggers overflow the buffer.
+class AnalogIFrameThread : public MMDeviceThreadBase
+{
+public:
+   AnalogIFrameThread(AnalogI& input);
+   ~AnalogIFrameThread();
+   int svc();
+   int open (void*) { return 0;}
+   int close(unsigned long) {return 0;}
+
+   void Start();
+   void Stop() {stop_ = true;}
 
+private:
+   AnalogI& input_;
+   volatile bool stop_;
 };
 
 class DigitalO : public CStateDeviceBase<DigitalO>, public DAQDevice
@@ -250,13 +684,123 @@ public:
 private:
    void AddPorts(std::string deviceName);
    void AddPort(std::string line);
-   int SetupDigitalTriggering(uInt32* sequence, long numVals);
+   int SetupDigitalTriggering();
+   int ParseSequence(const std::vector<std::string>& sequence);
    int TestTriggering();
    int LoadBuffer(uInt32* sequence, long numVals);
+   int WriteState(uInt32 data);
+   int CreateOnDemandChannel();
+   int WriteSamples(long offset, long numVals);
 
    bool initialized_;
    bool busy_;
    long numPos_;
    bool open_;
    int state_;
-};
\ No newline at end of file
+   // Sequence loaded for triggering.
+   std::vector<uInt32> sequence_;
+   // Sequence being parsed, compared with sequence_ before uploading.
+   std::vector<uInt32> loadBuffer_;
+};
+class DigitalIDetectionThread;
+
+// Digital input timestamping the edges of its lines with the card's
+// change detection timing, which samples the lines on every change
+// instead of polling them.
+class DigitalI : public CGenericBase<DigitalI>, public DAQDevice
+{
+public:
+   DigitalI();
+   ~DigitalI();
+
+   // MMDevice API
+   // ------------
+   int Initialize();
+   int Shutdown();
+
+   void GetName(char* name) const;
+   bool Busy() {return false;}
+
+   // Inherited from DAQDevice
+   int TestTriggering() {return DEVICE_OK;}
+
+   // action interface
+   // ----------------
+   int OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPort(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnLineStates(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnChangeDetection(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnEdges(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnTimestampCounter(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnNotifyChanges(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnEdgeCount(MM::PropertyBase* pProp, MM::ActionType eAct, long line);
+   int OnLastEdge(MM::PropertyBase* pProp, MM::ActionType eAct, long line);
+   int OnChanges(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnEdgeRate(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRecentEdges(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+   // Called by the detection thread.
+   int AcquireEdges();
+
+private:
+   int CreateOnDemandChannel();
+   int ReadLineStates(uInt32& state);
+   int StartDetection();
+   int StartTimestamps();
+   void StopDetection();
+   double GetTimestamp(uInt32 ticks, double hostTime);
+
+   bool initialized_;
+   // Number of lines of channel_, one bit of the states each.
+   uInt32 numLines_;
+   std::string edges_;
+   // Counter timestamping the changes, empty to use the host clock.
+   std::string timestampCounter_;
+   bool notifyChanges_;
+
+   // Change detection: the detection thread is the only writer of the
+   // ring buffer and of the counts.
+   DigitalIDetectionThread* thread_;
+   bool detecting_;
+   TaskHandle timestampTask_;
+   std::chrono::steady_clock::time_point start_;
+   std::vector<uInt32> block_;
+   std::vector<uInt32> ticksBlock_;
+   // Running count of the timebase ticks, unwrapped from the 32 bit
+   // counter, and host time (s) of the last change.
+   uInt32 lastTicks_;
+   unsigned long long ticks_;
+   double lastHostTime_;
+   // Each change of the lines, with its time in ms since the start of
+   // the detection and the states after it.
+   struct EdgeEntry
+   {
+      double time;
+      uInt32 state;
+   };
+   std::vector<EdgeEntry> ring_;
+   // Number of changes written in the ring buffer.
+   std::atomic<unsigned long> written_;
+   MMThreadLock lock_;
+   uInt32 state_;
+   std::vector<unsigned long> edgeCounts_;
+   // Time (ms) of the last counted edge of each line, -1 if none.
+   std::vector<double> lastEdges_;
+};
+
+class DigitalIDetectionThread : public MMDeviceThreadBase
+{
+public:
+   DigitalIDetectionThread(DigitalI& input);
+   ~DigitalIDetectionThread();
+   int svc();
+   int open (void*) { return 0;}
+   int close(unsigned long) {return 0;}
+
+   void Start();
+   void Stop() {stop_ = true;}
+
+private:
+   DigitalI& input_;
+   volatile bool stop_;
+};
@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          NI100XBenchmark.cpp
+// PROJECT:       100X micro-manager extensions
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Times the on-demand calls and the sequence loads of NI100X
+//                against the in-memory DAQmx stand-in, without a card nor
+//                the Micro-Manager core. Run by "make check"; fails if a
+//                call fails. The stand-in latencies are set with
+//                NI100X_STANDIN_LATENCY_US and NI100X_STANDIN_TASK_LATENCY_US.
+//
+// AUTHOR:        NI100X adapter contributors, 2026
+//
+// COPYRIGHT:     The NI100X adapter authors
+//
+
+#include "NI100X.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Property names, defined in NI100X.cpp
+extern const char* g_PropertyChannel;
+extern const char* g_PropertyDoubleBuffering;
+
+// Number of repetitions of each timed call.
+const int g_BenchIterations = 1000;
+// Samples of each loaded sequence.
+const int g_BenchSequenceLength = 1000;
+// Sequence loads timed, fewer as each one builds a task.
+const int g_BenchSequenceLoads = 50;
+
+typedef std::chrono::steady_clock Clock;
+
+static int Report(const char* name, int error, Clock::time_point start, int calls)
+{
+   if (error != DEVICE_OK)
+   {
+      printf("%s: failed with error %d\n", name, error);
+      return error;
+   }
+   double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+   printf("%-36s %9.4f ms per call\n", name, elapsed / calls);
+   return DEVICE_OK;
+}
+
+// AnalogO::ApplyVoltage through the Volts property, then sequence loads,
+// rebuilding the task each time or double buffered.
+static int RunAnalogO(bool doubleBuffering)
+{
+   AnalogO device;
+   int error = device.SetProperty(g_PropertyChannel, "Dev1/ao0");
+   if (error == DEVICE_OK)
+   {
+      error = device.Initialize();
+   }
+   if (error == DEVICE_OK)
+   {
+      error = device.SetProperty(g_PropertyDoubleBuffering, doubleBuffering ? "Yes" : "No");
+   }
+   if (error != DEVICE_OK)
+   {
+      return Report("AnalogO initialization", error, Clock::now(), 1);
+   }
+
+   Clock::time_point start = Clock::now();
+   for (int i = 0; i < g_BenchIterations && error == DEVICE_OK; ++i)
+   {
+      error = device.SetSignal((i % 50) * 0.1);
+   }
+   error = Report("AnalogO ApplyVoltage", error, start, g_BenchIterations);
+
+   if (error == DEVICE_OK)
+   {
+      start = Clock::now();
+      for (int k = 0; k < g_BenchSequenceLoads && error == DEVICE_OK; ++k)
+      {
+         error = device.ClearDASequence();
+         for (int i = 0; i < g_BenchSequenceLength && error == DEVICE_OK; ++i)
+         {
+            error = device.AddToDASequence((i % 50) * 0.1);
+         }
+         if (error == DEVICE_OK)
+         {
+            error = device.StartDASequence();
+         }
+         if (error == DEVICE_OK)
+         {
+            error = device.StopDASequence();
+         }
+      }
+      error = Report(doubleBuffering ? "AnalogO sequence load, double buffered" :
+         "AnalogO sequence load", error, start, g_BenchSequenceLoads);
+   }
+   device.Shutdown();
+   return error;
+}
+
+// DigitalO::OnState through the State property.
+static int RunDigitalO()
+{
+   DigitalO device;
+   int error = device.SetProperty(g_PropertyChannel, "Dev1/port0/line0:3");
+   if (error == DEVICE_OK)
+   {
+      error = device.Initialize();
+   }
+   if (error != DEVICE_OK)
+   {
+      return Report("DigitalO initialization", error, Clock::now(), 1);
+   }
+
+   Clock::time_point start = Clock::now();
+   for (int i = 0; i < g_BenchIterations && error == DEVICE_OK; ++i)
+   {
+      error = device.SetProperty(MM::g_Keyword_State, std::to_string(i % 16).c_str());
+   }
+   error = Report("DigitalO OnState", error, start, g_BenchIterations);
+   device.Shutdown();
+   return error;
+}
+
+// AnalogI::GetSignal, read on demand.
+static int RunAnalogI()
+{
+   AnalogI device;
+   int error = device.SetProperty(g_PropertyChannel, "Dev1/ai0");
+   if (error == DEVICE_OK)
+   {
+      error = device.Initialize();
+   }
+   if (error != DEVICE_OK)
+   {
+      return Report("AnalogI initialization", error, Clock::now(), 1);
+   }
+
+   double volts = 0.0;
+   Clock::time_point start = Clock::now();
+   for (int i = 0; i < g_BenchIterations && error == DEVICE_OK; ++i)
+   {
+      error = device.GetSignal(volts);
+   }
+   error = Report("AnalogI GetSignal", error, start, g_BenchIterations);
+   device.Shutdown();
+   return error;
+}
+
+int main()
+{
+   int error = RunAnalogO(false);
+   if (error == DEVICE_OK)
+   {
+      error = RunAnalogO(true);
+   }
+   if (error == DEVICE_OK)
+   {
+      error = RunDigitalO();
+   }
+   if (error == DEVICE_OK)
+   {
+      error = RunAnalogI();
+   }
+   return error == DEVICE_OK ? 0 : 1;
+}